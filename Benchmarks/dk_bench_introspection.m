@@ -0,0 +1,116 @@
+/** Benchmark for the memory used by introspection trees.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool measures how much memory the introspection tree of a single proxy
+ * occupies. It parses the same introspection data (either read from a file or
+ * obtained from the bus object on the session bus) into a number of
+ * independent object path nodes, exactly the way a proxy builds its method
+ * cache, and reports the growth of the resident set size per tree.
+ *
+ * Usage: dk_bench_introspection [trees] [introspection.xml]
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+#import "../Source/DKIntrospectionParserDelegate.h"
+#import "../Source/DKObjectPathNode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static long
+DKBenchResidentKB(void)
+{
+  long pages = 0;
+  long resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (NULL == statm)
+  {
+    return 0;
+  }
+  if (2 != fscanf(statm, "%ld %ld", &pages, &resident))
+  {
+    resident = 0;
+  }
+  fclose(statm);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static DKObjectPathNode*
+DKBenchBuildTree(NSData *data)
+{
+  DKObjectPathNode *root = [[DKObjectPathNode alloc] initWithName: @"/"
+                                                           parent: nil];
+  DKIntrospectionParserDelegate *delegate =
+    [[DKIntrospectionParserDelegate alloc] initWithParentForNodes: root];
+  NSXMLParser *parser = [[NSXMLParser alloc] initWithData: data];
+  [parser setDelegate: delegate];
+  [parser parse];
+  [parser release];
+  [delegate release];
+  return root;
+}
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSMutableArray *trees = [NSMutableArray array];
+  NSData *data = nil;
+  long count = 1000;
+  long baseline = 0;
+  long after = 0;
+  long i;
+
+  if (argc > 1)
+  {
+    count = MAX(1, strtol(argv[1], NULL, 10));
+  }
+  if (argc > 2)
+  {
+    data = [NSData dataWithContentsOfFile:
+      [NSString stringWithUTF8String: argv[2]]];
+  }
+  else
+  {
+    data = [[(id)[DKDBus sessionBus] Introspect]
+      dataUsingEncoding: NSUTF8StringEncoding];
+  }
+  if (0 == [data length])
+  {
+    fprintf(stderr, "No introspection data available.\n");
+    [arp release];
+    return 1;
+  }
+
+  // Build one tree up front so that one-time allocations are not counted:
+  [trees addObject: [DKBenchBuildTree(data) autorelease]];
+  baseline = DKBenchResidentKB();
+  for (i = 0; i < count; i++)
+  {
+    NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+    [trees addObject: [DKBenchBuildTree(data) autorelease]];
+    [loopPool release];
+  }
+  after = DKBenchResidentKB();
+  printf("%ld trees from %lu bytes of XML: %ld KB total, %.2f KB per tree\n",
+    count, (unsigned long)[data length], after - baseline,
+    (double)(after - baseline) / count);
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,176 @@
+/** Benchmark for the round-trip latency of method calls.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool measures the latency distribution of method calls to the bus
+ * object on the session bus, first with the worker thread in its default mode
+ * and then in the low-latency mode (see +[DKPort
+ * setWorkerThreadCPU:schedulingPriority:busyPollInterval:]). The calls are
+ * spaced out by a short pause, so that the worker thread goes to sleep between
+ * calls in the default mode, which is where the low-latency mode is supposed
+ * to help. The median, 99th and 99.9th percentile and the maximum are reported
+ * for both modes.
+ *
+ * Usage: dk_bench_latency [calls] [cpu] [priority] [poll-usec] [pause-usec]
+ *
+ * By default, the worker is not pinned to a CPU and keeps its scheduling
+ * policy, busy-polls for 1000 microseconds and the calls are 50 microseconds
+ * apart.
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+@interface NSObject (DKBenchLatencyMethods)
+- (NSString*)GetId;
+@end
+
+static double
+DKBenchNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+static int
+DKBenchCompareDoubles(const void *a, const void *b)
+{
+  double left = *(const double*)a;
+  double right = *(const double*)b;
+  if (left < right)
+  {
+    return -1;
+  }
+  return (left > right) ? 1 : 0;
+}
+
+static double
+DKBenchPercentile(double *sorted, long count, double fraction)
+{
+  long index = (long)(fraction * (count - 1) + 0.5);
+  return sorted[MIN(index, count - 1)];
+}
+
+/*
+ * Performs the calls and prints the latency distribution. Returns NO if a call
+ * failed.
+ */
+static BOOL
+DKBenchRun(const char *label, id bus, double *samples, long count,
+  useconds_t pause)
+{
+  long i;
+  // Warm up the connection and the method cache:
+  for (i = 0; i < 100; i++)
+  {
+    [bus GetId];
+  }
+  for (i = 0; i < count; i++)
+  {
+    NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+    double start = DKBenchNow();
+    NSString *busID = [bus GetId];
+    samples[i] = (DKBenchNow() - start) * 1e6;
+    [loopPool release];
+    if (nil == busID)
+    {
+      fprintf(stderr, "%s: call %ld failed.\n", label, i);
+      return NO;
+    }
+    if (pause > 0)
+    {
+      usleep(pause);
+    }
+  }
+  qsort(samples, count, sizeof(double), DKBenchCompareDoubles);
+  printf("%-12s %ld calls: p50 %8.1f us, p99 %8.1f us, p99.9 %8.1f us, "
+    "max %8.1f us\n", label, count,
+    DKBenchPercentile(samples, count, 0.5),
+    DKBenchPercentile(samples, count, 0.99),
+    DKBenchPercentile(samples, count, 0.999),
+    samples[count - 1]);
+  return YES;
+}
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  long count = 10000;
+  long cpu = -1;
+  long priority = 0;
+  long pollUsec = 1000;
+  long pauseUsec = 50;
+  double *samples = NULL;
+  id bus = nil;
+  int status = 0;
+
+  if (argc > 1)
+  {
+    count = MAX(1, strtol(argv[1], NULL, 10));
+  }
+  if (argc > 2)
+  {
+    cpu = strtol(argv[2], NULL, 10);
+  }
+  if (argc > 3)
+  {
+    priority = MAX(0, strtol(argv[3], NULL, 10));
+  }
+  if (argc > 4)
+  {
+    pollUsec = MAX(0, strtol(argv[4], NULL, 10));
+  }
+  if (argc > 5)
+  {
+    pauseUsec = MAX(0, strtol(argv[5], NULL, 10));
+  }
+
+  [DKPort enableWorkerThread];
+  bus = [DKDBus sessionBus];
+  samples = malloc(count * sizeof(double));
+  if ((nil == bus) || (NULL == samples))
+  {
+    fprintf(stderr, "Could not connect to the session bus.\n");
+    free(samples);
+    [arp release];
+    return 1;
+  }
+
+  if (NO == DKBenchRun("default", bus, samples, count, pauseUsec))
+  {
+    status = 1;
+  }
+  [DKPort setWorkerThreadCPU: cpu
+          schedulingPriority: priority
+            busyPollInterval: pollUsec / 1e6];
+  if (NO == DKBenchRun("low-latency", bus, samples, count, pauseUsec))
+  {
+    status = 1;
+  }
+  [DKPort setWorkerThreadCPU: -1
+          schedulingPriority: 0
+            busyPollInterval: 0];
+  free(samples);
+  [arp release];
+  return status;
+}
@@ -0,0 +1,167 @@
+/** Benchmark for marshalling deeply nested values.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool marshalls nested values into a D-Bus message and unmarshalls them
+ * again, without a message bus, and reports the time per message for each
+ * direction. The workloads nest containers of one kind to the given depth:
+ *
+ * - struct:   Structs containing an integer and the next level, e.g. (i(i(i))).
+ * - array:    Arrays of arrays, e.g. aaai, with two elements per level.
+ * - variant:  String to variant dictionaries (a{sv}), each holding an integer
+ *             and the dictionary for the next level.
+ *
+ * Every container level used to set up an exception handler, so these numbers
+ * are best compared between builds of DBusKit.
+ *
+ * Usage: dk_bench_marshalling [depth] [iterations]
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+#import "../Source/DKArgument.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double
+DKBenchNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+static id
+DKBenchStructValue(long depth)
+{
+  NSNumber *number = [NSNumber numberWithLong: depth];
+  if (depth <= 1)
+  {
+    return [NSArray arrayWithObject: number];
+  }
+  return [NSArray arrayWithObjects: number,
+    DKBenchStructValue(depth - 1), nil];
+}
+
+static NSString*
+DKBenchStructSignature(long depth)
+{
+  if (depth <= 1)
+  {
+    return @"(i)";
+  }
+  return [NSString stringWithFormat: @"(i%@)",
+    DKBenchStructSignature(depth - 1)];
+}
+
+static id
+DKBenchArrayValue(long depth)
+{
+  if (0 == depth)
+  {
+    return [NSNumber numberWithInt: 42];
+  }
+  return [NSArray arrayWithObjects: DKBenchArrayValue(depth - 1),
+    DKBenchArrayValue(depth - 1), nil];
+}
+
+static id
+DKBenchVariantValue(long depth)
+{
+  NSNumber *number = [NSNumber numberWithLong: depth];
+  if (depth <= 1)
+  {
+    return [NSDictionary dictionaryWithObject: number
+                                       forKey: @"value"];
+  }
+  return [NSDictionary dictionaryWithObjectsAndKeys: number, @"value",
+    DKBenchVariantValue(depth - 1), @"child", nil];
+}
+
+static void
+DKBenchRun(const char *label, NSString *signature, id value, long iterations)
+{
+  DKArgument *arg = [[DKArgument alloc] initWithDBusSignature: [signature UTF8String]
+                                                         name: nil
+                                                       parent: nil];
+  double marshallTime = 0;
+  double unmarshallTime = 0;
+  long i;
+  if (nil == arg)
+  {
+    fprintf(stderr, "%s: invalid signature %s\n", label,
+      [signature UTF8String]);
+    return;
+  }
+  for (i = 0; i < iterations; i++)
+  {
+    NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+    DBusMessage *msg = dbus_message_new_signal("/org/gnustep/DBusKit/Bench",
+      "org.gnustep.DBusKit.Bench", "Nested");
+    DBusMessageIter iter;
+    double start = 0;
+    dbus_message_iter_init_append(msg, &iter);
+    start = DKBenchNow();
+    [arg marshallObject: value
+           intoIterator: &iter];
+    marshallTime += DKBenchNow() - start;
+    dbus_message_iter_init(msg, &iter);
+    start = DKBenchNow();
+    [arg unmarshalledObjectFromIterator: &iter];
+    unmarshallTime += DKBenchNow() - start;
+    dbus_message_unref(msg);
+    [loopPool release];
+  }
+  printf("%-8s %ld messages: marshall %8.2f us, unmarshall %8.2f us per message\n",
+    label, iterations, (marshallTime * 1e6) / iterations,
+    (unmarshallTime * 1e6) / iterations);
+  [arg release];
+}
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  long depth = 8;
+  long iterations = 10000;
+  NSMutableString *arraySignature = [NSMutableString string];
+  long i;
+
+  if (argc > 1)
+  {
+    depth = MAX(1, strtol(argv[1], NULL, 10));
+  }
+  if (argc > 2)
+  {
+    iterations = MAX(1, strtol(argv[2], NULL, 10));
+  }
+
+  for (i = 0; i < depth; i++)
+  {
+    [arraySignature appendString: @"a"];
+  }
+  [arraySignature appendString: @"i"];
+
+  printf("Nesting depth %ld\n", depth);
+  DKBenchRun("struct", DKBenchStructSignature(depth),
+    DKBenchStructValue(depth), iterations);
+  DKBenchRun("array", arraySignature, DKBenchArrayValue(depth), iterations);
+  DKBenchRun("variant", @"a{sv}", DKBenchVariantValue(depth), iterations);
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,134 @@
+/** Benchmark for the memory high-water mark under sustained message load.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool sends a stream of method calls to the session bus and emits
+ * signals to itself, which are received and delivered by the worker thread.
+ * While doing so, it samples the resident set size and finally reports the
+ * baseline, the peak growth over the baseline and the growth that remained at
+ * the end of the run.
+ *
+ * Usage: dk_bench_memory [messages]
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+#import "../Source/DKProxy+Private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static long
+DKBenchResidentKB(void)
+{
+  long pages = 0;
+  long resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (NULL == statm)
+  {
+    return 0;
+  }
+  if (2 != fscanf(statm, "%ld %ld", &pages, &resident))
+  {
+    resident = 0;
+  }
+  fclose(statm);
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+@interface DKBenchSink: NSObject
+{
+  @public
+  long received;
+}
+- (void)ping: (NSNotification*)n;
+@end
+
+@implementation DKBenchSink
+- (void)ping: (NSNotification*)n
+{
+  received++;
+}
+@end
+
+static int
+DKBenchRun(long messages)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  DKNotificationCenter *center = nil;
+  DKBenchSink *sink = [[DKBenchSink new] autorelease];
+  id bus = nil;
+  long baseline = 0;
+  long peak = 0;
+  long now = 0;
+  long i;
+
+  [DKPort enableWorkerThread];
+  bus = [DKDBus sessionBus];
+  center = [DKNotificationCenter sessionBusCenter];
+  [center addObserver: sink
+             selector: @selector(ping:)
+               signal: @"Ping"
+            interface: @"org.gnustep.DBusKit.Benchmark"
+               sender: nil
+          destination: nil];
+
+  // Warm up so that the baseline includes the caches:
+  [(id<DKDBusStub>)bus GetNameOwner: @"org.freedesktop.DBus"];
+  baseline = DKBenchResidentKB();
+  peak = baseline;
+
+  for (i = 0; i < messages; i++)
+  {
+    NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+    [(id<DKDBusStub>)bus GetNameOwner: @"org.freedesktop.DBus"];
+    [center postSignalName: @"Ping"
+                 interface: @"org.gnustep.DBusKit.Benchmark"
+                    object: sink
+                  userInfo: [NSDictionary dictionaryWithObjectsAndKeys:
+                              [NSString stringWithFormat: @"message %ld", i], @"arg0",
+                              nil]];
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate date]];
+    if (0 == (i % 64))
+    {
+      now = DKBenchResidentKB();
+      peak = MAX(peak, now);
+    }
+    [loopPool release];
+  }
+  [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                           beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.5]];
+  now = DKBenchResidentKB();
+  peak = MAX(peak, now);
+  printf("%7ld messages  %6ld signals received  baseline %7ld KB  peak +%6ld KB  final +%6ld KB\n",
+    messages, sink->received, baseline, peak - baseline, now - baseline);
+  [center removeObserver: sink];
+  [arp release];
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  long messages = 20000;
+  if (argc > 1)
+  {
+    messages = MAX(1, strtol(argv[1], NULL, 10));
+  }
+  return DKBenchRun(messages);
+}
@@ -0,0 +1,310 @@
+/** Tool for recording D-Bus traffic and replaying it through DBusKit's decoder.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool replays a capture file, as written by
+ * -[DKPort startCapturingToFile:], through the code paths DBusKit uses to
+ * decode incoming messages, at full speed and without a message bus:
+ *
+ * - Signals are decoded and matched by a notification center that is not
+ *   connected to a bus, using the code -_handleMessage: uses for signals
+ *   received from the bus, and are then posted to an observer.
+ * - Method calls, replies and errors have their arguments unmarshalled into
+ *   boxed objects, as done for invocations and method returns.
+ *
+ * It reports throughput for the whole capture, so it can be run under a
+ * profiler to find decoding hot spots using real traffic.
+ *
+ * Usage: dk_bench_replay <capture> [iterations]
+ *        dk_bench_replay -record <capture> <seconds>
+ *
+ * In record mode, the tool observes all signals on the session bus for the
+ * given time and captures the traffic of its connection.
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+#import "../Source/DKArgument.h"
+#import "../Source/DKMessageCapture.h"
+#import "../Source/DKObjectPathNode.h"
+#import "../Source/DKSignal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static NSString *DKReplayNotification = @"DKReplayNotification";
+
+@interface DKNotificationCenter (DKNotificationCenterPrivate)
+- (id)_initWithoutBus;
+- (NSArray*)_observablesMatchingMessage: (DBusMessage*)msg
+                               userInfo: (NSDictionary**)userInfo
+                                 signal: (DKSignal**)signal
+                                standin: (DKProxyStandin**)standin;
+@end
+
+@interface DKReplayObserver: NSObject
+{
+  @public
+  unsigned long long received;
+}
+- (void)receive: (NSNotification*)notification;
+@end
+
+@implementation DKReplayObserver
+- (void)receive: (NSNotification*)notification
+{
+  received++;
+}
+@end
+
+static double
+DKReplayNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+/*
+ * Creates the arguments for the complete types in <var>signature</var>,
+ * parented to <var>parent</var>.
+ */
+static NSMutableArray*
+DKReplayArgumentsForSignature(const char *signature, id parent)
+{
+  NSMutableArray *args = [NSMutableArray array];
+  DBusSignatureIter iter;
+  if ((NULL == signature) || ('\0' == signature[0]))
+  {
+    return args;
+  }
+  dbus_signature_iter_init(&iter, signature);
+  do
+  {
+    char *sig = dbus_signature_iter_get_signature(&iter);
+    DKArgument *arg = [[DKArgument alloc] initWithDBusSignature: sig
+                                                           name: nil
+                                                         parent: parent];
+    [args addObject: arg];
+    [arg release];
+    dbus_free(sig);
+  } while (dbus_signature_iter_next(&iter));
+  return args;
+}
+
+static void
+DKReplaySignal(DBusMessage *msg, DKNotificationCenter *decoder,
+  NSNotificationCenter *center)
+{
+  NSDictionary *userInfo = nil;
+  [decoder _observablesMatchingMessage: msg
+                              userInfo: &userInfo
+                                signal: NULL
+                               standin: NULL];
+  [center postNotificationName: DKReplayNotification
+                        object: nil
+                      userInfo: userInfo];
+}
+
+static void
+DKReplayArguments(DBusMessage *msg, NSMutableDictionary *cache)
+{
+  DBusMessageIter iter;
+  const char *signature = dbus_message_get_signature(msg);
+  NSString *key = nil;
+  NSArray *args = nil;
+  NSUInteger count = 0;
+  NSUInteger i = 0;
+  if (NO == (BOOL)dbus_message_iter_init(msg, &iter))
+  {
+    return;
+  }
+  key = [NSString stringWithUTF8String: signature];
+  args = [cache objectForKey: key];
+  if (nil == args)
+  {
+    args = DKReplayArgumentsForSignature(signature, nil);
+    [cache setObject: args forKey: key];
+  }
+  count = [args count];
+  for (i = 0; i < count; i++)
+  {
+    [[args objectAtIndex: i] unmarshalledObjectFromIterator: &iter];
+    if (NO == (BOOL)dbus_message_iter_next(&iter))
+    {
+      break;
+    }
+  }
+}
+
+static int
+DKReplayRecord(const char *path, double seconds)
+{
+  DKPort *port = [DKPort sessionBusPort];
+  DKReplayObserver *observer = [[DKReplayObserver new] autorelease];
+  NSDate *end = [NSDate dateWithTimeIntervalSinceNow: seconds];
+  if (NO == [port startCapturingToFile: [NSString stringWithUTF8String: path]])
+  {
+    fprintf(stderr, "Could not create %s\n", path);
+    return 1;
+  }
+  [[DKNotificationCenter sessionBusCenter] addObserver: observer
+                                              selector: @selector(receive:)
+                                                signal: nil
+                                             interface: nil
+                                                sender: nil
+                                           destination: nil];
+  while ([end timeIntervalSinceNow] > 0)
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: end];
+  }
+  [port stopCapturing];
+  printf("Captured traffic for %.1f seconds (%llu signals observed)\n",
+    seconds, observer->received);
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  DKMessageCapture *capture = nil;
+  NSMutableData *messages = [NSMutableData data];
+  DKNotificationCenter *decoder = nil;
+  NSMutableDictionary *argumentCache = [NSMutableDictionary dictionary];
+  NSNotificationCenter *center = [[NSNotificationCenter new] autorelease];
+  DKReplayObserver *observer = [[DKReplayObserver new] autorelease];
+  DBusMessage *msg = NULL;
+  DBusMessage **all = NULL;
+  unsigned long long bytes = 0;
+  unsigned long long counts[DBUS_NUM_MESSAGE_TYPES];
+  unsigned long long failures = 0;
+  NSUInteger count = 0;
+  long iterations = 100;
+  long i;
+  NSUInteger j;
+  double start = 0;
+  double elapsed = 0;
+
+  if ((argc > 3) && (0 == strcmp(argv[1], "-record")))
+  {
+    int result = DKReplayRecord(argv[2], strtod(argv[3], NULL));
+    [arp release];
+    return result;
+  }
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: %s <capture> [iterations]\n"
+      "       %s -record <capture> <seconds>\n", argv[0], argv[0]);
+    [arp release];
+    return 1;
+  }
+  if (argc > 2)
+  {
+    iterations = MAX(1, strtol(argv[2], NULL, 10));
+  }
+
+  capture = [[[DKMessageCapture alloc] initForReadingAtPath:
+    [NSString stringWithUTF8String: argv[1]]] autorelease];
+  if (nil == capture)
+  {
+    [arp release];
+    return 1;
+  }
+  while (NULL != (msg = [capture nextMessageOutgoing: NULL
+                                           timestamp: NULL]))
+  {
+    char *buffer = NULL;
+    int length = 0;
+    if (dbus_message_marshal(msg, &buffer, &length))
+    {
+      bytes += (unsigned long long)length;
+      dbus_free(buffer);
+    }
+    [messages appendBytes: &msg length: sizeof(DBusMessage*)];
+  }
+  all = (DBusMessage**)[messages mutableBytes];
+  count = [messages length] / sizeof(DBusMessage*);
+  if (0 == count)
+  {
+    fprintf(stderr, "No messages in capture.\n");
+    [arp release];
+    return 1;
+  }
+
+  decoder = [[DKNotificationCenter alloc] _initWithoutBus];
+  [center addObserver: observer
+             selector: @selector(receive:)
+                 name: DKReplayNotification
+               object: nil];
+  memset(counts, 0, sizeof(counts));
+  start = DKReplayNow();
+  for (i = 0; i < iterations; i++)
+  {
+    for (j = 0; j < count; j++)
+    {
+      NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+      int type = dbus_message_get_type(all[j]);
+      NS_DURING
+      {
+        if (DBUS_MESSAGE_TYPE_SIGNAL == type)
+        {
+          DKReplaySignal(all[j], decoder, center);
+        }
+        else
+        {
+          DKReplayArguments(all[j], argumentCache);
+        }
+      }
+      NS_HANDLER
+      {
+        failures++;
+      }
+      NS_ENDHANDLER
+      if ((type >= 0) && (type < DBUS_NUM_MESSAGE_TYPES))
+      {
+        counts[type]++;
+      }
+      [loopPool release];
+    }
+  }
+  elapsed = DKReplayNow() - start;
+
+  printf("%lu messages (%llu bytes) x %ld iterations in %.3f s\n",
+    (unsigned long)count, bytes, iterations, elapsed);
+  printf("%.0f messages/s, %.2f MB/s, %.2f us/message\n",
+    (count * iterations) / elapsed,
+    ((bytes * iterations) / elapsed) / (1024 * 1024),
+    (elapsed * 1e6) / (count * iterations));
+  printf("calls: %llu, returns: %llu, errors: %llu, signals: %llu "
+    "(%llu delivered), decoding failures: %llu\n",
+    counts[DBUS_MESSAGE_TYPE_METHOD_CALL] / iterations,
+    counts[DBUS_MESSAGE_TYPE_METHOD_RETURN] / iterations,
+    counts[DBUS_MESSAGE_TYPE_ERROR] / iterations,
+    counts[DBUS_MESSAGE_TYPE_SIGNAL] / iterations,
+    observer->received / iterations,
+    failures / iterations);
+
+  [center removeObserver: observer];
+  for (j = 0; j < count; j++)
+  {
+    dbus_message_unref(all[j]);
+  }
+  [arp release];
+  return 0;
+}
@@ -0,0 +1,128 @@
+/** Benchmark for the startup cost of linking DBusKit.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool repeatedly spawns itself and measures the wall clock time it takes
+ * for the child process to start, touch the DBusKit classes an application
+ * would typically reference and exit again. In "unused" mode, no D-Bus object
+ * is used, so no connection should be made and no worker thread should be
+ * started. In "connected" mode, the child obtains a port to the session bus,
+ * which gives the baseline cost of actually setting up the connection.
+ *
+ * Usage: dk_bench_startup [iterations]
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+#import "../Source/DKEndpointManager.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static double
+DKBenchNow(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int
+DKBenchChild(const char *mode)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  DKEndpointManager *manager = [DKEndpointManager sharedEndpointManager];
+  [DKPort enableWorkerThread];
+  [DKNotificationCenter class];
+  [DKPortNameServer class];
+  if (0 == strcmp(mode, "connected"))
+  {
+    [DKPort sessionBusPort];
+  }
+  else if ([[manager workerThread] isExecuting])
+  {
+    fprintf(stderr, "Worker thread was started without using the bus.\n");
+    [arp release];
+    return 1;
+  }
+  [arp release];
+  return 0;
+}
+
+static double
+DKBenchSpawn(const char *argv0, const char *mode)
+{
+  double start = DKBenchNow();
+  int status = 0;
+  pid_t pid = fork();
+  if (0 == pid)
+  {
+    execl(argv0, argv0, "--child", mode, (char*)NULL);
+    _exit(127);
+  }
+  waitpid(pid, &status, 0);
+  if ((NO == WIFEXITED(status)) || (0 != WEXITSTATUS(status)))
+  {
+    fprintf(stderr, "Child process in mode '%s' failed.\n", mode);
+  }
+  return DKBenchNow() - start;
+}
+
+static void
+DKBenchRun(const char *argv0, const char *mode, long iterations)
+{
+  double total = 0;
+  double min = 0;
+  double max = 0;
+  long i;
+  for (i = 0; i < iterations; i++)
+  {
+    double t = DKBenchSpawn(argv0, mode);
+    total += t;
+    if ((0 == i) || (t < min))
+    {
+      min = t;
+    }
+    if (t > max)
+    {
+      max = t;
+    }
+  }
+  printf("%-10s %6ld runs  mean %8.3f ms  min %8.3f ms  max %8.3f ms\n",
+    mode, iterations, (total / iterations) * 1000.0, min * 1000.0,
+    max * 1000.0);
+}
+
+int
+main(int argc, char **argv)
+{
+  long iterations = 50;
+  if ((argc == 3) && (0 == strcmp(argv[1], "--child")))
+  {
+    return DKBenchChild(argv[2]);
+  }
+  if (argc > 1)
+  {
+    iterations = MAX(1, strtol(argv[1], NULL, 10));
+  }
+  DKBenchRun(argv[0], "unused", iterations);
+  DKBenchRun(argv[0], "connected", iterations);
+  return 0;
+}
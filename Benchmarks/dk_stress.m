@@ -0,0 +1,649 @@
+/** Multi-threaded stress and scaling test for DBusKit.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+
+/*
+ * This tool hammers DBusKit from an increasing number of threads (1, 2, 4, ...
+ * up to the given maximum) and reports the throughput for every step. It runs
+ * the following workloads against a private dbus-daemon that it starts itself:
+ *
+ * - proxy:    Calls a method on a single proxy shared by all threads.
+ * - init:     Has all threads obtain and call a freshly created proxy at the
+ *             same time, so that they race on the state machine that makes
+ *             callers wait for the introspection data.
+ * - observe:  Adds and removes observers in the notification center while
+ *             acquiring and releasing bus names, and checks that none of the
+ *             resulting NameOwnerChanged signals is lost.
+ * - export:   Calls a method on an object exported by the process itself.
+ *
+ * Every workload runs under a watchdog: If a thread makes no progress before
+ * the timeout expires, the tool reports the threads that are stuck (which
+ * indicates a deadlock or a lost wakeup in DKEndpointManager, DKProxy or
+ * DKNotificationCenter) and exits with status 2. Lost signals and failed
+ * calls make it exit with status 1.
+ *
+ * Usage: dk_stress [max-threads] [seconds-per-step] [timeout]
+ *
+ * Set DK_STRESS_USE_SESSION_BUS to run against the existing session bus
+ * instead of a private daemon.
+ */
+
+#import <Foundation/Foundation.h>
+#import "DBusKit/DBusKit.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DKStressServiceName @"org.gnustep.DBusKit.Stress"
+#define DKStressObjectPath @"/org/gnustep/DBusKit/Stress"
+#define DKStressNamePrefix @"org.gnustep.DBusKit.Stress.T"
+
+@interface NSObject (DKStressMethods)
+- (BOOL)NameHasOwner: (NSString*)name;
+- (NSString*)echo: (NSString*)string;
+@end
+
+static pid_t daemonPID = 0;
+
+static double
+DKStressNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+static void
+DKStressStopDaemon(void)
+{
+  if (daemonPID > 0)
+  {
+    kill(daemonPID, SIGTERM);
+    waitpid(daemonPID, NULL, 0);
+    daemonPID = 0;
+  }
+}
+
+/*
+ * Starts a private session bus and points DBUS_SESSION_BUS_ADDRESS at it. This
+ * needs to happen before DBusKit connects to the bus for the first time.
+ */
+static BOOL
+DKStressStartDaemon(void)
+{
+  int fds[2];
+  char address[1024];
+  ssize_t length = 0;
+  ssize_t got = 0;
+  if (0 != pipe(fds))
+  {
+    return NO;
+  }
+  daemonPID = fork();
+  if (daemonPID < 0)
+  {
+    return NO;
+  }
+  if (0 == daemonPID)
+  {
+    char fdArg[32];
+    close(fds[0]);
+    snprintf(fdArg, sizeof(fdArg), "--print-address=%d", fds[1]);
+    execlp("dbus-daemon", "dbus-daemon", "--session", "--nofork", fdArg,
+      (char*)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+  while ((length < (ssize_t)sizeof(address) - 1)
+    && ((got = read(fds[0], address + length,
+      sizeof(address) - 1 - length)) > 0))
+  {
+    length += got;
+    if (NULL != memchr(address, '\n', length))
+    {
+      break;
+    }
+  }
+  close(fds[0]);
+  if (length <= 0)
+  {
+    DKStressStopDaemon();
+    return NO;
+  }
+  address[length] = '\0';
+  address[strcspn(address, "\n")] = '\0';
+  setenv("DBUS_SESSION_BUS_ADDRESS", address, 1);
+  atexit(DKStressStopDaemon);
+  return YES;
+}
+
+/*
+ * Per-thread progress, sampled by the watchdog.
+ */
+typedef struct
+{
+  volatile unsigned long long operations;
+  volatile unsigned long long errors;
+  volatile double lastProgress;
+  volatile double maxLatency;
+  volatile int finished;
+} DKStressThreadState;
+
+/*
+ * The object exported by the process.
+ */
+@interface DKStressEcho: NSObject
+- (NSString*)echo: (NSString*)string;
+@end
+
+@implementation DKStressEcho
+- (NSString*)echo: (NSString*)string
+{
+  return string;
+}
+@end
+
+/*
+ * Counts the NameOwnerChanged signals for the names the workers acquire.
+ */
+@interface DKStressSignalCounter: NSObject
+{
+  @public
+  volatile unsigned long long received;
+}
+- (void)nameOwnerChanged: (NSNotification*)notification;
+- (void)ignore: (NSNotification*)notification;
+@end
+
+@implementation DKStressSignalCounter
+- (void)nameOwnerChanged: (NSNotification*)notification
+{
+  NSString *name = [[notification userInfo] objectForKey: @"arg0"];
+  if ([name isKindOfClass: [NSString class]]
+    && [name hasPrefix: DKStressNamePrefix])
+  {
+    __sync_fetch_and_add(&received, 1);
+  }
+}
+
+- (void)ignore: (NSNotification*)notification
+{
+}
+@end
+
+@interface DKStressRunner: NSObject
+{
+  DKStressThreadState *states;
+  NSUInteger threadCount;
+  SEL operation;
+  unsigned long long operationLimit;
+  volatile int stop;
+  NSCondition *barrier;
+  NSUInteger waiting;
+  NSUInteger generation;
+  id sharedProxy;
+  id exportedProxy;
+  NSConnection *exportConnection;
+  DKStressSignalCounter *counter;
+  volatile unsigned long long expectedSignals;
+  double timeout;
+}
+- (id)initWithTimeout: (double)seconds;
+- (BOOL)setUp;
+- (BOOL)hasExportedProxy;
+- (BOOL)runOperation: (SEL)selector
+             threads: (NSUInteger)count
+            duration: (double)seconds
+               limit: (unsigned long long)limit
+       operationsOut: (unsigned long long*)ops
+           errorsOut: (unsigned long long*)errors
+       maxLatencyOut: (double*)maxLatency;
+- (BOOL)waitForSignals;
+@end
+
+@implementation DKStressRunner
+- (id)initWithTimeout: (double)seconds
+{
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  timeout = seconds;
+  barrier = [NSCondition new];
+  counter = [DKStressSignalCounter new];
+  return self;
+}
+
+- (BOOL)setUp
+{
+  NSConnection *conn = nil;
+  DKPort *port = [DKPort port];
+  BOOL success = YES;
+  [DKPort enableWorkerThread];
+  sharedProxy = [[DKDBus sessionBus] retain];
+  [[DKNotificationCenter sessionBusCenter] addObserver: counter
+                                              selector: @selector(nameOwnerChanged:)
+                                                signal: @"NameOwnerChanged"
+                                             interface: @"org.freedesktop.DBus"
+                                                sender: sharedProxy
+                                           destination: nil];
+  NS_DURING
+  {
+    // Export an object under a well-known name and obtain a proxy for it:
+    conn = [NSConnection connectionWithReceivePort: port
+                                          sendPort: [DKPort port]];
+    [conn setObject: [[DKStressEcho new] autorelease]
+             atPath: DKStressObjectPath];
+    if (DKPortNamePrimaryOwner != [[DKPortNameServer sharedSessionBusPortNameServer]
+      registerPort: port
+              name: DKStressServiceName])
+    {
+      [NSException raise: NSGenericException
+                  format: @"Could not acquire %@", DKStressServiceName];
+    }
+    ASSIGN(exportConnection, conn);
+    conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                          sendPort: [[[DKPort alloc] initWithRemote: DKStressServiceName] autorelease]];
+    exportedProxy = [[conn proxyAtPath: DKStressObjectPath] retain];
+    if (NO == [@"ping" isEqualToString: [exportedProxy echo: @"ping"]])
+    {
+      [NSException raise: NSGenericException
+                  format: @"Exported object did not reply"];
+    }
+  }
+  NS_HANDLER
+  {
+    fprintf(stderr, "Could not export object, skipping export workload: %s\n",
+      [[localException reason] UTF8String]);
+    DESTROY(exportedProxy);
+  }
+  NS_ENDHANDLER
+  success = (nil != sharedProxy);
+  return success;
+}
+
+- (BOOL)hasExportedProxy
+{
+  return (nil != exportedProxy);
+}
+
+/*
+ * Blocks until all threads of the current run have arrived, so that they start
+ * hammering DBusKit at the same time.
+ */
+- (void)waitOnBarrier
+{
+  NSUInteger myGeneration = 0;
+  [barrier lock];
+  myGeneration = generation;
+  waiting++;
+  if (waiting == threadCount)
+  {
+    waiting = 0;
+    generation++;
+    [barrier broadcast];
+  }
+  else
+  {
+    while (myGeneration == generation)
+    {
+      [barrier wait];
+    }
+  }
+  [barrier unlock];
+}
+
+- (BOOL)proxyOperation: (NSUInteger)index
+{
+  return [sharedProxy NameHasOwner: @"org.freedesktop.DBus"];
+}
+
+- (BOOL)initOperation: (NSUInteger)index
+{
+  // Each run gets a fresh proxy, because the last reference to the previous
+  // one was dropped when its run ended.
+  DKPort *port = [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease];
+  id proxy = [DKProxy proxyWithPort: port
+                               path: @"/org/freedesktop/DBus"];
+  return [proxy NameHasOwner: @"org.freedesktop.DBus"];
+}
+
+- (BOOL)observeOperation: (NSUInteger)index
+{
+  DKNotificationCenter *center = [DKNotificationCenter sessionBusCenter];
+  DKPortNameServer *nameServer = [DKPortNameServer sharedSessionBusPortNameServer];
+  DKStressSignalCounter *observer = [[DKStressSignalCounter new] autorelease];
+  NSString *name = [NSString stringWithFormat: @"%@%lu",
+    DKStressNamePrefix, (unsigned long)index];
+  BOOL success = NO;
+  [center addObserver: observer
+             selector: @selector(ignore:)
+               signal: @"NameOwnerChanged"
+            interface: @"org.freedesktop.DBus"
+               sender: sharedProxy
+          destination: nil];
+  if (DKPortNamePrimaryOwner == [nameServer registerPort: [DKPort port]
+                                                    name: name])
+  {
+    // Both acquiring and releasing the name emit NameOwnerChanged:
+    __sync_fetch_and_add(&expectedSignals, 2);
+    success = YES;
+  }
+  [nameServer removePortForName: name];
+  [center removeObserver: observer];
+  return success;
+}
+
+- (BOOL)exportOperation: (NSUInteger)index
+{
+  NSString *string = [NSString stringWithFormat: @"%lu", (unsigned long)index];
+  return [string isEqualToString: [exportedProxy echo: string]];
+}
+
+- (void)runThread: (NSNumber*)indexNumber
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSUInteger index = [indexNumber unsignedIntegerValue];
+  DKStressThreadState *state = &states[index];
+  BOOL (*perform)(id, SEL, NSUInteger) =
+    (BOOL(*)(id, SEL, NSUInteger))[self methodForSelector: operation];
+  [self waitOnBarrier];
+  state->lastProgress = DKStressNow();
+  while ((0 == stop)
+    && ((0 == operationLimit) || (state->operations < operationLimit)))
+  {
+    NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+    double start = DKStressNow();
+    double latency = 0;
+    BOOL success = NO;
+    NS_DURING
+    {
+      success = perform(self, operation, index);
+    }
+    NS_HANDLER
+    {
+      success = NO;
+    }
+    NS_ENDHANDLER
+    state->lastProgress = DKStressNow();
+    latency = state->lastProgress - start;
+    if (latency > state->maxLatency)
+    {
+      state->maxLatency = latency;
+    }
+    if (NO == success)
+    {
+      state->errors++;
+    }
+    state->operations++;
+    [loopPool release];
+  }
+  __sync_synchronize();
+  state->finished = 1;
+  [arp release];
+}
+
+/*
+ * Reports the threads that have not finished and terminates the process,
+ * since threads that are stuck cannot be reclaimed. _exit() skips the atexit()
+ * handlers, so the private bus daemon is stopped explicitly.
+ */
+- (void)reportHangForOperation: (SEL)selector
+{
+  double now = DKStressNow();
+  NSUInteger i = 0;
+  fprintf(stderr, "\n%s: threads made no progress for %.1f s, "
+    "deadlock or lost wakeup:\n", sel_getName(selector), timeout);
+  for (i = 0; i < threadCount; i++)
+  {
+    if (0 == states[i].finished)
+    {
+      fprintf(stderr, "  thread %lu: stuck after %llu operations, "
+        "last progress %.1f s ago\n", (unsigned long)i,
+        states[i].operations, now - states[i].lastProgress);
+    }
+  }
+  fflush(stderr);
+  DKStressStopDaemon();
+  _exit(2);
+}
+
+- (BOOL)runOperation: (SEL)selector
+             threads: (NSUInteger)count
+            duration: (double)seconds
+               limit: (unsigned long long)limit
+       operationsOut: (unsigned long long*)ops
+           errorsOut: (unsigned long long*)errors
+       maxLatencyOut: (double*)maxLatency
+{
+  double end = 0;
+  BOOL allFinished = NO;
+  NSUInteger i = 0;
+
+  states = calloc(count, sizeof(DKStressThreadState));
+  threadCount = count;
+  operation = selector;
+  operationLimit = limit;
+  stop = 0;
+  __sync_synchronize();
+  for (i = 0; i < count; i++)
+  {
+    states[i].lastProgress = DKStressNow();
+    [NSThread detachNewThreadSelector: @selector(runThread:)
+                             toTarget: self
+                           withObject: [NSNumber numberWithUnsignedInteger: i]];
+  }
+
+  /*
+   * Keep the run loop of the main thread running while waiting, so that the
+   * workloads do not depend on whether DBusKit dispatches on the main thread.
+   */
+  end = DKStressNow() + seconds;
+  while (NO == allFinished)
+  {
+    double now = DKStressNow();
+    allFinished = YES;
+    if (now >= end)
+    {
+      stop = 1;
+    }
+    for (i = 0; i < count; i++)
+    {
+      if (0 == states[i].finished)
+      {
+        allFinished = NO;
+        if ((now - states[i].lastProgress) > timeout)
+        {
+          [self reportHangForOperation: selector];
+        }
+      }
+    }
+    if (NO == allFinished)
+    {
+      [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                               beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+    }
+  }
+
+  *ops = 0;
+  *errors = 0;
+  *maxLatency = 0;
+  for (i = 0; i < count; i++)
+  {
+    *ops += states[i].operations;
+    *errors += states[i].errors;
+    *maxLatency = MAX(*maxLatency, states[i].maxLatency);
+  }
+  free(states);
+  states = NULL;
+  return (0 == *errors);
+}
+
+- (BOOL)waitForSignals
+{
+  double deadline = DKStressNow() + timeout;
+  while ((counter->received < expectedSignals) && (DKStressNow() < deadline))
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+  }
+  printf("  signals: %llu expected, %llu received\n",
+    expectedSignals, counter->received);
+  return (counter->received >= expectedSignals);
+}
+
+- (void)dealloc
+{
+  [[DKNotificationCenter sessionBusCenter] removeObserver: counter];
+  [counter release];
+  [barrier release];
+  [sharedProxy release];
+  [exportedProxy release];
+  [exportConnection release];
+  [super dealloc];
+}
+@end
+
+int
+main(int argc, char **argv)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  DKStressRunner *runner = nil;
+  NSUInteger maxThreads = 64;
+  double duration = 2;
+  double timeout = 30;
+  BOOL success = YES;
+  SEL workloads[4];
+  const char *names[4] = { "proxy", "init", "observe", "export" };
+  NSUInteger i = 0;
+
+  workloads[0] = @selector(proxyOperation:);
+  workloads[1] = @selector(initOperation:);
+  workloads[2] = @selector(observeOperation:);
+  workloads[3] = @selector(exportOperation:);
+
+  if (argc > 1)
+  {
+    maxThreads = MAX(1, strtol(argv[1], NULL, 10));
+  }
+  if (argc > 2)
+  {
+    duration = MAX(0.1, strtod(argv[2], NULL));
+  }
+  if (argc > 3)
+  {
+    timeout = MAX(1, strtod(argv[3], NULL));
+  }
+  if ((NULL == getenv("DK_STRESS_USE_SESSION_BUS"))
+    && (NO == DKStressStartDaemon()))
+  {
+    fprintf(stderr, "Could not start a private dbus-daemon.\n");
+    [arp release];
+    return 1;
+  }
+
+  runner = [[DKStressRunner alloc] initWithTimeout: timeout];
+  if (NO == [runner setUp])
+  {
+    fprintf(stderr, "Could not connect to the bus.\n");
+    [runner release];
+    [arp release];
+    return 1;
+  }
+
+  for (i = 0; i < 4; i++)
+  {
+    NSUInteger threads = 1;
+    double base = 0;
+    if ((3 == i) && (NO == [runner hasExportedProxy]))
+    {
+      continue;
+    }
+    printf("%s:\n", names[i]);
+    for (threads = 1; threads <= maxThreads; threads *= 2)
+    {
+      NSAutoreleasePool *loopPool = [NSAutoreleasePool new];
+      unsigned long long ops = 0;
+      unsigned long long errors = 0;
+      double maxLatency = 0;
+      double start = DKStressNow();
+      double elapsed = 0;
+      double rate = 0;
+      if (1 == i)
+      {
+        // Every round races on a new proxy, so only one call per thread.
+        NSUInteger round = 0;
+        for (round = 0; round < 20; round++)
+        {
+          unsigned long long roundOps = 0;
+          unsigned long long roundErrors = 0;
+          double roundLatency = 0;
+          NSAutoreleasePool *roundPool = [NSAutoreleasePool new];
+          [runner runOperation: workloads[i]
+                       threads: threads
+                      duration: duration
+                         limit: 1
+                 operationsOut: &roundOps
+                     errorsOut: &roundErrors
+                 maxLatencyOut: &roundLatency];
+          [roundPool release];
+          ops += roundOps;
+          errors += roundErrors;
+          maxLatency = MAX(maxLatency, roundLatency);
+        }
+      }
+      else
+      {
+        [runner runOperation: workloads[i]
+                     threads: threads
+                    duration: duration
+                       limit: 0
+               operationsOut: &ops
+                   errorsOut: &errors
+               maxLatencyOut: &maxLatency];
+      }
+      elapsed = DKStressNow() - start;
+      rate = ops / elapsed;
+      if (1 == threads)
+      {
+        base = rate;
+      }
+      printf("  %2lu threads: %10.0f ops/s (%.2fx), max latency %7.2f ms, "
+        "%llu errors\n", (unsigned long)threads, rate,
+        (base > 0) ? rate / base : 0, maxLatency * 1000, errors);
+      fflush(stdout);
+      if (0 != errors)
+      {
+        success = NO;
+      }
+      [loopPool release];
+    }
+    if ((2 == i) && (NO == [runner waitForSignals]))
+    {
+      fprintf(stderr, "observe: NameOwnerChanged signals were lost\n");
+      success = NO;
+    }
+  }
+
+  [runner release];
+  [arp release];
+  return success ? 0 : 1;
+}
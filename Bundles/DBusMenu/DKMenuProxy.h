@@ -34,12 +34,60 @@
   NSUInteger revision;
   NSMapTable *nativeToDBus;
   NSMapTable *dBusToNative;
+  /**
+   * The next identifier to hand out. Identifiers stay stable for the lifetime
+   * of a menu item, so that clients can keep their copy of the layout.
+   */
+  int32_t nextIdentifier;
+  /**
+   * Maps the identifier of each parent (0 for the root) to the array of the
+   * identifiers of its children at the time of the last update.
+   */
+  NSMapTable *childrenForParent;
+  /**
+   * Maps the identifier of each item to the identifier of its parent.
+   */
+  NSMapTable *parentForItem;
+  /**
+   * Maps the identifier of each item to the properties it had at the time of
+   * the last update.
+   */
+  NSMapTable *propertySnapshots;
+  /**
+   * Maps the identifier of each parent to the revision in which its subtree
+   * last changed.
+   */
+  NSMapTable *layoutRevisions;
+  /**
+   * Maps the identifier of each item to its image and the encoded icon data,
+   * so that the image is only rendered again if it is replaced.
+   */
+  NSMapTable *iconCache;
   NSRecursiveLock *lock;
   DKNotificationCenter *center;
   BOOL exported;
+  /**
+   * Set while a resynchronisation after items were added or removed is
+   * pending.
+   */
+  BOOL resyncScheduled;
 }
 - (id)initWithMenu: (NSMenu*)menu;
+
+/**
+ * Called when the menu has changed. The proxy compares the menu with the state
+ * it last published. If the structure of the menu changed, it emits
+ * <code>LayoutUpdated</code> for the innermost parent containing all changes.
+ * If only properties of items changed, it emits
+ * <code>ItemsPropertiesUpdated</code> containing only the changed properties.
+ */
 - (void)menuUpdated: (NSMenu*)menu;
+
+/**
+ * Returns the revision in which the layout below <var>parentID</var> last
+ * changed.
+ */
+- (NSUInteger)revisionForParent: (int32_t)parentID;
 - (int32_t)DBusIDForMenuObject: (NSMenuItem*)item;
 - (BOOL)isExported;
 - (void)setExported: (BOOL)yesno;
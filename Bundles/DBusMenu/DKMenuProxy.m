@@ -26,9 +26,12 @@
 #import <Foundation/NSData.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSIndexSet.h>
 #import <Foundation/NSInvocation.h>
 #import <Foundation/NSLock.h>
 #import <Foundation/NSMapTable.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSSet.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSValue.h>
 
@@ -81,6 +84,12 @@ static NSString const	*DKMenuEventClicked = @"clicked";
 
 static NSDictionary *DKMenuAllDefaults;
 
+/*
+ * All property keys except for the icon data, which is cached separately
+ * because rendering it is expensive.
+ */
+static NSArray *DKMenuUncachedKeys;
+
 @interface NSMenu (DBusExport)
 - (id)valueForDBusProperty: (NSString*)property;
 @end
@@ -94,6 +103,14 @@ static NSDictionary *DKMenuAllDefaults;
 - (BOOL)isHidden;
 @end
 
+@interface DKMenuProxy (PropertyCache)
+- (NSDictionary*)_propertiesForMenuObject: (id)menuObject
+                               identifier: (int32_t)identifier
+                                    names: (NSArray*)propertyNames;
+- (void)_notifyPropertiesUpdated: (NSArray*)updated
+                         removed: (NSArray*)removed;
+@end
+
 BOOL DKMenuValueIsDefaultForKey(id value, NSString *key)
 {
   id defaultValue = [DKMenuAllDefaults objectForKey: key];
@@ -120,6 +137,34 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
   return dict;
 }
 
+/*
+ * Restricts a cached property dictionary to the requested properties and wraps
+ * the values in variants for sending them over D-Bus. The cached dictionaries
+ * hold the plain values so that they can be compared directly.
+ */
+static NSDictionary*
+DKMenuFilterPropertyDictionary(NSDictionary *props, NSArray *propertyNames)
+{
+  NSEnumerator *kEnum = nil;
+  NSString *key = nil;
+  NSMutableDictionary *dict = nil;
+  if ((nil == propertyNames) || (0 == [propertyNames count]))
+    {
+      propertyNames = [props allKeys];
+    }
+  dict = [NSMutableDictionary dictionaryWithCapacity: [propertyNames count]];
+  kEnum = [propertyNames objectEnumerator];
+  while (nil != (key = [kEnum nextObject]))
+    {
+      id value = [props objectForKey: key];
+      if (nil != value)
+        {
+          [dict setObject: VARIANT(value) forKey: key];
+        }
+    }
+  return dict;
+}
+
 
 @implementation NSMenuItem (DBusExport)
 
@@ -243,7 +288,6 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
         }
       NS_ENDHANDLER
     }
-  returnValue = VARIANT(returnValue);
   return returnValue;
 }
 
@@ -256,7 +300,9 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
                  forProxy: (DKMenuProxy*)proxy
 {
   NSNumber *identifier = DK_INT32([proxy DBusIDForMenuObject: self]);
-  NSDictionary *props = DKMenuPropertyDictionaryForDBusProperties(self, properties);
+  NSDictionary *props = [proxy _propertiesForMenuObject: self
+                                               identifier: [identifier intValue]
+                                                    names: properties];
   NSArray *children = nil;
   NSDebugMLLog(@"DKMenu", @"Generating layout for %@. D-Bus facing identifier is %@, properties %@ (requested depth: %ld)", self, identifier, properties, depth);
   if ((depth == 0) || (NO == [self hasSubmenu]))
@@ -339,37 +385,324 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
       DKMenuToggleTypeDefaultValue, kDKMenuToggleTypeKey, 
       DKMenuToggleStateDefaultValue, kDKMenuToggleStateKey,
       DKMenuChildrenDisplayDefaultValue, kDKMenuChildrenDisplayKey, nil];
+    DKMenuUncachedKeys = [[DKMenuAllDefaults allKeys] mutableCopy];
+    [(NSMutableArray*)DKMenuUncachedKeys removeObject: (NSString*)kDKMenuIconDataKey];
   }
 }
 
 
-- (void)_mapMenu: (NSMenu*)menu usingIdentifierReference: (int32_t*)identifier
+/*
+ * Records the properties of an item that differ from the last snapshot.
+ * Properties that are no longer present have reverted to their default value
+ * and are reported as removed.
+ */
+static void
+DKMenuRecordPropertyChanges(int32_t identifier,
+  NSDictionary *oldProps,
+  NSDictionary *newProps,
+  NSMutableArray *updated,
+  NSMutableArray *removed)
+{
+  NSMutableDictionary *changed = [NSMutableDictionary dictionary];
+  NSMutableArray *gone = [NSMutableArray array];
+  NSEnumerator *kEnum = [newProps keyEnumerator];
+  NSString *key = nil;
+  while (nil != (key = [kEnum nextObject]))
+    {
+      id value = [newProps objectForKey: key];
+      if (NO == [value isEqual: [oldProps objectForKey: key]])
+        {
+          [changed setObject: VARIANT(value) forKey: key];
+        }
+    }
+  kEnum = [oldProps keyEnumerator];
+  while (nil != (key = [kEnum nextObject]))
+    {
+      if (nil == [newProps objectForKey: key])
+        {
+          [gone addObject: key];
+        }
+    }
+  if (0 != [changed count])
+    {
+      [updated addObject: [DKStructArray arrayWithObjects: DK_INT32(identifier),
+        changed, nil]];
+    }
+  if (0 != [gone count])
+    {
+      [removed addObject: [DKStructArray arrayWithObjects: DK_INT32(identifier),
+        gone, nil]];
+    }
+}
+
+/*
+ * Walks the menu and compares it with the state recorded during the last walk.
+ * New items are assigned identifiers, parents whose list of children changed
+ * are added to layoutChanges and property changes of existing items are
+ * collected in updated/removed.
+ */
+- (void)_syncMenu: (NSMenu*)menu
+           parent: (int32_t)parentID
+             seen: (NSMutableIndexSet*)seen
+    layoutChanges: (NSMutableIndexSet*)layoutChanges
+ updatedProperties: (NSMutableArray*)updated
+ removedProperties: (NSMutableArray*)removed
 {
   NSArray *items = [menu itemArray];
   NSEnumerator *iEnum = [items objectEnumerator];
   NSMenuItem *item = nil;
+  NSMutableArray *childIDs = [NSMutableArray arrayWithCapacity: [items count]];
+  NSArray *oldChildIDs = nil;
   while (nil != (item = [iEnum nextObject]))
-    { 
-      int32_t ident = (*identifier)++;
-      if (NULL == NSMapInsertIfAbsent(nativeToDBus, (void*)item, (void*)(intptr_t)ident))
+    {
+      int32_t ident = (int32_t)(intptr_t)NSMapGet(nativeToDBus, (void*)item);
+      NSDictionary *oldProps = nil;
+      NSDictionary *newProps = nil;
+      if (0 == ident)
         {
+          ident = nextIdentifier++;
+          NSMapInsert(nativeToDBus, (void*)item, (void*)(intptr_t)ident);
           NSMapInsert(dBusToNative, (void*)(intptr_t)ident, (void*)item);
-          if ([item hasSubmenu])
-            {
-              [self _mapMenu: [item submenu] usingIdentifierReference: identifier];
-            }
+        }
+      else if ([seen containsIndex: ident])
+        {
+          // The item appears more than once in the menu, we only map it once.
+          continue;
+        }
+      [seen addIndex: ident];
+      [childIDs addObject: [NSNumber numberWithInt: ident]];
+      NSMapInsert(parentForItem, (void*)(intptr_t)ident,
+        (void*)(intptr_t)parentID);
+
+      newProps = [self _freshPropertiesForItem: item identifier: ident];
+      oldProps = NSMapGet(propertySnapshots, (void*)(intptr_t)ident);
+      if ((nil != oldProps) && (NO == [oldProps isEqual: newProps]))
+        {
+          DKMenuRecordPropertyChanges(ident, oldProps, newProps,
+            updated, removed);
+        }
+      NSMapInsert(propertySnapshots, (void*)(intptr_t)ident, newProps);
+
+      if ([item hasSubmenu])
+        {
+          [self _syncMenu: [item submenu]
+                   parent: ident
+                     seen: seen
+            layoutChanges: layoutChanges
+        updatedProperties: updated
+        removedProperties: removed];
+        }
+      else if (NULL != NSMapGet(childrenForParent, (void*)(intptr_t)ident))
+        {
+          // The submenu was removed:
+          NSMapRemove(childrenForParent, (void*)(intptr_t)ident);
+          [layoutChanges addIndex: ident];
         }
     }
+  oldChildIDs = NSMapGet(childrenForParent, (void*)(intptr_t)parentID);
+  if (NO == [oldChildIDs isEqualToArray: childIDs])
+    {
+      [layoutChanges addIndex: parentID];
+    }
+  NSMapInsert(childrenForParent, (void*)(intptr_t)parentID, childIDs);
 }
 
-- (void)_createMapping
+/*
+ * Removes all items that were not encountered while walking the menu.
+ */
+- (void)_purgeItemsNotInSet: (NSMutableIndexSet*)seen
+{
+  NSMapEnumerator theEnum = NSEnumerateMapTable(dBusToNative);
+  NSMutableIndexSet *stale = [NSMutableIndexSet indexSet];
+  void *key = NULL;
+  void *item = NULL;
+  NSUInteger ident = 0;
+  while (NSNextMapEnumeratorPair(&theEnum, &key, &item))
+    {
+      if (NO == [seen containsIndex: (NSUInteger)(intptr_t)key])
+        {
+          [stale addIndex: (NSUInteger)(intptr_t)key];
+        }
+    }
+  NSEndMapTableEnumeration(&theEnum);
+
+  for (ident = [stale firstIndex]; NSNotFound != ident;
+    ident = [stale indexGreaterThanIndex: ident])
+    {
+      void *k = (void*)(intptr_t)ident;
+      NSMapRemove(nativeToDBus, NSMapGet(dBusToNative, k));
+      NSMapRemove(dBusToNative, k);
+      NSMapRemove(parentForItem, k);
+      NSMapRemove(propertySnapshots, k);
+      NSMapRemove(childrenForParent, k);
+      NSMapRemove(layoutRevisions, k);
+      NSMapRemove(iconCache, k);
+    }
+}
+
+/*
+ * Returns the encoded icon for the item, rendering it only if the item
+ * carries a different image than the one cached for it.
+ */
+- (id)_iconDataForItem: (NSMenuItem*)item identifier: (int32_t)identifier
+{
+  NSImage *image = nil;
+  NSArray *entry = nil;
+  id data = nil;
+  if ([item respondsToSelector: @selector(image)])
+    {
+      image = [item image];
+    }
+  if (nil == image)
+    {
+      NSMapRemove(iconCache, (void*)(intptr_t)identifier);
+      return nil;
+    }
+  entry = NSMapGet(iconCache, (void*)(intptr_t)identifier);
+  if ((nil != entry) && ([entry objectAtIndex: 0] == image))
+    {
+      return [entry objectAtIndex: 1];
+    }
+  data = [item valueForDBusProperty: (NSString*)kDKMenuIconDataKey];
+  if (nil == data)
+    {
+      NSMapRemove(iconCache, (void*)(intptr_t)identifier);
+      return nil;
+    }
+  entry = [NSArray arrayWithObjects: image, data, nil];
+  NSMapInsert(iconCache, (void*)(intptr_t)identifier, entry);
+  return data;
+}
+
+/*
+ * Computes the full property dictionary for an item. Everything but the icon
+ * is cheap to obtain and queried from the item directly.
+ */
+- (NSDictionary*)_freshPropertiesForItem: (NSMenuItem*)item
+                              identifier: (int32_t)identifier
+{
+  NSMutableDictionary *props = (NSMutableDictionary*)
+    DKMenuPropertyDictionaryForDBusProperties(item, DKMenuUncachedKeys);
+  id icon = [self _iconDataForItem: item identifier: identifier];
+  if ((nil != icon)
+    && (NO == DKMenuValueIsDefaultForKey(icon, (NSString*)kDKMenuIconDataKey)))
+    {
+      [props setObject: icon forKey: (NSString*)kDKMenuIconDataKey];
+    }
+  return props;
+}
+
+/*
+ * Returns the properties of a menu object. For items, the dictionary recorded
+ * during the last update is used, so that answering repeated queries does not
+ * require querying (or rendering) anything. The cache is refreshed from
+ * -menuUpdated: and whenever the menu reports that an item changed.
+ */
+- (NSDictionary*)_propertiesForMenuObject: (id)menuObject
+                               identifier: (int32_t)identifier
+                                    names: (NSArray*)propertyNames
+{
+  NSDictionary *props = nil;
+  if (0 == identifier)
+    {
+      // The root menu has only trivial properties.
+      return DKMenuFilterPropertyDictionary(
+        DKMenuPropertyDictionaryForDBusProperties(menuObject, propertyNames),
+        nil);
+    }
+  [lock lock];
+  props = NSMapGet(propertySnapshots, (void*)(intptr_t)identifier);
+  if (nil == props)
+    {
+      props = [self _freshPropertiesForItem: menuObject
+                                 identifier: identifier];
+      NSMapInsert(propertySnapshots, (void*)(intptr_t)identifier, props);
+    }
+  [[props retain] autorelease];
+  [lock unlock];
+  return DKMenuFilterPropertyDictionary(props, propertyNames);
+}
+
+/*
+ * Returns the innermost parent that contains all parents in the set.
+ */
+- (int32_t)_commonParentForParents: (NSIndexSet*)parents
+{
+  NSMutableArray *chain = [NSMutableArray array];
+  NSUInteger ident = [parents firstIndex];
+  int32_t current = (int32_t)ident;
+  NSUInteger count = 0;
+
+  // Collect the chain from the first parent up to the root:
+  while (0 != current)
+    {
+      [chain addObject: [NSNumber numberWithInt: current]];
+      current = (int32_t)(intptr_t)NSMapGet(parentForItem,
+        (void*)(intptr_t)current);
+    }
+  [chain addObject: [NSNumber numberWithInt: 0]];
+
+  for (ident = [parents indexGreaterThanIndex: ident]; NSNotFound != ident;
+    ident = [parents indexGreaterThanIndex: ident])
+    {
+      NSMutableSet *ancestors = [NSMutableSet set];
+      current = (int32_t)ident;
+      while (0 != current)
+        {
+          [ancestors addObject: [NSNumber numberWithInt: current]];
+          current = (int32_t)(intptr_t)NSMapGet(parentForItem,
+            (void*)(intptr_t)current);
+        }
+      [ancestors addObject: [NSNumber numberWithInt: 0]];
+      // Drop entries from the chain until we hit a common ancestor:
+      while ((0 != (count = [chain count]))
+        && (NO == [ancestors containsObject: [chain objectAtIndex: 0]]))
+        {
+          [chain removeObjectAtIndex: 0];
+        }
+    }
+  if (0 == [chain count])
+    {
+      return 0;
+    }
+  return [[chain objectAtIndex: 0] intValue];
+}
+
+- (void)_resetMapping
 {
   NSResetMapTable(nativeToDBus);
   NSResetMapTable(dBusToNative);
-  int32_t identifier = 1; // 0 would be the root
-  [self _mapMenu: representedMenu usingIdentifierReference: &identifier]; 
-            
-  NSDebugMLLog(@"DKMenu", @"Created mappings for %d menu items", (identifier - 1));
+  NSResetMapTable(childrenForParent);
+  NSResetMapTable(parentForItem);
+  NSResetMapTable(propertySnapshots);
+  NSResetMapTable(layoutRevisions);
+  NSResetMapTable(iconCache);
+  nextIdentifier = 1; // 0 would be the root
+}
+
+- (void)_createMapping
+{
+  NSMutableIndexSet *seen = [NSMutableIndexSet indexSet];
+  [self _resetMapping];
+  [self _syncMenu: representedMenu
+           parent: 0
+             seen: seen
+    layoutChanges: [NSMutableIndexSet indexSet]
+updatedProperties: [NSMutableArray array]
+removedProperties: [NSMutableArray array]];
+
+  NSDebugMLLog(@"DKMenu", @"Created mappings for %lu menu items",
+    (unsigned long)[seen count]);
+}
+
+- (NSUInteger)revisionForParent: (int32_t)parentID
+{
+  NSUInteger rev = 0;
+  [lock lock];
+  rev = (NSUInteger)(uintptr_t)NSMapGet(layoutRevisions,
+    (void*)(intptr_t)parentID);
+  [lock unlock];
+  return rev;
 }
 
 - (NSMapTable*)_nativeToDBusMap
@@ -404,27 +737,35 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
   [lock unlock];
   return item;
 }
-- (void)notifyMenuServer
+- (void)_postSignal: (NSString*)signal userInfo: (NSDictionary*)info
 {
  if (NO == exported)
    {
      return;
    }
- // We could do this much more efficiently if we had a smarter
- // idea of how the menu changed.
- NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
-   [NSNumber numberWithUnsignedInteger: revision], @"arg0", 
-   DK_INT32(0), @"arg1", nil];
  if (center == nil)
    {
      center = [[DKNotificationCenter sessionBusCenter] retain];
    }
- [center postSignalName: @"LayoutUpdated"
+ [center postSignalName: signal
               interface: @"com.canonical.dbusmenu"
                  object: self
                userInfo: info];
 }
 
+- (void)_notifyLayoutUpdatedForParent: (int32_t)parentID
+{
+ NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
+   [NSNumber numberWithUnsignedInteger: revision], @"arg0",
+   DK_INT32(parentID), @"arg1", nil];
+ [self _postSignal: @"LayoutUpdated" userInfo: info];
+}
+
+- (void)notifyMenuServer
+{
+ [self _notifyLayoutUpdatedForParent: 0];
+}
+
 - (void)setExported: (BOOL)yesno
 {
   if ((exported == NO) && (yesno == YES))
@@ -447,20 +788,151 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
     NSIntegerMapValueCallBacks, 24);
   dBusToNative = NSCreateMapTable(NSIntegerMapKeyCallBacks,
     NSNonRetainedObjectMapValueCallBacks, 24); 
+  childrenForParent = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+    NSObjectMapValueCallBacks, 8);
+  parentForItem = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+    NSIntegerMapValueCallBacks, 24);
+  propertySnapshots = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+    NSObjectMapValueCallBacks, 24);
+  layoutRevisions = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+    NSIntegerMapValueCallBacks, 8);
+  iconCache = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+    NSObjectMapValueCallBacks, 8);
   lock = [NSRecursiveLock new];
   [self _createMapping];
+  [[NSNotificationCenter defaultCenter] addObserver: self
+                                           selector: @selector(menuItemChanged:)
+                                               name: NSMenuDidChangeItemNotification
+                                             object: nil];
+  [[NSNotificationCenter defaultCenter] addObserver: self
+                                           selector: @selector(menuStructureChanged:)
+                                               name: NSMenuDidAddItemNotification
+                                             object: nil];
+  [[NSNotificationCenter defaultCenter] addObserver: self
+                                           selector: @selector(menuStructureChanged:)
+                                               name: NSMenuDidRemoveItemNotification
+                                             object: nil];
   return self;
 }
+
 - (void)menuUpdated: (NSMenu*)menu
 {
+  NSMutableIndexSet *seen = [NSMutableIndexSet indexSet];
+  NSMutableIndexSet *layoutChanges = [NSMutableIndexSet indexSet];
+  NSMutableArray *updated = [NSMutableArray array];
+  NSMutableArray *removed = [NSMutableArray array];
+  int32_t changedParent = 0;
+  [lock lock];
+  NS_DURING
+    {
+      if ([menu isEqual: representedMenu] == NO)
+        {
+          // A different menu, nothing of the old layout can be reused:
+          ASSIGN(representedMenu,menu);
+          [self _createMapping];
+          [layoutChanges addIndex: 0];
+        }
+      else
+        {
+          [self _syncMenu: representedMenu
+                   parent: 0
+                     seen: seen
+            layoutChanges: layoutChanges
+        updatedProperties: updated
+        removedProperties: removed];
+          [self _purgeItemsNotInSet: seen];
+        }
+    }
+  NS_HANDLER
+    {
+      [lock unlock];
+      [localException raise];
+    }
+  NS_ENDHANDLER
+
+  if (0 != [layoutChanges count])
+    {
+      NSUInteger ident = 0;
+      int32_t current = 0;
+      __sync_fetch_and_add(&revision,1);
+      changedParent = [self _commonParentForParents: layoutChanges];
+      // Record the revision for the changed parents and all their ancestors:
+      for (ident = [layoutChanges firstIndex]; NSNotFound != ident;
+        ident = [layoutChanges indexGreaterThanIndex: ident])
+        {
+          current = (int32_t)ident;
+          while (0 != current)
+            {
+              NSMapInsert(layoutRevisions, (void*)(intptr_t)current,
+                (void*)(uintptr_t)revision);
+              current = (int32_t)(intptr_t)NSMapGet(parentForItem,
+                (void*)(intptr_t)current);
+            }
+        }
+      NSMapInsert(layoutRevisions, (void*)(intptr_t)0,
+        (void*)(uintptr_t)revision);
+      [self _notifyLayoutUpdatedForParent: changedParent];
+      NSDebugMLLog(@"DKMenu", @"Represented menu updated below %d", changedParent);
+    }
+  [self _notifyPropertiesUpdated: updated
+                          removed: removed];
+  [lock unlock];
+}
+
+- (void)_notifyPropertiesUpdated: (NSArray*)updated
+                         removed: (NSArray*)removed
+{
+  if ((0 != [updated count]) || (0 != [removed count]))
+    {
+      NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
+        updated, @"arg0",
+        removed, @"arg1", nil];
+      [self _postSignal: @"ItemsPropertiesUpdated" userInfo: info];
+      NSDebugMLLog(@"DKMenu", @"Properties updated for %lu items",
+        (unsigned long)([updated count] + [removed count]));
+    }
+}
+
+/*
+ * Refreshes the cached properties of an item that has been changed (e.g.
+ * enabled, retitled or had its state toggled) and tells clients about the
+ * properties that differ.
+ */
+- (void)menuItemChanged: (NSNotification*)notification
+{
+  NSMenu *menu = [notification object];
+  NSInteger index = [[[notification userInfo] objectForKey: @"NSMenuItemIndex"] integerValue];
+  NSMutableArray *updated = [NSMutableArray array];
+  NSMutableArray *removed = [NSMutableArray array];
+  NSMenuItem *item = nil;
+  int32_t ident = 0;
+  if ((index < 0) || (index >= [menu numberOfItems]))
+    {
+      return;
+    }
+  item = (NSMenuItem*)[menu itemAtIndex: index];
   [lock lock];
-  if ([menu isEqual: representedMenu] == NO)
+  ident = (int32_t)(intptr_t)NSMapGet(nativeToDBus, (void*)item);
+  if (0 == ident)
     {
-      ASSIGN(representedMenu,menu);
+      // Not one of ours, or not yet mapped.
+      [lock unlock];
+      return;
     }
   NS_DURING
     {
-       [self _createMapping];
+      NSDictionary *newProps = [self _freshPropertiesForItem: item
+                                                  identifier: ident];
+      NSDictionary *oldProps = NSMapGet(propertySnapshots,
+        (void*)(intptr_t)ident);
+      if ((nil != oldProps) && (NO == [oldProps isEqual: newProps]))
+        {
+          DKMenuRecordPropertyChanges(ident, oldProps, newProps,
+            updated, removed);
+        }
+      NSMapInsert(propertySnapshots, (void*)(intptr_t)ident, newProps);
+      [self _notifyPropertiesUpdated: updated
+                              removed: removed];
     }
   NS_HANDLER
     {
@@ -468,12 +940,46 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
       [localException raise];
     }
   NS_ENDHANDLER
-  __sync_fetch_and_add(&revision,1);
-  [self notifyMenuServer]; 
-  NSDebugMLLog(@"DKMenu", @"Represented menu updated");
   [lock unlock];
 }
 
+- (BOOL)_representsMenu: (NSMenu*)menu
+{
+  while (nil != menu)
+    {
+      if (menu == representedMenu)
+        {
+          return YES;
+        }
+      menu = [menu supermenu];
+    }
+  return NO;
+}
+
+/*
+ * Schedules synchronising the layout after items were added to or removed
+ * from the menu. Building a menu adds items one by one, so this is coalesced
+ * into a single update.
+ */
+- (void)menuStructureChanged: (NSNotification*)notification
+{
+  if ((YES == resyncScheduled)
+    || (NO == [self _representsMenu: [notification object]]))
+    {
+      return;
+    }
+  resyncScheduled = YES;
+  [self performSelector: @selector(_resyncMenu:)
+             withObject: nil
+             afterDelay: 0];
+}
+
+- (void)_resyncMenu: (id)ignored
+{
+  resyncScheduled = NO;
+  [self menuUpdated: representedMenu];
+}
+
 - (uint32_t)Version
 {
   // Seems to be 2 presently
@@ -493,7 +999,9 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
   if (parentID == 0)
     {
       NSNumber *identifier = DK_INT32(0);
-      NSDictionary *properties = DKMenuPropertyDictionaryForDBusProperties(representedMenu, propertyNames);
+      NSDictionary *properties = [self _propertiesForMenuObject: representedMenu
+                                                     identifier: 0
+                                                          names: propertyNames];
       NSArray *children = nil;
       if (0 == depth)
         {
@@ -557,7 +1065,9 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
     {
       continue;
     }
-    NSDictionary *propertyDict =  DKMenuPropertyDictionaryForDBusProperties(menuObject,propertyNames);
+    NSDictionary *propertyDict = [self _propertiesForMenuObject: menuObject
+                                                     identifier: [item intValue]
+                                                          names: propertyNames];
     [array addObject: [DKStructArray arrayWithObjects: item, propertyDict, nil]]; 
   }
   NSDebugMLLog(@"DKMenu", @"Responding to property query %@ for %@: %@", propertyNames, menuItemIDs, array);
@@ -567,7 +1077,20 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
 - (id)menuItem: (NSNumber*)menuID property: (NSString*)property
 {
   id menuObject = [self _nativeMenuObjectForDBusID: [menuID unsignedIntegerValue]];
-  return [menuObject valueForDBusProperty: property];
+  id value = nil;
+  if (nil == menuObject)
+    {
+      return nil;
+    }
+  value = [[self _propertiesForMenuObject: menuObject
+                               identifier: [menuID intValue]
+                                    names: nil] objectForKey: property];
+  if (nil == value)
+    {
+      // Default values are not recorded in the cache.
+      value = VARIANT([DKMenuAllDefaults objectForKey: property]);
+    }
+  return value;
 }
 
 
@@ -601,9 +1124,15 @@ NSDictionary* DKMenuPropertyDictionaryForDBusProperties(id menuObject, NSArray*
 
 - (void)dealloc
 {
+  [[NSNotificationCenter defaultCenter] removeObserver: self];
   [representedMenu release];
   NSFreeMapTable(nativeToDBus);
   NSFreeMapTable(dBusToNative);
+  NSFreeMapTable(childrenForParent);
+  NSFreeMapTable(parentForItem);
+  NSFreeMapTable(propertySnapshots);
+  NSFreeMapTable(layoutRevisions);
+  NSFreeMapTable(iconCache);
   [center release];
   [lock release];
   [super dealloc];
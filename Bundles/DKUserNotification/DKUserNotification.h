@@ -34,14 +34,29 @@
 extern "C" {
 #endif
 
-@class NSConnection, NSArray;
+@class NSConnection, NSArray, NSMutableArray, NSRecursiveLock;
 @protocol Notifications;
 
+typedef enum
+{
+  DKUserNotificationConnecting = 0,
+  DKUserNotificationConnected,
+  DKUserNotificationFailed
+} DKUserNotificationConnectionState;
+
 @interface DKUserNotificationCenter : NSUserNotificationCenter
 {
   NSConnection *connection;
   id <NSObject, Notifications> proxy;
   NSArray *caps;
+  DKUserNotificationConnectionState connectionState;
+  /** Notifications delivered before the daemon was contacted. */
+  NSMutableArray *queuedNotifications;
+  /** Notifications that have been sent but not yet assigned an ID. */
+  NSMutableArray *inFlightNotifications;
+  /** In-flight notifications that were removed in the meantime. */
+  NSMutableArray *closeWhenDelivered;
+  NSRecursiveLock *lock;
 }
 
 @end
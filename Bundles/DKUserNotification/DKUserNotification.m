@@ -34,7 +34,9 @@
 #import <Foundation/NSUserNotification.h>
 #import <Foundation/NSArray.h>
 #import <Foundation/NSBundle.h>
+#import <Foundation/NSDictionary.h>
 #import "Foundation/NSException.h"
+#import <Foundation/NSLock.h>
 #import <Foundation/NSProcessInfo.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSURL.h>
@@ -75,6 +77,9 @@ static NSString * const kButtonActionKey = @"show";
 
 @interface DKUserNotificationCenter (Private)
 - (NSString *) cleanupTextIfNecessary: (NSString *)rawText;
+- (void) _didConnectWithCapabilities: (NSArray *)capabilities;
+- (void) _sendNotification: (NSUserNotification *)un;
+- (void) _removeDeliveredNotification: (NSUserNotification *)un;
 @end
 
 @implementation DKUserNotificationCenter
@@ -103,28 +108,119 @@ static NSString * const kButtonActionKey = @"show";
         NSLog(@"Unable to create a proxy for %@", kDBusPathKey);
         NS_VALUERETURN(nil, self);
       }
+    }
+    NS_HANDLER
+    {
+      NSLog(@"%@ during DBus setup: %@",
+          [localException name], [localException description]);
+      DESTROY(self);
+    }
+    NS_ENDHANDLER
+  }
+  if (self)
+  {
+    lock = [NSRecursiveLock new];
+    queuedNotifications = [NSMutableArray new];
+    inFlightNotifications = [NSMutableArray new];
+    closeWhenDelivered = [NSMutableArray new];
+
+    // Talking to the notification daemon might involve activating it, so we
+    // don't want to block the caller until it is up. The replies arrive on
+    // this thread's run loop.
+    NS_DURING
+    {
+      [(DKProxy *)proxy callMethod: @selector(GetServerInformation)
+                     withArguments: [NSArray array]
+                            target: self
+                          selector: @selector(_serverInformationReceived:)
+                          userInfo: nil];
+    }
+    NS_HANDLER
+    {
+      NSLog(@"%@ during DBus setup: %@",
+          [localException name], [localException description]);
+      [self _didConnectWithCapabilities: nil];
+    }
+    NS_ENDHANDLER
+  }
+  return self;
+}
 
-      NSString *name;
-      NSString *vendor;
-      NSString *version;
-#if 0
-      [proxy GetServerInformation: &name : &vendor : &version];
-#else
-      NSArray *info = [proxy GetServerInformation];
-        name    = [info objectAtIndex:0];
-        vendor  = [info objectAtIndex:1];
-        version = [info objectAtIndex:2];
-#endif
-      NSDebugLLog(@"NSUserNotification", @"connected to %@ (%@) by %@", name, version, vendor);
+- (void) dealloc
+{
+  [[DKNotificationCenter sessionBusCenter] removeObserver: self];
+  RELEASE(caps);
+  RELEASE(proxy);
+  RELEASE(connection);
+  RELEASE(queuedNotifications);
+  RELEASE(inFlightNotifications);
+  RELEASE(closeWhenDelivered);
+  RELEASE(lock);
+  [super dealloc];
+}
 
-      caps = RETAIN([proxy GetCapabilities]);
-      if (!caps)
-      {
-        NSLog(@"No response to GetCapabilities method");
-        NS_VALUERETURN(nil, self);
-      }
-      NSDebugLLog(@"NSUserNotification", @"capabilities: %@", caps);
+/*
+ * Handles the reply to GetServerInformation and asks for the capabilities of
+ * the daemon. Both calls are sent without blocking the worker thread, which
+ * is notified of the replies by libdbus.
+ */
+- (void) _serverInformationReceived: (NSDictionary *)reply
+{
+  NSException *exception = [reply objectForKey: @"exception"];
+  NSArray *info = [reply objectForKey: @"result"];
+
+  if (nil != exception)
+  {
+    NSLog(@"%@ during DBus setup: %@",
+        [exception name], [exception description]);
+    [self _didConnectWithCapabilities: nil];
+    return;
+  }
+  if ([info count] >= 3)
+  {
+    NSDebugLLog(@"NSUserNotification", @"connected to %@ (%@) by %@",
+      [info objectAtIndex: 0], [info objectAtIndex: 2],
+      [info objectAtIndex: 1]);
+  }
+
+  NS_DURING
+  {
+    [(DKProxy *)proxy callMethod: @selector(GetCapabilities)
+                   withArguments: [NSArray array]
+                          target: self
+                        selector: @selector(_capabilitiesReceived:)
+                        userInfo: nil];
+  }
+  NS_HANDLER
+  {
+    NSLog(@"%@ during DBus setup: %@",
+        [localException name], [localException description]);
+    [self _didConnectWithCapabilities: nil];
+  }
+  NS_ENDHANDLER
+}
+
+- (void) _capabilitiesReceived: (NSDictionary *)reply
+{
+  NSException *exception = [reply objectForKey: @"exception"];
+  NSArray *capabilities = [reply objectForKey: @"result"];
+
+  if (nil != exception)
+  {
+    NSLog(@"%@ during DBus setup: %@",
+        [exception name], [exception description]);
+    capabilities = nil;
+  }
+  else if (!capabilities)
+  {
+    NSLog(@"No response to GetCapabilities method");
+  }
+  else
+  {
+    NSDebugLLog(@"NSUserNotification", @"capabilities: %@", capabilities);
 
+    NS_DURING
+    {
       DKNotificationCenter *dnc = [DKNotificationCenter sessionBusCenter];
 #if 0
       [dnc addObserver: self
@@ -145,23 +241,73 @@ static NSString * const kButtonActionKey = @"show";
     {
       NSLog(@"%@ during DBus setup: %@",
           [localException name], [localException description]);
-      DESTROY(self);
+      capabilities = nil;
     }
     NS_ENDHANDLER
   }
-  return self;
+  [self _didConnectWithCapabilities: capabilities];
 }
 
-- (void) dealloc
+/*
+ * Finishes startup and sends the notifications that were queued in the
+ * meantime. Without capabilities, we assume that the daemon is unavailable.
+ */
+- (void) _didConnectWithCapabilities: (NSArray *)capabilities
 {
-  [[DKNotificationCenter sessionBusCenter] removeObserver: self];
-  RELEASE(caps);
-  RELEASE(proxy);
-  RELEASE(connection);
-  [super dealloc];
+  NSArray *queued = nil;
+  NSEnumerator *nEnum = nil;
+  NSUserNotification *un = nil;
+  [lock lock];
+  ASSIGN(caps, capabilities);
+  connectionState = (nil == caps) ? DKUserNotificationFailed
+                                  : DKUserNotificationConnected;
+  queued = AUTORELEASE([queuedNotifications copy]);
+  [queuedNotifications removeAllObjects];
+  [lock unlock];
+
+  if (nil == capabilities)
+  {
+    if ([queued count] > 0)
+    {
+      NSLog(@"Dropping %lu notifications: %@ is not available",
+        (unsigned long)[queued count], kDBusBusKey);
+    }
+    return;
+  }
+  nEnum = [queued objectEnumerator];
+  while (nil != (un = [nEnum nextObject]))
+  {
+    [self _sendNotification: un];
+  }
 }
 
 - (void) _deliverNotification: (NSUserNotification *)un
+{
+  [lock lock];
+  switch (connectionState)
+  {
+    case DKUserNotificationConnecting:
+      [queuedNotifications addObject: un];
+      [lock unlock];
+      return;
+    case DKUserNotificationFailed:
+      [lock unlock];
+      NSDebugMLLog(@"NSUserNotification",
+                   @"Not delivering %@, %@ is not available", un, kDBusBusKey);
+      return;
+    default:
+      break;
+  }
+  [lock unlock];
+  [self _sendNotification: un];
+}
+
+/*
+ * Sends the Notify call without waiting for the reply, so that several
+ * notifications can be in flight at once. The identifier assigned by the daemon
+ * is recorded in -_notifyCompleted:.
+ */
+- (void) _sendNotification: (NSUserNotification *)un
 {
   NSString *appName   = nil;
   NSString *imageName = nil;
@@ -219,28 +365,111 @@ static NSString * const kButtonActionKey = @"show";
 
   NSString *summary  = [self cleanupTextIfNecessary: un.title];
   NSString *body     = [self cleanupTextIfNecessary: un.informativeText];
-  NSNumber *uniqueId = [proxy Notify: appName
-                                    : 0
-                                    : imageName ? imageName : @""
-                                    : summary
-                                    : body
-                                    : actions
-                                    : [hints count] ? hints : nil
-                                    : -1];
-  ASSIGN(un->_uniqueId, uniqueId);
-  un.presented = YES;
+  NSArray  *args     = [NSArray arrayWithObjects: appName,
+                         [NSNumber numberWithUnsignedInt: 0],
+                         imageName ? imageName : @"",
+                         summary ? summary : @"",
+                         body ? body : @"",
+                         actions,
+                         hints,
+                         [NSNumber numberWithInt: -1], nil];
+
+  [lock lock];
+  [inFlightNotifications addObject: un];
+  [lock unlock];
+  NS_DURING
+  {
+    [(DKProxy *)proxy callMethod: @selector(Notify::::::::)
+                   withArguments: args
+                          target: self
+                        selector: @selector(_notifyCompleted:)
+                        userInfo: un];
+  }
+  NS_HANDLER
+  {
+    NSLog(@"%@ sending notification: %@",
+        [localException name], [localException description]);
+    [lock lock];
+    [inFlightNotifications removeObjectIdenticalTo: un];
+    [lock unlock];
+  }
+  NS_ENDHANDLER
+}
+
+- (void) _notifyCompleted: (NSDictionary *)reply
+{
+  NSUserNotification *un = [reply objectForKey: @"userInfo"];
+  NSException *exception = [reply objectForKey: @"exception"];
+  BOOL closeNow = NO;
+
+  [lock lock];
+  if (nil == exception)
+  {
+    ASSIGN(un->_uniqueId, [reply objectForKey: @"result"]);
+    un.presented = YES;
+  }
+  if (NSNotFound != [closeWhenDelivered indexOfObjectIdenticalTo: un])
+  {
+    [closeWhenDelivered removeObjectIdenticalTo: un];
+    closeNow = YES;
+  }
+  // Keep the notification alive until we are done with it.
+  AUTORELEASE(RETAIN(un));
+  [inFlightNotifications removeObjectIdenticalTo: un];
+  [lock unlock];
+
+  if (nil != exception)
+  {
+    NSLog(@"%@ delivering notification: %@",
+        [exception name], [exception description]);
+  }
+  else if (closeNow)
+  {
+    [self _removeDeliveredNotification: un];
+  }
 }
 
 - (void)_removeDeliveredNotification:(NSUserNotification *)un
 {
+  [lock lock];
+  if (NSNotFound != [queuedNotifications indexOfObjectIdenticalTo: un])
+  {
+    // Never sent, nothing to close.
+    [queuedNotifications removeObjectIdenticalTo: un];
+    [lock unlock];
+    return;
+  }
+  if (NSNotFound != [inFlightNotifications indexOfObjectIdenticalTo: un])
+  {
+    // We don't know the identifier yet, close it once we do.
+    [closeWhenDelivered addObject: un];
+    [lock unlock];
+    return;
+  }
+  [lock unlock];
   if (un.presented)
-    [proxy CloseNotification: [un->_uniqueId unsignedIntValue]];
+  {
+    NS_DURING
+    {
+      [(DKProxy *)proxy callMethod: @selector(CloseNotification:)
+                     withArguments: [NSArray arrayWithObject: un->_uniqueId]
+                            target: nil
+                          selector: NULL
+                          userInfo: nil];
+    }
+    NS_HANDLER
+    {
+      NSLog(@"%@ closing notification: %@",
+          [localException name], [localException description]);
+    }
+    NS_ENDHANDLER
+  }
 }
 
 - (NSString *)cleanupTextIfNecessary:(NSString *)rawText
 {
   if (!rawText || ![caps containsObject:@"body-markup"])
-    return nil;
+    return rawText;
 
   NSMutableString *t = (NSMutableString *)[rawText mutableCopy];
   [t replaceOccurrencesOfString: @"&"  withString: @"&amp;"  options: 0 range: NSMakeRange(0, [t length])];  // must be first!
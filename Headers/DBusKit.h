@@ -20,9 +20,12 @@
    Boston, MA 02111 USA.
    */
 
+#import <DBusKit/DKChannel.h>
 #import <DBusKit/DKCommon.h>
+#import <DBusKit/DKGeneratedIntrospection.h>
 #import <DBusKit/DKNotificationCenter.h>
 #import <DBusKit/DKPort.h>
+#import <DBusKit/DKPreparedCall.h>
 #import <DBusKit/DKProxy.h>
 #import <DBusKit/DKStruct.h>
 #import <DBusKit/DKVariant.h>
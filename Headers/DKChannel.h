@@ -0,0 +1,160 @@
+/** Interface for DKChannel to stream typed records over a file descriptor.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+   */
+
+#import <Foundation/NSObject.h>
+@class NSArray, NSData, NSFileHandle, NSMutableArray, NSMutableData, NSString;
+
+/**
+ * A DKChannel streams records of a fixed D-Bus type signature over a socket,
+ * bypassing the message bus. This is useful for high-rate streams of small
+ * records, for which a signal or method call per record would be too
+ * expensive.
+ *
+ * The socket is negotiated with an ordinary method call: The service creates a
+ * channel with +channelWithRecordSignature:remoteHandle: and returns the
+ * remote handle from a method with an <code>h</code> (UNIX_FD) return type.
+ * The client wraps the file handle it receives with
+ * -initWithFileHandle:recordSignature:.
+ *
+ * Records are passed as arrays holding one object per complete type in the
+ * record signature, boxed in the same way as arguments of method calls. They
+ * are marshalled in batches, every batch being a D-Bus message with an array
+ * of record structures as its body.
+ *
+ * In blocking mode (the default), writes block while the peer does not keep
+ * up and reads block until a batch has arrived. In non-blocking mode,
+ * -writeRecord: refuses records while more than the high water mark of
+ * encoded data is waiting to be written and -readRecord returns nil if no
+ * complete batch is available.
+ */
+@interface DKChannel: NSObject
+{
+  int fd;
+  NSString *recordSignature;
+  NSString *batchSignature;
+  id batchArgument;
+  id recordArgument;
+  NSMutableArray *pendingRecords;
+  NSUInteger batchSize;
+  NSUInteger highWaterMark;
+  NSMutableData *outBuffer;
+  NSUInteger outOffset;
+  NSMutableData *inBuffer;
+  NSArray *receivedRecords;
+  NSUInteger receivedIndex;
+  BOOL isBlocking;
+  BOOL atEOF;
+}
+
+/**
+ * Creates a connected socket pair and returns a channel for one end of it. The
+ * other end is returned in <var>handle</var>, to be passed to the peer as a
+ * UNIX_FD argument or return value. Returns nil if the signature is invalid or
+ * the sockets could not be created.
+ */
++ (id)channelWithRecordSignature: (NSString*)signature
+                    remoteHandle: (NSFileHandle**)handle;
+
+/**
+ * Initializes a channel for a duplicate of the file descriptor of
+ * <var>handle</var>, so the handle can be released independently. If
+ * <var>signature</var> is nil, the signature of the first batch received is
+ * adopted.
+ */
+- (id)initWithFileHandle: (NSFileHandle*)handle
+         recordSignature: (NSString*)signature;
+
+/**
+ * Initializes a channel for <var>descriptor</var>, which will be closed with
+ * the channel.
+ */
+- (id)initWithFileDescriptor: (int)descriptor
+             recordSignature: (NSString*)signature;
+
+/**
+ * Returns the D-Bus type signature of a record.
+ */
+- (NSString*)recordSignature;
+
+/**
+ * Returns the file descriptor of the channel, e.g. for polling it.
+ */
+- (int)fileDescriptor;
+
+/**
+ * Sets the number of records that are marshalled into one batch (256 by
+ * default). A batch is written once it is complete or the channel is flushed.
+ */
+- (void)setBatchSize: (NSUInteger)count;
+
+/**
+ * Sets the number of encoded bytes that may wait to be written in
+ * non-blocking mode before -writeRecord: refuses records (1 MiB by default).
+ */
+- (void)setHighWaterMark: (NSUInteger)bytes;
+
+/**
+ * Switches the channel between blocking and non-blocking mode.
+ */
+- (void)setBlocking: (BOOL)flag;
+
+/**
+ * Queues <var>record</var> for writing. Returns NO if the record was refused
+ * because of backpressure or the channel is broken. Raises if the record does
+ * not match the record signature.
+ */
+- (BOOL)writeRecord: (NSArray*)record;
+
+/**
+ * Writes all queued records. In non-blocking mode, returns NO if some data
+ * could not be written yet.
+ */
+- (BOOL)flush;
+
+/**
+ * Returns the number of encoded bytes waiting to be written.
+ */
+- (NSUInteger)bufferedByteCount;
+
+/**
+ * Returns the next record, or nil at the end of the stream or, in
+ * non-blocking mode, if no complete batch has arrived.
+ */
+- (NSArray*)readRecord;
+
+/**
+ * Returns the next batch in D-Bus wire format without decoding it, or nil
+ * under the same conditions as -readRecord. The data can be decoded with
+ * dbus_message_demarshal(). Records already decoded by -readRecord are not
+ * included.
+ */
+- (NSData*)readBatchData;
+
+/**
+ * Returns YES once the peer has closed the channel and all batches have been
+ * read.
+ */
+- (BOOL)isAtEnd;
+
+/**
+ * Flushes queued records and closes the file descriptor. In non-blocking mode,
+ * data that cannot be written right away is discarded.
+ */
+- (void)close;
+@end
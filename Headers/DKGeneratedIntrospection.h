@@ -0,0 +1,93 @@
+/** Declarations for introspection data generated at build time.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+   */
+
+/*
+ * The dk_make_dispatch tool scans the headers of exported classes with
+ * libclang and emits a source file containing the tables declared here. When
+ * that file is linked into a service, the tables are registered before main()
+ * runs and DBusKit builds the interfaces of exported objects from them instead
+ * of reflecting over the Objective-C runtime. Generated code should not fill
+ * in these structures by hand, their layout may change with the tool.
+ */
+
+/**
+ * Describes an argument of a generated method.
+ */
+typedef struct
+{
+  /** The D-Bus type signature of the argument (one complete type). */
+  const char *signature;
+  /** The name of the argument, or NULL. */
+  const char *name;
+  /** The Objective-C class declared for object arguments, or NULL. */
+  const char *className;
+  /** Non-zero for the return value, zero for input arguments. */
+  int isOutput;
+} DKGeneratedArgument;
+
+/**
+ * Describes a method of a generated interface.
+ */
+typedef struct
+{
+  /** The D-Bus member name of the method. */
+  const char *member;
+  /** The Objective-C selector the method dispatches to. */
+  const char *selector;
+  /** The arguments of the method, return value first. */
+  const DKGeneratedArgument *arguments;
+  /** The number of entries in <var>arguments</var>. */
+  unsigned int argumentCount;
+} DKGeneratedMethod;
+
+/**
+ * Describes the interface generated for an Objective-C class or protocol.
+ */
+typedef struct
+{
+  /** The name of the class or protocol the interface was generated for. */
+  const char *objCName;
+  /** Non-zero if <var>objCName</var> names a protocol. */
+  int isProtocol;
+  /** The D-Bus name of the interface. */
+  const char *interfaceName;
+  /** The methods of the interface. */
+  const DKGeneratedMethod *methods;
+  /** The number of entries in <var>methods</var>. */
+  unsigned int methodCount;
+} DKGeneratedInterface;
+
+/**
+ * A table of generated interfaces, as emitted for one set of headers. The
+ * <var>next</var> field is used by DBusKit to chain registered tables.
+ */
+typedef struct DKGeneratedIntrospectionTable
+{
+  const DKGeneratedInterface *interfaces;
+  unsigned int interfaceCount;
+  struct DKGeneratedIntrospectionTable *next;
+} DKGeneratedIntrospectionTable;
+
+/**
+ * Makes the interfaces in <var>table</var> available to DBusKit. This is safe
+ * to call from a constructor function before the Objective-C runtime has been
+ * set up. The table must stay valid for the lifetime of the process.
+ */
+void
+DKRegisterGeneratedIntrospection(DKGeneratedIntrospectionTable *table);
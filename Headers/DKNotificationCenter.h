@@ -23,7 +23,7 @@
 #import <Foundation/NSObject.h>
 #import <DBusKit/DKCommon.h>
 #import <DBusKit/DKPort.h>
-@class DKDBus, DKEndpoint, DKProxy, NSDictionary, NSHashTable, NSRecursiveLock,
+@class DKDBus, DKEndpoint, DKProxy, NSArray, NSCountedSet, NSDictionary, NSHashTable, NSRecursiveLock,
   NSMapTable, NSMutableDictionary, NSNotification, NSString;
 
 /**
@@ -108,9 +108,41 @@
   NSMapTable *notificationNamesBySignal;
 
   /**
-   * The lock protecting the tables.
+   * The lock protecting the signal and notification name tables.
    */
    NSRecursiveLock *lock;
+
+  /**
+   * The lock serializing changes to the observables table.
+   */
+  NSRecursiveLock *observablesLock;
+
+  /**
+   * Immutable copy of the observables table, which is read without locking
+   * when matching signals.
+   */
+  NSArray *observableSnapshot;
+
+  /**
+   * Spin lock protecting access to the observableSnapshot pointer.
+   */
+  int snapshotLock;
+
+  /**
+   * Maps observers to the observables they are watching, so that removing an
+   * observer does not need to look at all observables.
+   */
+  NSMapTable *observablesByObserver;
+
+  /**
+   * Match rules waiting to be removed from the bus.
+   */
+  NSCountedSet *pendingRuleRemovals;
+
+  /**
+   * Whether removal of the pending match rules has been scheduled.
+   */
+  BOOL ruleRemovalScheduled;
 }
 
 /**
@@ -20,6 +20,7 @@
    Boston, MA 02111 USA.
    */
 
+#import <Foundation/NSDate.h>
 #import <Foundation/NSPort.h>
 
 @class NSLock, NSMapTable, NSMutableDictionary, DKEndpoint;
@@ -100,6 +101,83 @@ typedef NS_ENUM(NSUInteger, DKDBusBusType)
  */
 + (void)enableWorkerThread;
 
+/**
+ * Configures the low-latency mode of the worker thread, for applications that
+ * cannot afford the time it takes to wake the thread up when a message
+ * arrives. If <var>cpu</var> is not negative, the worker thread is pinned to
+ * that CPU (this is only supported on Linux). If <var>priority</var> is
+ * greater than zero, the thread requests the real-time SCHED_FIFO policy at
+ * that priority, which usually requires privileges. If <var>interval</var> is
+ * greater than zero, the thread keeps polling the bus connections without
+ * sleeping until no event was handled for that many seconds, at the cost of
+ * keeping a CPU busy. Busy-polling at a real-time priority should only be
+ * combined with pinning to a CPU that is not needed by other threads.
+ * Passing -1, 0 and 0 restores the default behaviour. Settings that cannot be
+ * applied are logged and otherwise ignored.
+ */
++ (void)setWorkerThreadCPU: (NSInteger)cpu
+        schedulingPriority: (NSInteger)priority
+          busyPollInterval: (NSTimeInterval)interval;
+
+/**
+ * Enables or disables the trace recorder. While enabled, DBusKit records
+ * method calls, marshalling, handoffs to its worker thread, message dispatch,
+ * signals and introspection into per-thread ring buffers. Tracing can also be
+ * enabled by setting the DBUSKIT_TRACE environment variable to the file the
+ * trace should be written to on exit.
+ */
++ (void)setTracingEnabled: (BOOL)flag;
+
+/**
+ * Writes the recorded trace to <var>path</var> in the Chrome trace event
+ * format, which can be loaded into chrome://tracing or Perfetto. Returns NO if
+ * the file could not be written.
+ */
++ (BOOL)writeTraceToFile: (NSString*)path;
+
+/**
+ * Returns the live object counters for the classes DBusKit creates in large
+ * numbers (proxies, introspection data, arguments, messages, observations and
+ * variants). The dictionary is keyed by class name, and each value is a
+ * dictionary containing the number of live instances (key <code>live</code>)
+ * and the total number of instances allocated so far (key
+ * <code>allocated</code>). Instances of subclasses are included in the counts
+ * for their superclass. The counters are always enabled, so they can be sampled
+ * periodically to find leaks and allocation hot spots in long running
+ * processes.
+ */
++ (NSDictionary*)allocationStatistics;
+
+/**
+ * Controls whether identical synchronous calls to idempotent methods that are
+ * issued concurrently share a single message on the bus. Methods are
+ * idempotent if they carry the <code>org.gnustep.dbuskit.Idempotent</code>
+ * annotation or are queries of the standard org.freedesktop.DBus interfaces,
+ * such as GetNameOwner, Introspect or Properties.Get. Coalescing is enabled by
+ * default, but only takes effect while the worker thread is enabled.
+ */
++ (void)setCoalescesIdempotentCalls: (BOOL)flag;
+
+/**
+ * Returns statistics for the client-side result cache (see
+ * -[DKProxy setResultCacheTTL:invalidatedBySignal:forSelector:]). The
+ * dictionary contains the number of calls answered from the cache
+ * (<code>hits</code>), of calls to cached methods that had to be sent
+ * (<code>misses</code>), of results dropped to make room
+ * (<code>evictions</code>), because their time-to-live had passed
+ * (<code>expirations</code>) or because of an invalidating signal
+ * (<code>invalidations</code>), as well as the number of cached results
+ * (<code>entries</code>) and the maximum number of results
+ * (<code>capacity</code>).
+ */
++ (NSDictionary*)resultCacheStatistics;
+
+/**
+ * Sets the maximum number of results kept in the client-side result cache.
+ * The default is 256. Setting it to 0 disables the cache.
+ */
++ (void)setResultCacheCapacity: (NSUInteger)capacity;
+
 /**
  * Return a DKPort instance connected to the specified D-Bus peer on the session
  * message bus.
@@ -112,4 +190,76 @@ typedef NS_ENUM(NSUInteger, DKDBusBusType)
  */
 - (id)initWithRemote: (NSString*)remote
                onBus: (DKDBusBusType)bus;
+
+/**
+ * Enables or disables collection of traffic statistics for the connection
+ * the port uses. Since connections are shared, this affects all ports to the
+ * same bus.
+ */
+- (void)setCollectsStatistics: (BOOL)yesno;
+
+/**
+ * Starts recording the raw messages sent and received over the connection the
+ * port uses to the file at <var>path</var>, together with their direction and
+ * time. The capture can be replayed offline with the dk_bench_replay tool.
+ * Since connections are shared, this captures the traffic of all ports to the
+ * same bus. Returns NO if the file could not be created.
+ */
+- (BOOL)startCapturingToFile: (NSString*)path;
+
+/**
+ * Stops recording messages and closes the capture file.
+ */
+- (void)stopCapturing;
+
+/**
+ * Returns the traffic statistics for the connection the port uses. The
+ * dictionary contains the following keys:
+ * <deflist>
+ * <term>messagesSent</term><desc>Number of messages sent</desc>
+ * <term>bytesSent</term><desc>Size of all messages sent</desc>
+ * <term>messagesReceived</term><desc>Number of messages received</desc>
+ * <term>bytesReceived</term><desc>Size of all messages received</desc>
+ * <term>maxMessageSize</term><desc>Size of the largest message seen</desc>
+ * <term>outgoingQueueSize</term><desc>Number of bytes waiting to be written to
+ * the connection</desc>
+ * <term>dispatchTime</term><desc>Time spent dispatching incoming messages (in
+ * seconds)</desc>
+ * </deflist>
+ */
+- (NSDictionary*)statistics;
+
+/**
+ * Limits the number of bytes that will be buffered from the connection before
+ * DBusKit stops reading from it.
+ */
+- (void)setMaximumReceivedSize: (NSUInteger)size;
+
+/**
+ * Limits the size of a single message that will be accepted from the
+ * connection.
+ */
+- (void)setMaximumMessageSize: (NSUInteger)size;
+
+/**
+ * Sets the outgoing queue size that causes a
+ * <code>DKEndpointThresholdExceededNotification</code> to be posted.
+ */
+- (void)setOutgoingQueueThreshold: (NSUInteger)size;
+
+/**
+ * Sets the message size that causes a
+ * <code>DKEndpointThresholdExceededNotification</code> to be posted.
+ */
+- (void)setMessageSizeThreshold: (NSUInteger)size;
 @end
+
+/**
+ * Posted to the default notification center when a connection exceeds one of
+ * the configured thresholds. The notification is delivered on the main thread,
+ * which needs to run its run loop to receive it. The userInfo dictionary
+ * carries the name of the threshold ("outgoingQueueSize" or "messageSize")
+ * under the "threshold" key and the observed value and the configured limit
+ * under the "value" and "limit" keys.
+ */
+extern NSString *DKEndpointThresholdExceededNotification;
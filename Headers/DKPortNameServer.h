@@ -24,7 +24,7 @@
 #import <DBusKit/DKPort.h>
 #include <stdint.h>
 
-@class DKPort, NSHashTable, NSMutableDictionary, NSRecursiveLock, NSString;
+@class DKPort, NSHashTable, NSMapTable, NSMutableDictionary, NSRecursiveLock, NSString;
 
 typedef NS_OPTIONS(NSUInteger, DKPortNameFlags)
 {
@@ -79,10 +79,22 @@ typedef NS_ENUM(uint32_t, DKPortNameRegistrationStatus)
    */
   NSHashTable *activeNames;
 
+  /**
+   * Maps names to the threads that requested them, which are notified when
+   * the names are acquired or lost.
+   */
+  NSMapTable *nameThreads;
+
   /**
    * The lock protecting the tables.
    */
    NSRecursiveLock *lock;
+
+  /**
+   * Records whether the name server is already watching the NameAcquired and
+   * NameLost signals.
+   */
+  BOOL observingNames;
 }
 
 + (id)sharedSystemBusPortNameServer;
@@ -100,5 +112,50 @@ typedef NS_ENUM(uint32_t, DKPortNameRegistrationStatus)
                                         name: (NSString*)name
                                        flags: (DKPortNameFlags)flags;
 
+/**
+ * Requests <var>name</var> for <var>port</var> without waiting for the bus to
+ * reply. Once the request completes, <var>selector</var> is performed on
+ * <var>target</var> with a dictionary containing the name (under the "name"
+ * key) and the DKPortNameRegistrationStatus (as an NSNumber under the "status"
+ * key). If the request failed, the exception will be passed under the
+ * "exception" key instead of the status. The target is notified on the thread
+ * that issued the request, which needs to run its run loop.
+ */
+- (void)registerPort: (DKPort*)port
+                name: (NSString*)name
+               flags: (DKPortNameFlags)flags
+              target: (id)target
+            selector: (SEL)selector;
+
 - (void)removePortForName: (NSString*)name;
+
+/**
+ * Asks the bus to activate the service owning <var>name</var> without waiting
+ * for the activation to complete. This can be used to start services an
+ * application will need later on while it is still busy doing other work.
+ * If <var>target</var> is not nil, <var>selector</var> will be performed on
+ * it once the service is running. The argument is a dictionary containing the
+ * name (under the "name" key) and the reply from the bus (as an NSNumber under
+ * the "result" key, 1 if the service was started and 2 if it was already
+ * running) or the exception that occurred (under the "exception" key).
+ */
+- (void)startServiceWithName: (NSString*)name
+                      target: (id)target
+                    selector: (SEL)selector;
 @end
+
+/**
+ * Posted to the default notification center when the bus assigns a name to
+ * the application. The name is passed under the "name" key of the userInfo
+ * dictionary. The notification is posted on the thread that registered the
+ * name, which needs to run its run loop.
+ */
+extern NSString *DKPortNameAcquiredNotification;
+
+/**
+ * Posted to the default notification center when the application loses a name
+ * it owned. The name is passed under the "name" key of the userInfo
+ * dictionary. Like DKPortNameAcquiredNotification, it is posted on the thread
+ * that registered the name.
+ */
+extern NSString *DKPortNameLostNotification;
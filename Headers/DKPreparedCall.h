@@ -0,0 +1,85 @@
+/** Interface for DKPreparedCall to call a D-Bus method repeatedly.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+   */
+
+#import <Foundation/NSObject.h>
+@class DKProxy, NSInvocation, NSMethodSignature;
+
+/**
+ * A DKPreparedCall binds a method of a D-Bus object once, like a prepared
+ * statement does for a database query: The D-Bus method is looked up for the
+ * selector, the method signature is checked and the header of the method call
+ * message is built when the prepared call is created. Every invocation only
+ * supplies the argument values, skipping the
+ * -methodSignatureForSelector:/-forwardInvocation: round trip that a message
+ * sent to the proxy needs.
+ *
+ * Arguments are passed as pointers to the argument values, in the order of the
+ * method signature. Prepared calls reuse their invocation and must not be
+ * used from more than one thread at a time.
+ */
+@interface DKPreparedCall: NSObject
+{
+  DKProxy *proxy;
+  id method;
+  NSInvocation *invocation;
+  struct DBusMessage *message;
+  NSUInteger argumentCount;
+}
+
+/**
+ * Returns a prepared call for the method corresponding to <var>selector</var>
+ * on <var>aProxy</var>.
+ */
++ (id)preparedCallWithProxy: (DKProxy*)aProxy
+                   selector: (SEL)selector;
+
+/**
+ * Prepares a call for the method corresponding to <var>selector</var> on
+ * <var>aProxy</var>. Raises a <code>DKInvalidArgumentException</code> if the
+ * proxy does not have such a method or if the selector does not match its
+ * signature.
+ */
+- (id)initWithProxy: (DKProxy*)aProxy
+           selector: (SEL)selector;
+
+/**
+ * Returns the method signature arguments and return values need to conform to.
+ */
+- (NSMethodSignature*)methodSignature;
+
+/**
+ * Returns the number of arguments passed to the method.
+ */
+- (NSUInteger)numberOfArguments;
+
+/**
+ * Calls the method with the arguments pointed to by the elements of
+ * <var>arguments</var> and stores the return value at <var>returnValue</var>,
+ * unless it is <code>NULL</code>.
+ */
+- (void)invokeWithArguments: (void**)arguments
+                returnValue: (void*)returnValue;
+
+/**
+ * Calls the method with the arguments pointed to by the variable arguments
+ * and stores the return value at <var>returnValue</var>, unless it is
+ * <code>NULL</code>.
+ */
+- (void)invokeWithReturnValue: (void*)returnValue, ...;
+@end
@@ -21,10 +21,11 @@
    Boston, MA 02111 USA.
    */
 
+#import <Foundation/NSDate.h>
 #import <Foundation/NSProxy.h>
 #import <DBusKit/DKPort.h>
 
-@class DKEndpoint, DKInterface, NSCondition, NSLock, NSString, NSMapTable, NSMutableArray, NSMutableDictionary;
+@class DKEndpoint, DKInterface, NSArray, NSCondition, NSLock, NSString, NSMapTable, NSMutableArray, NSMutableDictionary, NSThread;
 @protocol NSCoding;
 
 
@@ -80,6 +81,17 @@ typedef NSInteger DKProxyState;
    * Identifies the present state of the proxy.
    */
   DKProxyState state;
+
+  /**
+   * The key under which the proxy is registered in the process-wide table of
+   * live proxies, or nil if it is not registered.
+   */
+  NSString *uniqueKey;
+
+  /**
+   * Asynchronous calls that wait for the proxy to be introspected.
+   */
+  NSMutableArray *deferredCalls;
 }
 
 + (id) proxyWithPort: (DKPort*)aPort
@@ -89,6 +101,14 @@ typedef NSInteger DKProxyState;
                    path: (NSString*)aPath
                     bus: (DKDBusBusType)type;
 
+/**
+ * Initializes a proxy for the object at <var>aPath</var>, reached through
+ * <var>aPort</var>. As long as a proxy for the same object (i.e. with the same
+ * endpoint, service and path) is alive, the receiver is released and the
+ * existing proxy is returned instead, so that all users share its introspection
+ * data. Consequently, changes like -setPrimaryDBusInterface: will be visible
+ * to every holder of the proxy.
+ */
 - (id) initWithPort: (DKPort*)aPort
                path: (NSString*)aPath;
 
@@ -113,6 +133,54 @@ typedef NSInteger DKProxyState;
  * interface as the primary one by calling -setPrimaryDBusInterface:.
  */
 - (void)setPrimaryDBusInterface: (NSString*)anInterface;
+
+/**
+ * Calls the D-Bus method corresponding to <var>selector</var> without waiting
+ * for the reply. The arguments are passed as objects in <var>arguments</var>,
+ * in the same way as for a boxed method call. Once the call has completed,
+ * <var>callback</var> is performed on <var>target</var> with a dictionary
+ * containing the return value under the key <code>result</code>, or the
+ * exception that occurred under the key <code>exception</code>.
+ * <var>userInfo</var> is passed along under the key <code>userInfo</code>.
+ * The callback is delivered on the calling thread, which needs to run its run
+ * loop.
+ *
+ * If the proxy has not been introspected yet, this is done asynchronously and
+ * the call is sent once it has finished. Errors in resolving the method are
+ * then reported to the callback instead of being raised.
+ *
+ * Returns an autoreleased handle for the call. Sending <code>-cancel</code> to
+ * it abandons the call, which then completes with a
+ * <code>DKDBusCallCancelledException</code>.
+ */
+- (id)callMethod: (SEL)selector
+   withArguments: (NSArray*)arguments
+          target: (id)target
+        selector: (SEL)callback
+        userInfo: (id)userInfo;
+
+/**
+ * Cancels the synchronous D-Bus method call <var>thread</var> is blocked in,
+ * which will then raise a <code>DKDBusCallCancelledException</code>. Returns NO
+ * if the thread is not waiting for a reply.
+ */
++ (BOOL)cancelSynchronousCallOnThread: (NSThread*)thread;
+
+/**
+ * Enables the client-side result cache for the D-Bus method corresponding to
+ * <var>selector</var>: For <var>ttl</var> seconds after a successful call,
+ * calls with the same arguments are answered from the cache without contacting
+ * the remote object. If <var>signalName</var> is not nil, all cached results
+ * of the method are discarded whenever the remote object emits that signal
+ * (the name may be qualified with an interface name). Passing 0 as the
+ * <var>ttl</var> disables caching again. This is equivalent to annotating the
+ * method with <code>org.gnustep.dbuskit.CacheTTL</code> and
+ * <code>org.gnustep.dbuskit.CacheInvalidatedBy</code>, but takes precedence
+ * over the annotations and may be called while the method is in use.
+ */
+- (void)setResultCacheTTL: (NSTimeInterval)ttl
+      invalidatedBySignal: (NSString*)signalName
+              forSelector: (SEL)selector;
 @end
 
 extern NSString* DKBusDisconnectedNotification;
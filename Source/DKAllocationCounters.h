@@ -0,0 +1,91 @@
+/** Declarations of the DBusKit live object counters.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/NSObject.h>
+#include <stdint.h>
+
+@class NSDictionary;
+
+/*
+ * The allocation counters keep track of the number of live instances and the
+ * total number of allocations of the classes DBusKit creates in large numbers.
+ * Unlike GSDebugAllocationAdd(), they are always enabled: Counting costs two
+ * atomic additions per allocation and one per deallocation, and every counter
+ * lives on its own cache line so that threads allocating different kinds of
+ * objects do not contend.
+ *
+ * A class is counted from its +allocWithZone: and -dealloc methods, so the
+ * counters include instances of subclasses (e.g. DKOutgoingProxy instances are
+ * also counted as DKProxy instances).
+ */
+
+/**
+ * The kinds of objects that are counted.
+ */
+typedef enum
+{
+  DKAllocationProxy = 0,
+  DKAllocationOutgoingProxy,
+  DKAllocationLazyProxy,
+  DKAllocationProxyStandin,
+  DKAllocationInterface,
+  DKAllocationMethod,
+  DKAllocationSignal,
+  DKAllocationArgument,
+  DKAllocationMethodCall,
+  DKAllocationMethodReturn,
+  DKAllocationSignalEmission,
+  DKAllocationObservable,
+  DKAllocationObservation,
+  DKAllocationVariant,
+  DKAllocationKindCount
+} DKAllocationKind;
+
+typedef struct
+{
+  volatile int64_t live;
+  volatile uint64_t allocated;
+  char padding[48];
+} DKAllocationCounter;
+
+extern DKAllocationCounter DKAllocationCounters[DKAllocationKindCount];
+
+/**
+ * Records the allocation of an object of the given kind.
+ */
+#define DKCountAllocation(kind) do {\
+  __sync_fetch_and_add(&DKAllocationCounters[(kind)].live, 1);\
+  __sync_fetch_and_add(&DKAllocationCounters[(kind)].allocated, 1);\
+} while (0)
+
+/**
+ * Records the deallocation of an object of the given kind.
+ */
+#define DKCountDeallocation(kind) do {\
+  __sync_fetch_and_sub(&DKAllocationCounters[(kind)].live, 1);\
+} while (0)
+
+/**
+ * Returns a dictionary keyed by class name. Each value is a dictionary with
+ * the number of live instances (key "live") and the number of allocations
+ * since the process started (key "allocated").
+ */
+NSDictionary*
+DKAllocationStatistics(void);
@@ -0,0 +1,66 @@
+/** Implementation of the DBusKit live object counters.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import "DKAllocationCounters.h"
+
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+DKAllocationCounter DKAllocationCounters[DKAllocationKindCount]
+  __attribute__((aligned(64)));
+
+static NSString *DKAllocationClassNames[DKAllocationKindCount] = {
+  @"DKProxy",
+  @"DKOutgoingProxy",
+  @"DKLazyProxy",
+  @"DKProxyStandin",
+  @"DKInterface",
+  @"DKMethod",
+  @"DKSignal",
+  @"DKArgument",
+  @"DKMethodCall",
+  @"DKMethodReturn",
+  @"DKSignalEmission",
+  @"DKObservable",
+  @"DKObservation",
+  @"DKVariant"
+};
+
+NSDictionary*
+DKAllocationStatistics(void)
+{
+  NSMutableDictionary *stats =
+    [NSMutableDictionary dictionaryWithCapacity: DKAllocationKindCount];
+  NSUInteger i = 0;
+  for (i = 0; i < DKAllocationKindCount; i++)
+  {
+    // The counters are read independently, so the values are only a snapshot.
+    int64_t live = __sync_fetch_and_add(&DKAllocationCounters[i].live, 0);
+    uint64_t allocated =
+      __sync_fetch_and_add(&DKAllocationCounters[i].allocated, 0);
+    [stats setObject: [NSDictionary dictionaryWithObjectsAndKeys:
+        [NSNumber numberWithLongLong: (long long)live], @"live",
+        [NSNumber numberWithUnsignedLongLong: (unsigned long long)allocated], @"allocated",
+        nil]
+              forKey: DKAllocationClassNames[i]];
+  }
+  return stats;
+}
@@ -36,6 +36,38 @@
 extern NSString *kDKArgumentDirectionIn;
 extern NSString *kDKArgumentDirectionOut;
 
+/**
+ * Status codes used by the internal marshalling routines to report failures
+ * without raising.
+ */
+typedef enum
+{
+  /** No error occurred. */
+  DKMarshallingSuccess = 0,
+  /** libdbus ran out of memory while appending to the message. */
+  DKMarshallingOutOfMemory,
+  /** The object could not be unboxed to the type of the argument. */
+  DKMarshallingUnboxingFailure,
+  /** The object cannot be represented as a value of the container type. */
+  DKMarshallingInvalidObject,
+  /** The message does not contain the type described by the argument. */
+  DKMarshallingTypeMismatch,
+  /** The message iterator yielded an element of an unexpected type. */
+  DKMarshallingMistypedIterator
+} DKMarshallingStatus;
+
+/**
+ * Describes the first failure encountered while marshalling or unmarshalling
+ * a value. The argument and object are not retained, they are only valid
+ * until the marshalling call that reported the failure returns.
+ */
+typedef struct
+{
+  DKMarshallingStatus status;
+  id argument;
+  id object;
+} DKMarshallingError;
+
 
 /**
  *  DKArgument encapsulates D-Bus argument information and handles
@@ -183,6 +215,25 @@ extern NSString *kDKArgumentDirectionOut;
 - (void) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter;
 
+/**
+ * Like -marshallObject:intoIterator:, but returns NO and describes the failure
+ * in <var>error</var> instead of raising. Subclasses override this method
+ * rather than the raising variant, so that failures in nested containers are
+ * propagated without setting up an exception handler per level.
+ */
+- (BOOL) marshallObject: (id)object
+           intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error;
+
+/**
+ * Like -unmarshalledObjectFromIterator:, but returns nil and describes the
+ * failure in <var>error</var> instead of raising. Since nil is also a valid
+ * result, callers need to check the status of <var>error</var>, which must be
+ * initialized to DKMarshallingSuccess.
+ */
+- (id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                                error: (DKMarshallingError*)error;
+
 /**
  * Returns whether the parent of the node is already an DKArgument. This might
  * matter when serialising the argument into an XML or Objective-C
@@ -43,9 +43,11 @@
 #import <GNUstepBase/NSDebug+GNUstepBase.h>
 #endif
 
+#import "DKAllocationCounters.h"
 #import "DKProxy+Private.h"
 #import "DKPort+Private.h"
 #import "DKEndpoint.h"
+#import "DKLazyProxy.h"
 #import "DKObjectPathNode.h"
 #import "DKOutgoingProxy.h"
 #import "DKArgument.h"
@@ -67,7 +69,9 @@ NSString *kDKArgumentDirectionOut = @"out";
 
 
 /*
- * Macros to call D-Bus function and check whether they returned OOM:
+ * Macros to call D-Bus function and check whether they returned OOM. They are
+ * used by the error returning marshalling methods and expect
+ * <var>error</var> to be in scope.
  */
 
 #define DK_MARSHALLING_RAISE_OOM [NSException raise: @"DKArgumentMarshallingException"\
@@ -76,24 +80,77 @@ NSString *kDKArgumentDirectionOut = @"out";
 #define DK_ITER_APPEND(iter, type, addr) do {\
   if (NO == (BOOL)dbus_message_iter_append_basic(iter, type, (void*)addr))\
   {\
-    DK_MARSHALLING_RAISE_OOM; \
+    return DKMarshallingFailed(error, DKMarshallingOutOfMemory, self, nil);\
   }\
 }  while (0)
 
 #define DK_ITER_OPEN_CONTAINER(iter, type, sig, subIter) do {\
   if (NO == (BOOL)dbus_message_iter_open_container(iter, type, sig, subIter))\
   {\
-    DK_MARSHALLING_RAISE_OOM; \
+    return DKMarshallingFailed(error, DKMarshallingOutOfMemory, self, nil);\
   }\
 } while (0)
 
 #define DK_ITER_CLOSE_CONTAINER(iter, subIter) do {\
   if (NO == (BOOL)dbus_message_iter_close_container(iter, subIter))\
   {\
-    DK_MARSHALLING_RAISE_OOM; \
+    return DKMarshallingFailed(error, DKMarshallingOutOfMemory, self, nil);\
   }\
 } while (0)
 
+/*
+ * Records the first failure in <var>error</var>. Always returns NO so that it
+ * can be used in return statements.
+ */
+static inline BOOL
+DKMarshallingFailed(DKMarshallingError *error, DKMarshallingStatus status,
+  id argument, id object)
+{
+  if (DKMarshallingSuccess == error->status)
+  {
+    error->status = status;
+    error->argument = argument;
+    error->object = object;
+  }
+  return NO;
+}
+
+/*
+ * Converts a failure reported by the marshalling routines into the exception
+ * that the public marshalling methods raise.
+ */
+static void
+DKRaiseMarshallingError(DKMarshallingError *error)
+{
+  switch (error->status)
+  {
+    case DKMarshallingSuccess:
+      return;
+    case DKMarshallingOutOfMemory:
+      DK_MARSHALLING_RAISE_OOM;
+      break;
+    case DKMarshallingUnboxingFailure:
+      [NSException raise: @"DKArgumentUnboxingException"
+                  format: @"Could not unbox object '%@' into D-Bus format",
+        error->object];
+      break;
+    case DKMarshallingInvalidObject:
+      [NSException raise: NSInternalInconsistencyException
+                  format: @"Cannot marshall object '%@' as D-Bus type '%@'.",
+        error->object, [error->argument DBusTypeSignature]];
+      break;
+    case DKMarshallingTypeMismatch:
+      [NSException raise: NSInternalInconsistencyException
+                  format: @"Type mismatch between D-Bus message and introspection data. Expected '%@'.",
+        [error->argument DBusTypeSignature]];
+      break;
+    case DKMarshallingMistypedIterator:
+      [NSException raise: @"DKInternalInconsistencyException"
+                  format: @"Mistyped array iterator"];
+      break;
+  }
+}
+
 
 /*
  * Private Container argument subclasses:
@@ -162,19 +219,21 @@ NSString *kDKArgumentDirectionOut = @"out";
 
 /**
  * Unmarshalls one key and value from <var>iter</var> and places them at the
- * addresses specified.
+ * addresses specified. Returns NO and fills in <var>error</var> on failure.
  */
-- (void) unmarshallFromIterator: (DBusMessageIter*)iter
+- (BOOL) unmarshallFromIterator: (DBusMessageIter*)iter
                           value: (id*)value
-                            key: (id*)key;
+                            key: (id*)key
+                          error: (DKMarshallingError*)error;
 
 /**
  * Marshalls <var>key</var> and <var>object</var> and appends them to
- * <var>iter</var>.
+ * <var>iter</var>. Returns NO and fills in <var>error</var> on failure.
  */
-- (void) marshallObject: (id)object
+- (BOOL) marshallObject: (id)object
                  forKey: (id)key
-           intoIterator: (DBusMessageIter*)iter;
+           intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error;
 @end
 
 
@@ -362,6 +421,16 @@ DKDBusTypeForUnboxingObject(id object)
  */
 @implementation DKArgument
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationArgument);
+  }
+  return obj;
+}
+
 + (void) initialize
 {
   if ([DKArgument class] != self)
@@ -1031,15 +1100,28 @@ DKDBusTypeForUnboxingObject(id object)
       /*
        * To handle object-paths, we follow the argument/method tree back to the
        * proxy where it was created and create a new proxy with the proper
-       * settings.
+       * settings. Unless a custom class was requested, we return a
+       * lightweight DKLazyProxy that only becomes a full proxy once it is
+       * messaged. Object path arrays can be very large and most of their
+       * elements are usually never used.
        */
       DKProxy *ancestor = [self proxyParent];
       NSString *service = [ancestor _service];
       DKEndpoint *endpoint = [ancestor _endpoint];
       NSString *path = [[NSString alloc] initWithUTF8String: *(char**)buffer];
-      DKProxy *newProxy = [[[objCEquivalent alloc] initWithEndpoint: endpoint
-	                                               andService: service
-	                                                  andPath: path] autorelease];
+      id newProxy = nil;
+      if ([DKProxy class] == objCEquivalent)
+      {
+        newProxy = [[[DKLazyProxy alloc] initWithEndpoint: endpoint
+                                                  service: service
+                                                     path: path] autorelease];
+      }
+      else
+      {
+        newProxy = [[[objCEquivalent alloc] initWithEndpoint: endpoint
+                                                  andService: service
+                                                     andPath: path] autorelease];
+      }
       [path release];
       return newProxy;
     }
@@ -1132,15 +1214,29 @@ DKDBusTypeForUnboxingObject(id object)
 
 
 -(id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+{
+  DKMarshallingError error = {DKMarshallingSuccess, nil, nil};
+  id value = [self unmarshalledObjectFromIterator: iter
+                                            error: &error];
+  if (DKMarshallingSuccess != error.status)
+  {
+    DKRaiseMarshallingError(&error);
+  }
+  return value;
+}
+
+-(id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                               error: (DKMarshallingError*)error
 {
   // All basic types are guaranteed to fit into 64bit.
   uint64_t buffer = 0;
-  int iterType = dbus_message_iter_get_arg_type(iter);
 
-  // Check that the method contains the expected type.
-  NSAssert3((iterType == DBusType),
-    @"Type mismatch between D-Bus message and introspection data. Got '%d', expected '%d' in method %@." ,
-      iterType, DBusType, [parent name]);
+  // Check that the message contains the expected type.
+  if (dbus_message_iter_get_arg_type(iter) != DBusType)
+  {
+    DKMarshallingFailed(error, DKMarshallingTypeMismatch, self, nil);
+    return nil;
+  }
 
   dbus_message_iter_get_basic(iter, (void*)&buffer);
 
@@ -1239,22 +1335,43 @@ DKDBusTypeForUnboxingObject(id object)
            fromType: invType
              toType: expectedType];
 
-  DK_ITER_APPEND(iter, DBusType, &buffer);
+  if (NO == (BOOL)dbus_message_iter_append_basic(iter, DBusType, (void*)&buffer))
+  {
+    DK_MARSHALLING_RAISE_OOM;
+  }
 }
 
 - (void) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter
+{
+  DKMarshallingError error = {DKMarshallingSuccess, nil, nil};
+  if (NO == [self marshallObject: object
+                    intoIterator: iter
+                           error: &error])
+  {
+    DKRaiseMarshallingError(&error);
+  }
+}
+
+- (BOOL) marshallObject: (id)object
+           intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   long long int buffer = 0;
   if (NO == [self unboxValue: object intoBuffer: &buffer])
   {
-    [NSException raise: @"DKArgumentUnboxingException"
-                format: @"Could not unbox object '%@' into D-Bus format",
-      object];
+    return DKMarshallingFailed(error, DKMarshallingUnboxingFailure, self,
+      object);
   }
   DK_ITER_APPEND(iter, DBusType, &buffer);
+  return YES;
 }
 
+- (void)dealloc
+{
+  DKCountDeallocation(DKAllocationArgument);
+  [super dealloc];
+}
 @end
 
 
@@ -1504,6 +1621,7 @@ DKDBusTypeForUnboxingObject(id object)
 }
 
 -(id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                               error: (DKMarshallingError*)error
 {
   /*
    * For the general case, we cannot determine how to unmarshall the argument.
@@ -1536,10 +1654,12 @@ DKDBusTypeForUnboxingObject(id object)
           intoIterator: iter];
 }
 
-- (void) marshallObject: (id)object
+- (BOOL) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   [self subclassResponsibility: _cmd];
+  return NO;
 }
 
 - (void) dealloc
@@ -1614,20 +1734,21 @@ DKDBusTypeForUnboxingObject(id object)
 /**
  * Helper method to make sure that the iterator is a usable state.
  */
-- (void) assertSaneIterator: (DBusMessageIter*)iter
+- (BOOL) checkIterator: (DBusMessageIter*)iter
+                 error: (DKMarshallingError*)error
 {
-  int childType = DBUS_TYPE_INVALID;
-  // Make sure we are deserializing an array:
-  NSAssert((DBUS_TYPE_ARRAY == dbus_message_iter_get_arg_type(iter)),
-    @"Non array type when unmarshalling array from message.");
-  childType = dbus_message_iter_get_element_type(iter);
-
-  // Make sure we have the expected element type.
-  NSAssert((childType == [[self elementTypeArgument] DBusType]),
-    @"Type mismatch between D-Bus message and introspection data.");
+  // Make sure we are deserializing an array with the expected element type:
+  if ((DBUS_TYPE_ARRAY != dbus_message_iter_get_arg_type(iter))
+    || (dbus_message_iter_get_element_type(iter)
+      != [[self elementTypeArgument] DBusType]))
+  {
+    return DKMarshallingFailed(error, DKMarshallingTypeMismatch, self, nil);
+  }
+  return YES;
 }
 
 - (NSData*)dataFromSubIter: (DBusMessageIter*)iter
+                     error: (DKMarshallingError*)error
 {
   uint8_t bytes[128];
   NSMutableData *data = [NSMutableData new];
@@ -1645,8 +1766,8 @@ DKDBusTypeForUnboxingObject(id object)
       //Very bad, should never happen, but it would trash the stack
       // if it did, so we protect against it.
       [data release];
-      [NSException raise: @"DKInternalInconsistencyException"
-                  format: @"Mistyped array iterator"];
+      DKMarshallingFailed(error, DKMarshallingMistypedIterator, self, nil);
+      return nil;
     }
     NSUInteger offset = idx++ % 128;
     dbus_message_iter_get_basic(iter, (void*)(&bytes[0] + offset));
@@ -1670,30 +1791,36 @@ DKDBusTypeForUnboxingObject(id object)
 }
 
 -(id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                               error: (DKMarshallingError*)error
 {
   DKArgument *theChild = [self elementTypeArgument];
   DBusMessageIter subIter;
-  NSString *className = [self annotationValueForKey: @"org.gnustep.objc.class"];
-  BOOL returnAsNSData = NO;
-  // Check whether we are decoding a byte array that has been anotated as being
-  // an NSData instance
-  if ((DBUS_TYPE_BYTE == [theChild DBusType]) &&
-    ([NSClassFromString(className) isSubclassOfClass: [NSData class]]))
-   {
-     returnAsNSData = YES;
-   }
-  NSMutableArray *theArray = (returnAsNSData) ? nil : [NSMutableArray new];
+  NSString *className = nil;
+  NSMutableArray *theArray = nil;
   NSArray *returnArray = nil;
   NSNull *theNull = [NSNull null];
 
-  [self assertSaneIterator: iter];
+  if (NO == [self checkIterator: iter
+                          error: error])
+  {
+    return nil;
+  }
 
   dbus_message_iter_recurse(iter, &subIter);
-  if (returnAsNSData)
+
+  // Check whether we are decoding a byte array that has been anotated as being
+  // an NSData instance
+  if (DBUS_TYPE_BYTE == [theChild DBusType])
+  {
+    className = [self annotationValueForKey: @"org.gnustep.objc.class"];
+    if ([NSClassFromString(className) isSubclassOfClass: [NSData class]])
     {
-      return [self dataFromSubIter: &subIter];
+      return [self dataFromSubIter: &subIter
+                             error: error];
     }
+  }
 
+  theArray = [NSMutableArray new];
   do
   {
     id obj = nil;
@@ -1702,7 +1829,13 @@ DKDBusTypeForUnboxingObject(id object)
       // If we opened an empty iterator, we just break from the loop
       break;
     }
-    obj = [theChild unmarshalledObjectFromIterator: &subIter];
+    obj = [theChild unmarshalledObjectFromIterator: &subIter
+                                             error: error];
+    if (DKMarshallingSuccess != error->status)
+    {
+      [theArray release];
+      return nil;
+    }
     if (nil == obj)
     {
       obj = theNull;
@@ -1715,66 +1848,64 @@ DKDBusTypeForUnboxingObject(id object)
   return returnArray;
 }
 
-- (void) marshallObject: (id)object
+- (BOOL) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   DBusMessageIter subIter;
   DKArgument *theChild = [self elementTypeArgument];
   NSEnumerator *elementEnum = nil;
   id element = nil;
+  BOOL isData = NO;
   if (nil == object)
   {
     object = [NSArray array];
   }
-  if (DBUS_TYPE_BYTE != [theChild DBusType])
+  if (NO == [object respondsToSelector: @selector(objectEnumerator)])
+  {
+    isData = ((DBUS_TYPE_BYTE == [theChild DBusType])
+      && [object isKindOfClass: [NSData class]]);
+    if (NO == isData)
     {
-      NSAssert1([object respondsToSelector: @selector(objectEnumerator)],
-        @"Cannot enumerate contents of %@ when creating D-Bus array.",
+      return DKMarshallingFailed(error, DKMarshallingInvalidObject, self,
         object);
     }
-  else
-   {
-     NSAssert1(([object respondsToSelector: @selector(objectEnumerator)] ||
-       [object isKindOfClass: [NSData class]]),
-       @"Cannot enumerate contents of %@ when creating D-Bus array.",
-       object
-     );
-   }
-
+  }
 
   DK_ITER_OPEN_CONTAINER(iter, DBUS_TYPE_ARRAY, [[theChild DBusTypeSignature] UTF8String], &subIter);
-  NS_DURING
+  if (NO == isData)
+  {
+    elementEnum = [object objectEnumerator];
+    while (nil != (element = [elementEnum nextObject]))
     {
-      if ([object respondsToSelector: @selector(objectEnumerator)])
-	{
-	  elementEnum = [object objectEnumerator];
-	  while (nil != (element = [elementEnum nextObject]))
-	    {
-	      [theChild marshallObject: element
-			  intoIterator: &subIter];
-
-	    }
-	}
-    else if ([object isKindOfClass: [NSData class]])
+      if (NO == [theChild marshallObject: element
+                            intoIterator: &subIter
+                                   error: error])
       {
-	NSUInteger len = [object length];
-	const void *bytes = [object bytes];
-	NSUInteger pos = 0;
-	for (pos = 0; pos < len; pos++)
-	  {
-	     DK_ITER_APPEND(&subIter, DBUS_TYPE_BYTE, bytes++);
-	  }
+        // We are already screwed and don't care whether
+        // dbus_message_iter_close_container() returns OOM.
+        dbus_message_iter_close_container(iter, &subIter);
+        return NO;
       }
     }
-  NS_HANDLER
+  }
+  else
+  {
+    NSUInteger len = [object length];
+    const uint8_t *bytes = [object bytes];
+    NSUInteger pos = 0;
+    for (pos = 0; pos < len; pos++)
     {
-      // We are already screwed and don't care whether
-      // dbus_message_iter_close_container() returns OOM.
-      dbus_message_iter_close_container(iter, &subIter);
-      [localException raise];
+      if (NO == (BOOL)dbus_message_iter_append_basic(&subIter,
+        DBUS_TYPE_BYTE, (void*)(bytes + pos)))
+      {
+        dbus_message_iter_close_container(iter, &subIter);
+        return DKMarshallingFailed(error, DKMarshallingOutOfMemory, self, nil);
+      }
     }
-  NS_ENDHANDLER
+  }
   DK_ITER_CLOSE_CONTAINER(iter, &subIter);
+  return YES;
 }
 @end
 
@@ -1809,24 +1940,38 @@ DKDBusTypeForUnboxingObject(id object)
   return YES;
 }
 
-- (void) assertSaneIterator: (DBusMessageIter*)iter
+- (BOOL) checkIterator: (DBusMessageIter*)iter
+                 error: (DKMarshallingError*)error
 {
-  [super assertSaneIterator: iter];
-  NSAssert((DBUS_TYPE_DICT_ENTRY == dbus_message_iter_get_element_type(iter)),
-    @"Non dict-entry type in iterator when unmarshalling a dictionary.");
+  if (NO == [super checkIterator: iter
+                           error: error])
+  {
+    return NO;
+  }
+  if (DBUS_TYPE_DICT_ENTRY != dbus_message_iter_get_element_type(iter))
+  {
+    return DKMarshallingFailed(error, DKMarshallingTypeMismatch, self, nil);
+  }
+  return YES;
 }
 
 -(id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                               error: (DKMarshallingError*)error
 {
   DKDictEntryTypeArgument *theChild = (DKDictEntryTypeArgument*)[self elementTypeArgument];
   DBusMessageIter subIter;
-  NSMutableDictionary *theDictionary = [NSMutableDictionary new];
+  NSMutableDictionary *theDictionary = nil;
   NSDictionary *returnDictionary = nil;
   NSNull *theNull = [NSNull null];
 
-  [self assertSaneIterator: iter];
+  if (NO == [self checkIterator: iter
+                          error: error])
+  {
+    return nil;
+  }
 
   // We loop over the dict entries:
+  theDictionary = [NSMutableDictionary new];
   dbus_message_iter_recurse(iter, &subIter);
   do
   {
@@ -1837,9 +1982,14 @@ DKDBusTypeForUnboxingObject(id object)
       // If we opened an empty iterator, break the loop.
       break;
     }
-    [theChild unmarshallFromIterator: &subIter
-                               value: &value
-                                 key: &key];
+    if (NO == [theChild unmarshallFromIterator: &subIter
+                                         value: &value
+                                           key: &key
+                                         error: error])
+    {
+      [theDictionary release];
+      return nil;
+    }
     if (key == nil)
     {
       key = theNull;
@@ -1873,8 +2023,9 @@ DKDBusTypeForUnboxingObject(id object)
   return returnDictionary;
 }
 
-- (void) marshallObject: (id)object
+- (BOOL) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   NSArray *keys = nil;
   NSEnumerator *keyEnum = nil;
@@ -1887,54 +2038,64 @@ DKDBusTypeForUnboxingObject(id object)
     object = [NSDictionary dictionary];
   }
 
-  NSAssert1(([object respondsToSelector: @selector(allKeys)]
-    && [object respondsToSelector: @selector(objectForKey:)]),
-    @"Cannot marshall non key/value dictionary '%@' to D-Bus iterator.",
-    object);
+  if (NO == ([object respondsToSelector: @selector(allKeys)]
+    && [object respondsToSelector: @selector(objectForKey:)]))
+  {
+    return DKMarshallingFailed(error, DKMarshallingInvalidObject, self,
+      object);
+  }
 
   DK_ITER_OPEN_CONTAINER(iter, DBUS_TYPE_ARRAY, [[pairArgument DBusTypeSignature] UTF8String], &subIter);
 
   keys = [object allKeys];
   keyEnum = [keys objectEnumerator];
 
-  NS_DURING
+  while (nil != (element = [keyEnum nextObject]))
   {
-    while (nil != (element = [keyEnum nextObject]))
+    if (NO == [pairArgument marshallObject: [object objectForKey: element]
+                                    forKey: element
+                              intoIterator: &subIter
+                                     error: error])
     {
-      [pairArgument marshallObject: [object objectForKey: element]
-                            forKey: element
-		      intoIterator: &subIter];
+      // Something already went wrong and we don't care for a potential OOM
+      // error from dbus_message_iter_close_container();
+      dbus_message_iter_close_container(iter, &subIter);
+      return NO;
     }
   }
-  NS_HANDLER
-  {
-    // Something already went wrong and we don't care for a potential OOM error
-    // from dbus_message_iter_close_container();
-    dbus_message_iter_close_container(iter, &subIter);
-    [localException raise];
-  }
-  NS_ENDHANDLER
 
   DK_ITER_CLOSE_CONTAINER(iter, &subIter);
+  return YES;
 }
 @end
 
 @implementation DKStructTypeArgument
 -(id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                               error: (DKMarshallingError*)error
 {
-  DKMutableStructArray *theArray = [DKMutableStructArray new];
+  DKMutableStructArray *theArray = nil;
   NSArray *returnArray = nil;
   NSNull *theNull = [NSNull null];
   NSUInteger index = 0;
   NSUInteger count = [children count];
   DBusMessageIter subIter;
-  NSAssert((DBUS_TYPE_STRUCT == dbus_message_iter_get_arg_type(iter)),
-    @"Type mismatch between introspection data and D-Bus message.");
+  if (DBUS_TYPE_STRUCT != dbus_message_iter_get_arg_type(iter))
+  {
+    DKMarshallingFailed(error, DKMarshallingTypeMismatch, self, nil);
+    return nil;
+  }
 
+  theArray = [DKMutableStructArray new];
   dbus_message_iter_recurse(iter,&subIter);
   do
   {
-    id obj = [[children objectAtIndex: index] unmarshalledObjectFromIterator: &subIter];
+    id obj = [[children objectAtIndex: index] unmarshalledObjectFromIterator: &subIter
+                                                                       error: error];
+    if (DKMarshallingSuccess != error->status)
+    {
+      [theArray release];
+      return nil;
+    }
     if (nil == obj)
     {
       obj = theNull;
@@ -1947,8 +2108,9 @@ DKDBusTypeForUnboxingObject(id object)
   return returnArray;
 }
 
-- (void) marshallObject: (id)object
+- (BOOL) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   DBusMessageIter subIter;
   NSEnumerator *structEnum = nil;
@@ -1957,44 +2119,38 @@ DKDBusTypeForUnboxingObject(id object)
 
   if (nil != object)
   {
-    NSAssert1(([object respondsToSelector: @selector(count)]
-      && [object respondsToSelector: @selector(objectEnumerator)]),
-      @"Object '%@' cannot be marshalled as D-Bus struct.",
-      object);
-    NSAssert3(([object count] == childCount),
-      @"Could not marshall object '%@' as D-Bus struct: Expected %"PRIuPTR""
-      @" members, got %"PRIuPTR".",
-      object,
-      (unsigned long) [object count],
-      (unsigned long) childCount);
+    // The object needs to be a collection with one member per struct field:
+    if (NO == ([object respondsToSelector: @selector(count)]
+      && [object respondsToSelector: @selector(objectEnumerator)]
+      && ([object count] == childCount)))
+    {
+      return DKMarshallingFailed(error, DKMarshallingInvalidObject, self,
+        object);
+    }
   }
 
   DK_ITER_OPEN_CONTAINER(iter, DBUS_TYPE_STRUCT, NULL, &subIter);
 
   if (nil != object)
   {
+    NSUInteger index = 0;
+    id member = nil;
     structEnum = [object objectEnumerator];
-
-    NS_DURING
+    while ((nil != (member = [structEnum nextObject]))
+      && (index < childCount))
     {
-      NSUInteger index = 0;
-      id member = nil;
-      while ((nil != (member = [structEnum nextObject]))
-        && (index < childCount))
+      if (NO == [[children objectAtIndex: index] marshallObject: member
+                                                   intoIterator: &subIter
+                                                          error: error])
       {
-        [[children objectAtIndex: index] marshallObject: member
-                                           intoIterator: &subIter];
-      index++;
+        dbus_message_iter_close_container(iter, &subIter);
+        return NO;
       }
+      index++;
     }
-    NS_HANDLER
-    {
-      dbus_message_iter_close_container(iter, &subIter);
-      [localException raise];
-    }
-    NS_ENDHANDLER
   }
   DK_ITER_CLOSE_CONTAINER(iter, &subIter);
+  return YES;
 }
 @end
 
@@ -2183,48 +2339,54 @@ static Class NSCFBooleanClass;
 }
 
 - (id) unmarshalledObjectFromIterator: (DBusMessageIter*)iter
+                                error: (DKMarshallingError*)error
 {
   char *theSig = NULL;
   DBusMessageIter subIter;
   DKArgument *theArgument = nil;
   id theValue = nil;
-  NSAssert((DBUS_TYPE_VARIANT == dbus_message_iter_get_arg_type(iter)),
-    @"Type mismatch between introspection data and D-Bus message.");
+  if (DBUS_TYPE_VARIANT != dbus_message_iter_get_arg_type(iter))
+  {
+    DKMarshallingFailed(error, DKMarshallingTypeMismatch, self, nil);
+    return nil;
+  }
 
   dbus_message_iter_recurse(iter,&subIter);
   theSig = dbus_message_iter_get_signature(&subIter);
   theArgument = [[DKArgument alloc] initWithDBusSignature: theSig
                                                      name: nil
                                                    parent: self];
-  NS_DURING
+  /*
+   * The value is autoreleased, so it survives releasing the argument. If
+   * unmarshalling fails, the error refers to the argument, which is why it is
+   * autoreleased as well in that case.
+   */
+  theValue = [theArgument unmarshalledObjectFromIterator: &subIter
+                                                   error: error];
+  if (DKMarshallingSuccess != error->status)
   {
-    theValue = [theArgument unmarshalledObjectFromIterator: &subIter];
+    [theArgument autorelease];
   }
-  NS_HANDLER
+  else
   {
     [theArgument release];
-    dbus_free(theSig);
-    [localException raise];
   }
-  NS_ENDHANDLER
-
-  [theArgument release];
   dbus_free(theSig);
 
   return theValue;
 }
 
-- (void) marshallObject: (id)object
+- (BOOL) marshallObject: (id)object
            intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   DKArgument *subArg = [self DKArgumentWithObject: object];
   DBusMessageIter subIter;
 
-  if (nil != object)
+  if ((nil != object) && (nil == subArg))
   {
-    NSAssert1(subArg,
-      @"Could not marshall object %@ as D-Bus variant type",
-      subArg);
+    return DKMarshallingFailed(error, DKMarshallingInvalidObject, self,
+      object);
   }
 
   DK_ITER_OPEN_CONTAINER(iter, DBUS_TYPE_VARIANT, [[subArg DBusTypeSignature] UTF8String], &subIter);
@@ -2232,19 +2394,16 @@ static Class NSCFBooleanClass;
 
   if (nil != object)
   {
-    NS_DURING
-    {
-      [subArg marshallObject: object
-                intoIterator: &subIter];
-    }
-    NS_HANDLER
+    if (NO == [subArg marshallObject: object
+                        intoIterator: &subIter
+                               error: error])
     {
       dbus_message_iter_close_container(iter, &subIter);
-      [localException raise];
+      return NO;
     }
-    NS_ENDHANDLER
   }
   DK_ITER_CLOSE_CONTAINER(iter, &subIter);
+  return YES;
 }
 @end
 
@@ -2292,52 +2451,59 @@ static Class NSCFBooleanClass;
   return [children objectAtIndex: 1];
 }
 
-- (void) unmarshallFromIterator: (DBusMessageIter*)iter
+- (BOOL) unmarshallFromIterator: (DBusMessageIter*)iter
                           value: (id*)value
                             key: (id*)key
+                          error: (DKMarshallingError*)error
 {
   DBusMessageIter subIter;
-  NSAssert((DBUS_TYPE_DICT_ENTRY == dbus_message_iter_get_arg_type(iter)),
-    @"Type mismatch between introspection data and D-Bus message.");
+  *key = nil;
+  *value = nil;
+  if (DBUS_TYPE_DICT_ENTRY != dbus_message_iter_get_arg_type(iter))
+  {
+    return DKMarshallingFailed(error, DKMarshallingTypeMismatch, self, nil);
+  }
 
   dbus_message_iter_recurse(iter, &subIter);
 
-  *key = [[self keyArgument]  unmarshalledObjectFromIterator: &subIter];
-
-  if (dbus_message_iter_next(&subIter))
+  *key = [[self keyArgument] unmarshalledObjectFromIterator: &subIter
+                                                      error: error];
+  if (DKMarshallingSuccess != error->status)
   {
-    *value = [[self valueArgument] unmarshalledObjectFromIterator: &subIter];
+    return NO;
   }
-  else
+
+  if (dbus_message_iter_next(&subIter))
   {
-    *value = nil;
+    *value = [[self valueArgument] unmarshalledObjectFromIterator: &subIter
+                                                            error: error];
   }
-  return;
+  return (DKMarshallingSuccess == error->status);
 }
-- (void) marshallObject: (id)object
+
+- (BOOL) marshallObject: (id)object
                  forKey: (id)key
            intoIterator: (DBusMessageIter*)iter
+                  error: (DKMarshallingError*)error
 {
   DBusMessageIter subIter;
   DK_ITER_OPEN_CONTAINER(iter, DBUS_TYPE_DICT_ENTRY, NULL, &subIter);
 
   if ((nil != key) && (nil != object))
   {
-    NS_DURING
-    {
-      [[self keyArgument] marshallObject: key
-                            intoIterator: &subIter];
-      [[self valueArgument] marshallObject: object
-                              intoIterator: &subIter];
-    }
-    NS_HANDLER
+    if ((NO == [[self keyArgument] marshallObject: key
+                                     intoIterator: &subIter
+                                            error: error])
+      || (NO == [[self valueArgument] marshallObject: object
+                                        intoIterator: &subIter
+                                               error: error]))
     {
       // Again, we don't care for OOM here because we already failed.
       dbus_message_iter_close_container(iter, &subIter);
-      [localException raise];
+      return NO;
     }
-    NS_ENDHANDLER
   }
   DK_ITER_CLOSE_CONTAINER(iter, &subIter);
+  return YES;
 }
 @end
@@ -0,0 +1,563 @@
+/** Implementation of DKChannel to stream typed records over a file descriptor.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import "DBusKit/DKChannel.h"
+#import "DKArgument.h"
+
+#import <Foundation/NSArray.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSException.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSString.h>
+
+#ifndef DARLING
+#import <GNUstepBase/NSDebug+GNUstepBase.h>
+#else
+#import "config.h"
+#endif
+
+#include <dbus/dbus.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define DKChannelDefaultBatchSize 256
+#define DKChannelDefaultHighWaterMark (1024 * 1024)
+#define DKChannelReadSize 65536
+
+/*
+ * Every batch is a signal message with constant header fields, so that the
+ * stream consists of well-formed D-Bus messages.
+ */
+#define DKChannelPath "/org/gnustep/dbuskit/Channel"
+#define DKChannelInterface "org.gnustep.dbuskit.Channel"
+#define DKChannelMember "Batch"
+
+@interface DKChannel (Private)
+- (BOOL)_setRecordSignature: (NSString*)signature;
+- (BOOL)_encodePendingRecords;
+- (BOOL)_validateRecord: (NSArray*)record;
+- (BOOL)_drainOutBuffer;
+- (NSUInteger)_nextBatchLength;
+- (void)_consumeBatchOfLength: (NSUInteger)length;
+@end
+
+@implementation DKChannel
+
++ (id)channelWithRecordSignature: (NSString*)signature
+                    remoteHandle: (NSFileHandle**)handle
+{
+  int fds[2];
+  DKChannel *channel = nil;
+  if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+  {
+    NSWarnMLog(@"Could not create socket pair: %s", strerror(errno));
+    return nil;
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  channel = [[[self alloc] initWithFileDescriptor: fds[0]
+                                  recordSignature: signature] autorelease];
+  if (nil == channel)
+  {
+    close(fds[1]);
+    return nil;
+  }
+  if (NULL != handle)
+  {
+    *handle = [[[NSFileHandle alloc] initWithFileDescriptor: fds[1]
+                                             closeOnDealloc: YES] autorelease];
+  }
+  else
+  {
+    close(fds[1]);
+  }
+  return channel;
+}
+
+- (id)initWithFileHandle: (NSFileHandle*)handle
+         recordSignature: (NSString*)signature
+{
+  int descriptor = -1;
+  if (nil != handle)
+  {
+    descriptor = dup([handle fileDescriptor]);
+  }
+  if (descriptor < 0)
+  {
+    fd = -1;
+    [self release];
+    return nil;
+  }
+  fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+  return [self initWithFileDescriptor: descriptor
+                      recordSignature: signature];
+}
+
+- (id)initWithFileDescriptor: (int)descriptor
+             recordSignature: (NSString*)signature
+{
+  if (nil == (self = [super init]))
+  {
+    close(descriptor);
+    return nil;
+  }
+  fd = descriptor;
+  if ((nil != signature) && (NO == [self _setRecordSignature: signature]))
+  {
+    [self release];
+    return nil;
+  }
+  batchSize = DKChannelDefaultBatchSize;
+  highWaterMark = DKChannelDefaultHighWaterMark;
+  isBlocking = YES;
+  pendingRecords = [NSMutableArray new];
+  outBuffer = [NSMutableData new];
+  inBuffer = [NSMutableData new];
+  return self;
+}
+
+/**
+ * Sets up the argument used to marshall batches of records with the given
+ * signature.
+ */
+- (BOOL)_setRecordSignature: (NSString*)signature
+{
+  NSString *theBatchSignature = [NSString stringWithFormat: @"a(%@)", signature];
+  if (NO == (BOOL)dbus_signature_validate([signature UTF8String], NULL))
+  {
+    NSWarnMLog(@"Invalid record signature '%@'", signature);
+    return NO;
+  }
+  batchArgument = [[DKArgument alloc] initWithDBusSignature: [theBatchSignature UTF8String]
+                                                       name: nil
+                                                     parent: nil];
+  if (nil == batchArgument)
+  {
+    return NO;
+  }
+  // The element argument of the batch describes a single record:
+  ASSIGN(recordArgument, [[batchArgument children] objectAtIndex: 0]);
+  ASSIGN(recordSignature, signature);
+  ASSIGN(batchSignature, theBatchSignature);
+  return YES;
+}
+
+- (NSString*)recordSignature
+{
+  return recordSignature;
+}
+
+- (int)fileDescriptor
+{
+  return fd;
+}
+
+- (void)setBatchSize: (NSUInteger)count
+{
+  batchSize = MAX(count, 1);
+}
+
+- (void)setHighWaterMark: (NSUInteger)bytes
+{
+  highWaterMark = bytes;
+}
+
+- (void)setBlocking: (BOOL)flag
+{
+  int flags = 0;
+  if (fd < 0)
+  {
+    return;
+  }
+  flags = fcntl(fd, F_GETFL);
+  if (flag)
+  {
+    flags &= ~O_NONBLOCK;
+  }
+  else
+  {
+    flags |= O_NONBLOCK;
+  }
+  fcntl(fd, F_SETFL, flags);
+  isBlocking = flag;
+}
+
+/**
+ * Marshalls the queued records into a batch message and appends it to the
+ * output buffer.
+ */
+- (BOOL)_encodePendingRecords
+{
+  DBusMessage *batch = NULL;
+  DBusMessageIter iter;
+  char *buffer = NULL;
+  int length = 0;
+  if (0 == [pendingRecords count])
+  {
+    return YES;
+  }
+  batch = dbus_message_new_signal(DKChannelPath,
+    DKChannelInterface,
+    DKChannelMember);
+  if (NULL == batch)
+  {
+    return NO;
+  }
+  dbus_message_iter_init_append(batch, &iter);
+  NS_DURING
+  {
+    [batchArgument marshallObject: pendingRecords
+                     intoIterator: &iter];
+  }
+  NS_HANDLER
+  {
+    /*
+     * The records have been checked by -writeRecord:, so this should not
+     * happen. We keep them, since they have already been accepted.
+     */
+    dbus_message_unref(batch);
+    [localException raise];
+  }
+  NS_ENDHANDLER
+  [pendingRecords removeAllObjects];
+  if (NO == (BOOL)dbus_message_marshal(batch, &buffer, &length))
+  {
+    dbus_message_unref(batch);
+    return NO;
+  }
+  [outBuffer appendBytes: buffer
+                  length: (NSUInteger)length];
+  dbus_free(buffer);
+  dbus_message_unref(batch);
+  return YES;
+}
+
+/**
+ * Writes as much of the output buffer as possible. Returns YES if the buffer
+ * has been written completely.
+ */
+- (BOOL)_drainOutBuffer
+{
+  const char *bytes = [outBuffer bytes];
+  NSUInteger length = [outBuffer length];
+  while ((fd >= 0) && (outOffset < length))
+  {
+    // Avoid SIGPIPE if the peer has gone away.
+    ssize_t written = send(fd, bytes + outOffset, length - outOffset,
+      MSG_NOSIGNAL);
+    if ((written < 0) && (ENOTSOCK == errno))
+    {
+      written = write(fd, bytes + outOffset, length - outOffset);
+    }
+    if (written < 0)
+    {
+      if (EINTR == errno)
+      {
+        continue;
+      }
+      if ((EAGAIN != errno) && (EWOULDBLOCK != errno))
+      {
+        NSWarnMLog(@"Could not write to channel: %s", strerror(errno));
+      }
+      break;
+    }
+    outOffset += (NSUInteger)written;
+  }
+  if (outOffset == length)
+  {
+    [outBuffer setLength: 0];
+    outOffset = 0;
+    return YES;
+  }
+  // Compact the buffer once most of it has been written.
+  if (outOffset > (length / 2))
+  {
+    [outBuffer replaceBytesInRange: NSMakeRange(0, outOffset)
+                         withBytes: NULL
+                            length: 0];
+    outOffset = 0;
+  }
+  return NO;
+}
+
+- (NSUInteger)bufferedByteCount
+{
+  return [outBuffer length] - outOffset;
+}
+
+/**
+ * Checks that <var>record</var> matches the record signature by marshalling it
+ * into a scratch message, so that a bad record is refused before it is queued
+ * instead of failing the batch it ends up in. Raises if the record does not
+ * match.
+ */
+- (BOOL)_validateRecord: (NSArray*)record
+{
+  DBusMessage *scratch = dbus_message_new_signal(DKChannelPath,
+    DKChannelInterface,
+    DKChannelMember);
+  DBusMessageIter iter;
+  if (NULL == scratch)
+  {
+    return NO;
+  }
+  dbus_message_iter_init_append(scratch, &iter);
+  NS_DURING
+  {
+    [recordArgument marshallObject: record
+                      intoIterator: &iter];
+  }
+  NS_HANDLER
+  {
+    dbus_message_unref(scratch);
+    [localException raise];
+  }
+  NS_ENDHANDLER
+  dbus_message_unref(scratch);
+  return YES;
+}
+
+- (BOOL)writeRecord: (NSArray*)record
+{
+  if ((fd < 0) || (nil == batchArgument))
+  {
+    return NO;
+  }
+  if (NO == [self _validateRecord: record])
+  {
+    return NO;
+  }
+  if ((NO == isBlocking) && ([self bufferedByteCount] > highWaterMark))
+  {
+    // Give the peer a chance to catch up before refusing the record.
+    [self _drainOutBuffer];
+    if ([self bufferedByteCount] > highWaterMark)
+    {
+      return NO;
+    }
+  }
+  [pendingRecords addObject: record];
+  if ([pendingRecords count] >= batchSize)
+  {
+    if (NO == [self _encodePendingRecords])
+    {
+      return NO;
+    }
+    if (([self _drainOutBuffer] == NO) && isBlocking)
+    {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+- (BOOL)flush
+{
+  if (fd < 0)
+  {
+    return NO;
+  }
+  if (NO == [self _encodePendingRecords])
+  {
+    return NO;
+  }
+  return [self _drainOutBuffer];
+}
+
+/**
+ * Returns the length of the complete batch at the start of the input buffer,
+ * reading from the file descriptor as needed, or 0 if there is none.
+ */
+- (NSUInteger)_nextBatchLength
+{
+  char chunk[DKChannelReadSize];
+  while (YES)
+  {
+    NSUInteger available = [inBuffer length];
+    if (available >= DBUS_MINIMUM_HEADER_SIZE)
+    {
+      int needed = dbus_message_demarshal_bytes_needed([inBuffer bytes],
+        (int)available);
+      if (needed < 0)
+      {
+        NSWarnMLog(@"Corrupt data on channel, closing it.");
+        atEOF = YES;
+        [inBuffer setLength: 0];
+        return 0;
+      }
+      if ((needed > 0) && ((NSUInteger)needed <= available))
+      {
+        return (NSUInteger)needed;
+      }
+    }
+    if ((fd < 0) || atEOF)
+    {
+      return 0;
+    }
+    else
+    {
+      ssize_t count = read(fd, chunk, sizeof(chunk));
+      if (count > 0)
+      {
+        [inBuffer appendBytes: chunk
+                       length: (NSUInteger)count];
+      }
+      else if (0 == count)
+      {
+        atEOF = YES;
+      }
+      else if (EINTR != errno)
+      {
+        if ((EAGAIN != errno) && (EWOULDBLOCK != errno))
+        {
+          atEOF = YES;
+        }
+        return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ * Removes the batch of the given length from the input buffer.
+ */
+- (void)_consumeBatchOfLength: (NSUInteger)length
+{
+  [inBuffer replaceBytesInRange: NSMakeRange(0, length)
+                      withBytes: NULL
+                         length: 0];
+}
+
+- (NSArray*)readRecord
+{
+  while ((nil == receivedRecords) || (receivedIndex >= [receivedRecords count]))
+  {
+    NSUInteger length = [self _nextBatchLength];
+    DBusMessage *batch = NULL;
+    DBusMessageIter iter;
+    DBusError err;
+    const char *signature = NULL;
+    if (0 == length)
+    {
+      return nil;
+    }
+    dbus_error_init(&err);
+    batch = dbus_message_demarshal([inBuffer bytes], (int)length, &err);
+    [self _consumeBatchOfLength: length];
+    if (NULL == batch)
+    {
+      NSWarnMLog(@"Invalid batch on channel: %s", err.message);
+      dbus_error_free(&err);
+      continue;
+    }
+    signature = dbus_message_get_signature(batch);
+    if (nil == batchArgument)
+    {
+      size_t sigLength = strlen(signature);
+      // Adopt the record signature from "a(...)".
+      if ((sigLength > 3) && (0 == strncmp(signature, "a(", 2)))
+      {
+        [self _setRecordSignature: [[[NSString alloc] initWithBytes: signature + 2
+                                                              length: sigLength - 3
+                                                            encoding: NSUTF8StringEncoding] autorelease]];
+      }
+    }
+    if ((nil == batchArgument)
+      || (NO == [batchSignature isEqualToString: [NSString stringWithUTF8String: signature]]))
+    {
+      NSWarnMLog(@"Ignoring batch with unexpected signature '%s'", signature);
+      dbus_message_unref(batch);
+      continue;
+    }
+    DESTROY(receivedRecords);
+    receivedIndex = 0;
+    if (dbus_message_iter_init(batch, &iter))
+    {
+      NS_DURING
+      {
+        receivedRecords = [[batchArgument unmarshalledObjectFromIterator: &iter] retain];
+      }
+      NS_HANDLER
+      {
+        NSWarnMLog(@"Could not decode batch: %@", localException);
+      }
+      NS_ENDHANDLER
+    }
+    dbus_message_unref(batch);
+  }
+  return [receivedRecords objectAtIndex: receivedIndex++];
+}
+
+- (NSData*)readBatchData
+{
+  NSUInteger length = [self _nextBatchLength];
+  NSData *data = nil;
+  if (0 == length)
+  {
+    return nil;
+  }
+  data = [inBuffer subdataWithRange: NSMakeRange(0, length)];
+  [self _consumeBatchOfLength: length];
+  return data;
+}
+
+- (BOOL)isAtEnd
+{
+  return (atEOF && (0 == [inBuffer length])
+    && ((nil == receivedRecords) || (receivedIndex >= [receivedRecords count])));
+}
+
+- (void)close
+{
+  if (fd < 0)
+  {
+    return;
+  }
+  NS_DURING
+  {
+    [self flush];
+  }
+  NS_HANDLER
+  {
+    NSWarnMLog(@"Could not flush channel: %@", localException);
+  }
+  NS_ENDHANDLER
+  close(fd);
+  fd = -1;
+}
+
+- (void)dealloc
+{
+  [self close];
+  [batchArgument release];
+  [recordArgument release];
+  [recordSignature release];
+  [batchSignature release];
+  [pendingRecords release];
+  [outBuffer release];
+  [inBuffer release];
+  [receivedRecords release];
+  [super dealloc];
+}
+@end
@@ -24,6 +24,7 @@
 #import <Foundation/NSException.h>
 #import "DBusKit/DKPort.h"
 #include <dbus/dbus.h>
+#include <stdint.h>
 #import "config.h"
 
 #if HAVE_FUNC_ATTRIBUTE_VISIBILITY
@@ -35,6 +36,23 @@
 @class DKRunLoopContext, NSRunLoop, NSString, NSDictionary;
 @protocol NSCoding;
 
+/**
+ * Snapshot of the traffic counters an endpoint maintains once statistics
+ * collection has been enabled. Sizes are in bytes of marshalled message data,
+ * <var>dispatchTime</var> is the accumulated time (in microseconds) the worker
+ * thread spent dispatching incoming messages.
+ */
+typedef struct
+{
+  uint64_t messagesSent;
+  uint64_t bytesSent;
+  uint64_t messagesReceived;
+  uint64_t bytesReceived;
+  uint64_t maxMessageSize;
+  uint64_t outgoingQueueSize;
+  uint64_t dispatchTime;
+} DKEndpointStatistics;
+
 /**
  * DKEndpoint is used internally to manage the low level details of a connection
  * to a D-Bus peer. This can be a well known bus as well as some special peer.
@@ -87,6 +105,101 @@
  */
 - (NSString*)runLoopMode;
 
+/**
+ * Enables or disables collection of traffic statistics for the endpoint.
+ * Collection is disabled by default because determining the size of a message
+ * requires libdbus to marshall it a second time.
+ */
+- (void)setCollectsStatistics: (BOOL)yesno;
+
+/**
+ * Returns whether the endpoint collects traffic statistics.
+ */
+- (BOOL)collectsStatistics;
+
+/**
+ * Returns the statistics collected so far. The outgoing queue size is always
+ * reported, even if statistics collection is disabled.
+ */
+- (DKEndpointStatistics)statistics;
+
+/**
+ * Resets all counters (but not the limits and thresholds) to zero.
+ */
+- (void)resetStatistics;
+
+/**
+ * Records that <var>message</var> has been handed to libdbus for sending. This
+ * is called by the message classes and should not be called otherwise.
+ */
+- (void)noteOutgoingMessage: (DBusMessage*)message;
+
+/**
+ * Starts recording all messages sent and received by the endpoint to the
+ * capture file at <var>path</var>, replacing any capture in progress. Returns
+ * NO if the file could not be created. See DKMessageCapture for the format.
+ */
+- (BOOL)startCapturingToFile: (NSString*)path;
+
+/**
+ * Stops recording messages and closes the capture file.
+ */
+- (void)stopCapturing;
+
+/**
+ * Records a reply to a pending call in the capture, if any. libdbus does not
+ * pass such replies through the connection filters.
+ */
+- (void)noteReply: (DBusMessage*)reply;
+
+/**
+ * Sets the maximum number of bytes libdbus will buffer from the peer before
+ * it stops reading from the connection.
+ */
+- (void)setMaximumReceivedSize: (NSUInteger)size;
+
+/**
+ * Returns the maximum number of bytes libdbus will buffer from the peer.
+ */
+- (NSUInteger)maximumReceivedSize;
+
+/**
+ * Sets the maximum size of a single message libdbus will accept from the peer.
+ * The connection will be dropped if the peer sends a larger message.
+ */
+- (void)setMaximumMessageSize: (NSUInteger)size;
+
+/**
+ * Returns the maximum size of a single message accepted from the peer.
+ */
+- (NSUInteger)maximumMessageSize;
+
+/**
+ * Sets the size of the outgoing queue above which a
+ * DKEndpointThresholdExceededNotification will be posted. The notification
+ * is posted once when the threshold is crossed and rearmed when the queue has
+ * drained below it. A value of zero disables the check. Setting a non-zero
+ * threshold enables statistics collection.
+ */
+- (void)setOutgoingQueueThreshold: (NSUInteger)size;
+
+/**
+ * Returns the threshold for the outgoing queue size.
+ */
+- (NSUInteger)outgoingQueueThreshold;
+
+/**
+ * Sets the size above which sending or receiving a message will cause a
+ * DKEndpointThresholdExceededNotification to be posted. A value of zero
+ * disables the check. Setting a non-zero threshold enables statistics
+ * collection.
+ */
+- (void)setMessageSizeThreshold: (NSUInteger)size;
+
+/**
+ * Returns the threshold for the size of individual messages.
+ */
+- (NSUInteger)messageSizeThreshold;
 @end
 
 /**
@@ -23,6 +23,7 @@
    */
 
 #import "DKEndpoint.h"
+#import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSCoder.h>
 #import <Foundation/NSDebug.h>
 #import <Foundation/NSDictionary.h>
@@ -30,8 +31,10 @@
 #import <Foundation/NSKeyedArchiver.h>
 #import <Foundation/NSLock.h>
 #import <Foundation/NSMapTable.h>
+#import <Foundation/NSNotification.h>
 #import <Foundation/NSRunLoop.h>
 #import <Foundation/NSString.h>
+#import <Foundation/NSThread.h>
 #import <Foundation/NSTimer.h>
 #import <Foundation/NSValue.h>
 #import <Foundation/NSPortCoder.h>
@@ -46,6 +49,15 @@
 
 #import "DBusKit/DKPort.h"
 #import "DKEndpointManager.h"
+#import "DKMessageCapture.h"
+#import "DKTrace.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+NSString *DKEndpointThresholdExceededNotification =
+  @"DKEndpointThresholdExceededNotification";
 
 /*
  * Integration functions:
@@ -93,6 +105,47 @@ DKUpdateDispatchStatus(DBusConnection *conn,
 static void
 DKRelease(void *ptr);
 
+/*
+ * Filter that accounts for incoming messages before they are handled.
+ */
+static DBusHandlerResult
+DKCountIncoming(DBusConnection *conn, DBusMessage *msg, void *data);
+
+/*
+ * The counters in DKEndpointStatistics. The outgoing queue size is not
+ * counted but obtained from libdbus when the statistics are requested.
+ */
+static const size_t DKStatisticsCounters[] = {
+  offsetof(DKEndpointStatistics, messagesSent),
+  offsetof(DKEndpointStatistics, bytesSent),
+  offsetof(DKEndpointStatistics, messagesReceived),
+  offsetof(DKEndpointStatistics, bytesReceived),
+  offsetof(DKEndpointStatistics, maxMessageSize),
+  offsetof(DKEndpointStatistics, dispatchTime)
+};
+
+/*
+ * Atomically reads the counters in <var>counters</var> into
+ * <var>snapshot</var> (unless it is NULL), resetting them to zero if
+ * <var>reset</var> is YES.
+ */
+static void
+DKTakeStatistics(DKEndpointStatistics *counters,
+  DKEndpointStatistics *snapshot, BOOL reset)
+{
+  NSUInteger i = 0;
+  for (i = 0; i < (sizeof(DKStatisticsCounters) / sizeof(size_t)); i++)
+  {
+    uint64_t *counter = (uint64_t*)((char*)counters + DKStatisticsCounters[i]);
+    uint64_t value = reset ? __sync_lock_test_and_set(counter, 0)
+      : __sync_fetch_and_add(counter, 0);
+    if (NULL != snapshot)
+    {
+      *(uint64_t*)((char*)snapshot + DKStatisticsCounters[i]) = value;
+    }
+  }
+}
+
 @interface DKEndpoint (DBusEndpointPrivate)
 - (void)cleanup;
 - (void)_mergeInfo: (NSDictionary*)info;
@@ -108,11 +161,38 @@ DKRelease(void *ptr);
   NSMapTable *watchers;
   NSString *runLoopMode;
   NSRunLoop *runLoop;
+
+  /*
+   * The endpoint the context belongs to. This is not retained since the
+   * endpoint owns the context. It will be reset by the endpoint on cleanup.
+   */
+  DKEndpoint *endpoint;
+  DKEndpointStatistics stats;
+  BOOL collectStatistics;
+  uint64_t outgoingQueueThreshold;
+  uint64_t messageSizeThreshold;
+  BOOL outgoingQueueAboveThreshold;
+  DKMessageCapture *capture;
+  NSLock *captureLock;
 }
 
 - (id)_initWithConnection: (DBusConnection*)connection;
 - (NSRunLoop*)runLoop;
 - (NSString*)runLoopMode;
+- (void)_setEndpoint: (DKEndpoint*)endpoint;
+- (void)setCollectsStatistics: (BOOL)yesno;
+- (BOOL)collectsStatistics;
+- (DKEndpointStatistics)statistics;
+- (void)resetStatistics;
+- (void)noteMessage: (DBusMessage*)msg
+           outgoing: (BOOL)isOutgoing;
+- (void)setOutgoingQueueThreshold: (uint64_t)size;
+- (uint64_t)outgoingQueueThreshold;
+- (void)setMessageSizeThreshold: (uint64_t)size;
+- (uint64_t)messageSizeThreshold;
+- (void)setCapture: (DKMessageCapture*)aCapture;
+- (void)captureMessage: (DBusMessage*)msg
+              outgoing: (BOOL)isOutgoing;
 @end
 
 #ifndef DARLING
@@ -195,6 +275,15 @@ DKRelease(void *ptr);
 
   if (initSuccess)
   {
+    initSuccess = (BOOL)dbus_connection_add_filter(connection,
+      DKCountIncoming,
+      (void*)ctx,
+      NULL);
+  }
+
+  if (initSuccess)
+  {
+    [ctx _setEndpoint: self];
     dbus_connection_set_wakeup_main_function(connection,
       DKWakeUp,
       (void*)[ctx retain],
@@ -426,6 +515,8 @@ DKRelease(void *ptr);
   if (connection != NULL)
   {
     [[DKEndpointManager sharedEndpointManager] removeEndpointForDBusConnection: connection];
+    dbus_connection_remove_filter(connection, DKCountIncoming, (void*)ctx);
+    [ctx _setEndpoint: nil];
     dbus_connection_unref(connection);
     connection = NULL;
     [ctx release];
@@ -459,6 +550,102 @@ DKRelease(void *ptr);
   return connection;
 }
 
+/* Methods to monitor and limit the traffic on the connection: */
+
+- (void)setCollectsStatistics: (BOOL)yesno
+{
+  [ctx setCollectsStatistics: yesno];
+}
+
+- (BOOL)collectsStatistics
+{
+  return [ctx collectsStatistics];
+}
+
+- (DKEndpointStatistics)statistics
+{
+  DKEndpointStatistics theStats = [ctx statistics];
+  if (NULL != connection)
+  {
+    theStats.outgoingQueueSize = dbus_connection_get_outgoing_size(connection);
+  }
+  return theStats;
+}
+
+- (void)resetStatistics
+{
+  [ctx resetStatistics];
+}
+
+- (void)noteOutgoingMessage: (DBusMessage*)message
+{
+  [ctx noteMessage: message
+          outgoing: YES];
+}
+
+- (BOOL)startCapturingToFile: (NSString*)path
+{
+  DKMessageCapture *capture = [[DKMessageCapture alloc] initForWritingAtPath: path];
+  if (nil == capture)
+  {
+    return NO;
+  }
+  [ctx setCapture: capture];
+  [capture release];
+  return YES;
+}
+
+- (void)stopCapturing
+{
+  [ctx setCapture: nil];
+}
+
+- (void)noteReply: (DBusMessage*)reply
+{
+  [ctx captureMessage: reply
+             outgoing: NO];
+}
+
+- (void)setMaximumReceivedSize: (NSUInteger)size
+{
+  dbus_connection_set_max_received_size(connection, (long)size);
+}
+
+- (NSUInteger)maximumReceivedSize
+{
+  return (NSUInteger)dbus_connection_get_max_received_size(connection);
+}
+
+- (void)setMaximumMessageSize: (NSUInteger)size
+{
+  dbus_connection_set_max_message_size(connection, (long)size);
+}
+
+- (NSUInteger)maximumMessageSize
+{
+  return (NSUInteger)dbus_connection_get_max_message_size(connection);
+}
+
+- (void)setOutgoingQueueThreshold: (NSUInteger)size
+{
+  [ctx setOutgoingQueueThreshold: size];
+}
+
+- (NSUInteger)outgoingQueueThreshold
+{
+  return (NSUInteger)[ctx outgoingQueueThreshold];
+}
+
+- (void)setMessageSizeThreshold: (NSUInteger)size
+{
+  [ctx setMessageSizeThreshold: size];
+}
+
+- (NSUInteger)messageSizeThreshold
+{
+  return (NSUInteger)[ctx messageSizeThreshold];
+}
+
 
 /* Hashing and equality is easy: */
 
@@ -561,6 +748,7 @@ static void DKSocketCallback(
   void *info
 ) {
   DKWatcher *self = (DKWatcher *) info;
+  DKEndpointManagerNoteActivity();
   if (callbackType == kCFSocketReadCallBack)
     {
       dbus_watch_handle(self->watch, DBUS_WATCH_READABLE);
@@ -622,6 +810,7 @@ static void DKSocketCallback(
       return;
     }
   callbackInProgress = YES;
+  DKEndpointManagerNoteActivity();
   switch (type)
     {
       case ET_RDESC:
@@ -705,6 +894,7 @@ static IMP performOnWorkerThread;
   watchers = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
     NSObjectMapValueCallBacks,
     10);
+  captureLock = [NSLock new];
   return self;
 }
 
@@ -737,12 +927,188 @@ static IMP performOnWorkerThread;
 }
 
 
+- (void)_setEndpoint: (DKEndpoint*)anEndpoint
+{
+  endpoint = anEndpoint;
+}
+
+- (void)setCollectsStatistics: (BOOL)yesno
+{
+  collectStatistics = yesno;
+}
+
+- (BOOL)collectsStatistics
+{
+  return collectStatistics;
+}
+
+- (DKEndpointStatistics)statistics
+{
+  DKEndpointStatistics theStats;
+  memset(&theStats, 0, sizeof(theStats));
+  DKTakeStatistics(&stats, &theStats, NO);
+  return theStats;
+}
+
+- (void)resetStatistics
+{
+  DKTakeStatistics(&stats, NULL, YES);
+}
+
+- (void)setOutgoingQueueThreshold: (uint64_t)size
+{
+  outgoingQueueThreshold = size;
+  if (0 != size)
+  {
+    collectStatistics = YES;
+  }
+}
+
+- (uint64_t)outgoingQueueThreshold
+{
+  return outgoingQueueThreshold;
+}
+
+- (void)setMessageSizeThreshold: (uint64_t)size
+{
+  messageSizeThreshold = size;
+  if (0 != size)
+  {
+    collectStatistics = YES;
+  }
+}
+
+- (uint64_t)messageSizeThreshold
+{
+  return messageSizeThreshold;
+}
+
+/**
+ * Replaces the capture that messages are recorded to. The previous capture is
+ * closed.
+ */
+- (void)setCapture: (DKMessageCapture*)aCapture
+{
+  DKMessageCapture *oldCapture = nil;
+  [captureLock lock];
+  oldCapture = capture;
+  capture = [aCapture retain];
+  [captureLock unlock];
+  [oldCapture close];
+  [oldCapture release];
+}
+
+- (void)captureMessage: (DBusMessage*)msg
+              outgoing: (BOOL)isOutgoing
+{
+  if ((nil == capture) || (NULL == msg))
+  {
+    return;
+  }
+  [captureLock lock];
+  [capture recordMessage: msg
+                outgoing: isOutgoing];
+  [captureLock unlock];
+}
+
+/**
+ * Posts the notification on the main thread, since observers will not expect
+ * to be called on the worker thread, and should not hold it up.
+ */
+- (void)_postThresholdNotification: (NSString*)threshold
+                             value: (uint64_t)value
+                             limit: (uint64_t)limit
+{
+  NSDictionary *userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
+    threshold, @"threshold",
+    [NSNumber numberWithUnsignedLongLong: value], @"value",
+    [NSNumber numberWithUnsignedLongLong: limit], @"limit", nil];
+  NSNotification *notification =
+    [NSNotification notificationWithName: DKEndpointThresholdExceededNotification
+                                  object: endpoint
+                                userInfo: userInfo];
+  [[NSNotificationCenter defaultCenter] performSelectorOnMainThread: @selector(postNotification:)
+                                                         withObject: notification
+                                                      waitUntilDone: NO];
+}
+
+/**
+ * Accounts for a message that was sent or received. Determining the size
+ * requires marshalling the message, so we only do this when collecting
+ * statistics.
+ */
+- (void)noteMessage: (DBusMessage*)msg
+           outgoing: (BOOL)isOutgoing
+{
+  char *buffer = NULL;
+  int length = 0;
+  uint64_t size = 0;
+  uint64_t oldMax = 0;
+  [self captureMessage: msg
+              outgoing: isOutgoing];
+  if ((NO == collectStatistics) || (NULL == msg))
+  {
+    return;
+  }
+
+  if (dbus_message_marshal(msg, &buffer, &length))
+  {
+    size = (uint64_t)length;
+    dbus_free(buffer);
+  }
+
+  if (isOutgoing)
+  {
+    __sync_fetch_and_add(&stats.messagesSent, 1);
+    __sync_fetch_and_add(&stats.bytesSent, size);
+  }
+  else
+  {
+    __sync_fetch_and_add(&stats.messagesReceived, 1);
+    __sync_fetch_and_add(&stats.bytesReceived, size);
+  }
+
+  do
+  {
+    oldMax = stats.maxMessageSize;
+  } while ((size > oldMax)
+    && (NO == __sync_bool_compare_and_swap(&stats.maxMessageSize, oldMax, size)));
+
+  if ((0 != messageSizeThreshold) && (size > messageSizeThreshold))
+  {
+    [self _postThresholdNotification: @"messageSize"
+                               value: size
+                               limit: messageSizeThreshold];
+  }
+
+  if (isOutgoing && (0 != outgoingQueueThreshold))
+  {
+    uint64_t queued = (uint64_t)dbus_connection_get_outgoing_size(connection);
+    if (queued > outgoingQueueThreshold)
+    {
+      if (__sync_bool_compare_and_swap(&outgoingQueueAboveThreshold, NO, YES))
+      {
+        [self _postThresholdNotification: @"outgoingQueueSize"
+                                   value: queued
+                                   limit: outgoingQueueThreshold];
+      }
+    }
+    else
+    {
+      __sync_bool_compare_and_swap(&outgoingQueueAboveThreshold, YES, NO);
+    }
+  }
+}
+
 - (void)dealloc
 {
   NSDebugMLog(@"Destroying run loop context for libdbus.");
   NSFreeMapTable(watchers);
   NSFreeMapTable(timers);
   [runLoopMode release];
+  [capture close];
+  [capture release];
+  [captureLock release];
   [super dealloc];
 }
 
@@ -813,6 +1179,22 @@ static IMP performOnWorkerThread;
    */
 }
 
+/*
+ * Dispatches a single message. Every message gets its own autorelease pool so
+ * that the temporaries created while handling it (boxed values, userInfo
+ * dictionaries, proxy standins, etc.) do not pile up until the worker run loop
+ * finishes its current iteration.
+ */
+static inline void
+DKDispatchOneMessage(DBusConnection *connection)
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  DKTrace(DKTraceDispatchBegin, NULL, 0);
+  dbus_connection_dispatch(connection);
+  DKTrace(DKTraceDispatchEnd, NULL, 0);
+  [arp release];
+}
+
 /**
  * Called by libdbus to drain the message queue.
  */
@@ -826,10 +1208,26 @@ static IMP performOnWorkerThread;
     return NO;
   }
 
+  if (collectStatistics)
+  {
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (DBUS_DISPATCH_DATA_REMAINS == dbus_connection_get_dispatch_status(connection))
+    {
+      DKDispatchOneMessage(connection);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    __sync_fetch_and_add(&stats.dispatchTime,
+      (uint64_t)((end.tv_sec - start.tv_sec) * 1000000
+        + (end.tv_nsec - start.tv_nsec) / 1000));
+    return YES;
+  }
+
   while (DBUS_DISPATCH_DATA_REMAINS == dbus_connection_get_dispatch_status(connection))
   {
     // We drain all messages instead of waiting for the next run loop iteration:
-    dbus_connection_dispatch(connection);
+    DKDispatchOneMessage(connection);
   };
   return YES;
 }
@@ -972,6 +1370,16 @@ DKRelease(void *data)
   [(id)data release];
 }
 
+static DBusHandlerResult
+DKCountIncoming(DBusConnection *conn, DBusMessage *msg, void *data)
+{
+  CTX(data);
+  [ctx noteMessage: msg
+          outgoing: NO];
+  // We only account for the message, somebody else needs to handle it.
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
 static void
 DKWakeUp(void *data)
 {
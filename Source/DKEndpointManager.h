@@ -22,6 +22,7 @@
 
 
 #import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
 #include <stdint.h>
 #include <dbus/dbus.h>
 
@@ -131,6 +132,23 @@ typedef struct {
    * then on the worker thread.
    */
    NSMapTable *syncedTimers;
+
+  /**
+   * The CPU the worker thread is pinned to, or -1 if it may run on any CPU.
+   */
+  NSInteger workerCPU;
+
+  /**
+   * The SCHED_FIFO priority requested for the worker thread, or 0 if it uses
+   * the default scheduling policy.
+   */
+  NSInteger workerPriority;
+
+  /**
+   * The time the worker thread keeps polling the run loop after the last
+   * event before it blocks, or 0 if it blocks right away.
+   */
+  NSTimeInterval busyPollInterval;
 }
 
 /**
@@ -144,6 +162,12 @@ typedef struct {
  */
 - (NSThread*)workerThread;
 
+/**
+ * Returns YES once the worker thread has been started. Until then, the thread
+ * returned by -workerThread exists but does not process any connections.
+ */
+- (BOOL)isWorkerThreadRunning;
+
 /**
  * Creates or reuses an endpoint.
  */
@@ -256,8 +280,29 @@ typedef struct {
  * watcher object.
  */
 - (void)unregisterWatcher: (id)watcher;
+
+/**
+ * Configures the low-latency mode of the worker thread. If <var>cpu</var> is
+ * not negative, the thread is pinned to that CPU (only supported on Linux). If
+ * <var>priority</var> is greater than zero, the thread is scheduled with the
+ * real-time SCHED_FIFO policy at that priority, which usually requires
+ * privileges. If <var>interval</var> is greater than zero, the thread will
+ * poll the connections without sleeping until no event was handled for that
+ * many seconds. Passing -1, 0 and 0 restores the default mode. Failures to
+ * apply the settings are logged and otherwise ignored.
+ */
+- (void)setWorkerCPU: (NSInteger)cpu
+  schedulingPriority: (NSInteger)priority
+    busyPollInterval: (NSTimeInterval)interval;
 @end
 
+/**
+ * Records that the worker thread handled an event. This is used to extend the
+ * busy-polling window while events keep arriving.
+ */
+void
+DKEndpointManagerNoteActivity(void);
+
 /**
  * Macro to check whether the code is presently executing in the worker thread
  */
@@ -20,6 +20,11 @@
    Boston, MA 02111 USA.
    */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// Needed for pthread_setaffinity_np() and the CPU_* macros:
+#  define _GNU_SOURCE
+#endif
+
 #import "DKArgument.h"
 #import "DKEndpointManager.h"
 #import "DKEndpoint.h"
@@ -28,6 +33,7 @@
 #import "DKObjectPathNode.h"
 #import "DKProxy+Private.h"
 #import "DKSignal.h"
+#import "DKTrace.h"
 
 #import "DBusKit/DKProxy.h"
 
@@ -46,7 +52,12 @@
 
 #include <stdlib.h>
 #include <inttypes.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 /*
  * Phony interfaces to make the compiler aware of the fact that the private
@@ -62,6 +73,10 @@
 - (void)_mergeInfo: (NSDictionary*)info;
 @end
 
+@interface DKEndpointManager (DKEndpointManagerPrivate)
+- (void)_startWorkerThread;
+@end
+
 @interface NSObject (DKContextPrivateMethods)
 - (void)monitorForEvents;
 - (void)unmonitorForEvents;
@@ -70,6 +85,27 @@
 
 static DKEndpointManager *sharedManager;
 
+/*
+ * Counts events handled by the worker thread. It is only used to detect that
+ * something happened while busy-polling, so lost increments do not matter and
+ * no atomic operations are used.
+ */
+static volatile uint32_t workerActivity;
+
+void
+DKEndpointManagerNoteActivity(void)
+{
+  workerActivity++;
+}
+
+static double
+DKEndpointManagerNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
 #define DKTheManager getManager(managerClass, getManagerSelector)
 #define DKManagerThread managerThread
 #define DKPerformOnManagerThread(target,payloadSelector,object) performOnThread(target,\
@@ -99,10 +135,7 @@ if (NO == DKRingEmpty)\
 {\
   if (0 == initializeRefCount)\
   {\
-    if (__sync_bool_compare_and_swap(&threadStarted, 0, 1))\
-    {\
-      [workerThread start];\
-    }\
+    [self _startWorkerThread];\
   }\
   NSDebugMLog(@"Stuff in buffer: Scheduling buffer draining.");\
   [self performSelector: @selector(drainBuffer:)\
@@ -143,6 +176,7 @@ if (NO == DKRingEmpty)\
       }\
     }\
   [x.target retain];\
+  DKTrace(DKTraceWorkerEnqueue, sel_getName(x.selector), producerCounter);\
   ringBuffer[DKMaskIndex(producerCounter)] = x;\
   __sync_fetch_and_add(&producerCounter, 1);\
   [producerLock unlock];\
@@ -186,6 +220,9 @@ if (NO == DKRingEmpty)\
    */
    dbus_threads_init_default();
 
+  // Allow tracing to be switched on without changes to the application:
+  DKTraceInitializeFromEnvironment();
+
   /*
    * To sidestep the limitation of handling of +initialize by the gcc and
    * gnustep runtimes (which use a global lock to protect against multiple calls
@@ -209,12 +246,13 @@ if (NO == DKRingEmpty)\
   [[[DKIntrospectionParserDelegate alloc] init] release];
   [[[DKMethodCall alloc] init] release];
 
+  /*
+   * NOTE: We used to preload the bus objects for both well-known buses here.
+   * This is no longer done because it meant connecting to (and introspecting)
+   * both buses as soon as any part of DBusKit was used. The bus objects are
+   * now created when they are first needed.
+   */
   sharedManager = [[DKEndpointManager alloc] init];
-  [sharedManager enterInitialize];
-  // Preload the bus objects:
-  [DKDBus sessionBus];
-  [DKDBus systemBus];
-  [sharedManager leaveInitialize];
 }
 
 + (id)sharedEndpointManager
@@ -259,6 +297,7 @@ if (NO == DKRingEmpty)\
     * issues from +initialize.
     */
    initializeRefCount = 1;
+   workerCPU = -1;
    ringBuffer = calloc(sizeof(DKRingBufferElement), DKRingSize);
    producerLock = [NSLock new];
 
@@ -280,6 +319,20 @@ if (NO == DKRingEmpty)\
 }
 
 
+/**
+ * Starts the worker thread unless it is already running. This is deferred
+ * until there is actual work for the thread to do, so that applications that
+ * link DBusKit without using the bus don't pay for the thread.
+ */
+- (void)_startWorkerThread
+{
+  if (__sync_bool_compare_and_swap(&threadStarted, 0, 1))
+  {
+    [workerThread start];
+    NSDebugMLog(@"Worker thread started.");
+  }
+}
+
 - (void)enableThread
 {
   if (__sync_bool_compare_and_swap(&threadEnabled, 0, 1))
@@ -293,6 +346,11 @@ if (NO == DKRingEmpty)\
   return workerThread;
 }
 
+- (BOOL)isWorkerThreadRunning
+{
+  return threadStarted;
+}
+
 - (id)endpointForDBusConnection: (DBusConnection*)connection
                     mergingInfo: (NSDictionary*)info
 {
@@ -467,18 +525,147 @@ if (NO == DKRingEmpty)\
   //Won't happen.
 }
 
+/**
+ * Applies the CPU affinity and scheduling policy configured for the
+ * low-latency mode to the current thread, which must be the worker thread.
+ */
+- (void)_applyWorkerScheduling: (id)ignored
+{
+  struct sched_param param;
+  int policy = SCHED_OTHER;
+  int err = 0;
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (workerCPU >= 0)
+  {
+    CPU_SET(workerCPU, &cpus);
+  }
+  else
+  {
+    // Allow all CPUs again:
+    long i;
+    long count = sysconf(_SC_NPROCESSORS_CONF);
+    for (i = 0; (i < count) && (i < CPU_SETSIZE); i++)
+    {
+      CPU_SET(i, &cpus);
+    }
+  }
+  err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (0 != err)
+  {
+    NSWarnMLog(@"Could not set the CPU affinity of the worker thread: %s",
+      strerror(err));
+  }
+#else
+  if (workerCPU >= 0)
+  {
+    NSWarnMLog(@"Pinning the worker thread to a CPU is not supported on this platform.");
+  }
+#endif
+
+  memset(&param, 0, sizeof(param));
+  if (workerPriority > 0)
+  {
+    int min = sched_get_priority_min(SCHED_FIFO);
+    int max = sched_get_priority_max(SCHED_FIFO);
+    policy = SCHED_FIFO;
+    param.sched_priority = (int)MAX(min, MIN(max, workerPriority));
+  }
+  err = pthread_setschedparam(pthread_self(), policy, &param);
+  if ((0 != err) && (workerPriority > 0))
+  {
+    NSWarnMLog(@"Could not switch the worker thread to SCHED_FIFO: %s",
+      strerror(err));
+  }
+}
+
+/**
+ * Runs the run loop without blocking until no event has been handled for the
+ * busy-polling interval. This avoids the latency of waking up the worker
+ * thread from the kernel when events arrive in quick succession.
+ */
+- (void)_busyPollRunLoop: (NSRunLoop*)runLoop
+{
+  NSDate *past = [NSDate distantPast];
+  uint32_t seen = workerActivity;
+  NSTimeInterval interval = busyPollInterval;
+  double deadline = DKEndpointManagerNow() + interval;
+  while (interval > 0)
+  {
+    NSAutoreleasePool *arp = [NSAutoreleasePool new];
+    [runLoop runMode: NSDefaultRunLoopMode
+          beforeDate: past];
+    [arp release];
+    if (seen != workerActivity)
+    {
+      seen = workerActivity;
+      deadline = DKEndpointManagerNow() + interval;
+    }
+    else if (DKEndpointManagerNow() >= deadline)
+    {
+      break;
+    }
+    // Pick up changes to the configuration:
+    interval = busyPollInterval;
+  }
+}
+
 - (void)start: (id)ignored
 {
   NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+  NSDate *future = [NSDate distantFuture];
+  BOOL running = YES;
   // We schedule a timer to make sure that the run loop actually runs:
-  [NSTimer scheduledTimerWithTimeInterval: [[NSDate distantFuture] timeIntervalSinceNow]
+  [NSTimer scheduledTimerWithTimeInterval: [future timeIntervalSinceNow]
                                    target: self
                                  selector: @selector(distantFutureReached:)
                                  userInfo: nil
                                   repeats: NO];
-  [[NSRunLoop currentRunLoop] run];
+  if ((workerCPU >= 0) || (workerPriority > 0))
+  {
+    [self _applyWorkerScheduling: nil];
+  }
+
+  /*
+   * This is what -[NSRunLoop run] does, except that the low-latency mode can
+   * have the thread poll for a while before it goes to sleep again.
+   */
+  while (running)
+  {
+    NSAutoreleasePool *iterationPool = [NSAutoreleasePool new];
+    if (busyPollInterval > 0)
+    {
+      [self _busyPollRunLoop: runLoop];
+    }
+    running = [runLoop runMode: NSDefaultRunLoopMode
+                    beforeDate: future];
+    [iterationPool release];
+  }
   [arp release];
 }
+
+- (void)setWorkerCPU: (NSInteger)cpu
+  schedulingPriority: (NSInteger)priority
+    busyPollInterval: (NSTimeInterval)interval
+{
+  workerCPU = MAX(cpu, -1);
+  workerPriority = MAX(priority, 0);
+  busyPollInterval = MAX(interval, 0);
+  /*
+   * If the thread is not running yet, it will pick up the scheduling settings
+   * when it starts. Otherwise, it needs to apply them itself because NSThread
+   * does not give us access to the pthread.
+   */
+  if (threadStarted)
+  {
+    [self performSelector: @selector(_applyWorkerScheduling:)
+                 onThread: workerThread
+               withObject: nil
+            waitUntilDone: NO];
+  }
+}
 - (void)_performRecovery: (NSTimer*)timer
 {
   NSDictionary *userInfo = [timer userInfo];
@@ -520,6 +707,7 @@ if (NO == DKRingEmpty)\
   }
   else
   {
+    [self _startWorkerThread];
     [self performSelector: @selector(_injectTimer:)
                  onThread: workerThread
  	       withObject: timer
@@ -663,13 +851,22 @@ if (NO == DKRingEmpty)\
 {
   DKRingBufferElement element = {nil, NULL, nil, NULL};
   NSInteger *returnPointer = NULL;
+  // There is only one consumer, so this is the slot we are going to process:
+  uint32_t sequence = consumerCounter;
+  /*
+   * Each request is processed in its own autorelease pool. If the request
+   * raises, the pool is released along with the enclosing one.
+   */
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
   NSDebugMLog(@"Started draining buffer");
+  DKEndpointManagerNoteActivity();
   DKRingRemove(element);
 
   if (nil != element.target)
   {
     IMP performRequest = [element.target methodForSelector: element.selector];
     returnPointer = element.returnPointer;
+    DKTrace(DKTraceWorkerBegin, sel_getName(element.selector), sequence);
     NSAssert2(performRequest, @"Could not perform selector %@ on %@",
       NSStringFromSelector(element.selector),
       element.target);
@@ -686,6 +883,7 @@ if (NO == DKRingEmpty)\
         // Set the pointer to 0 so that the requesting thread does not
         // continue to wait for the result.
         *returnPointer = 0;
+        DKTrace(DKTraceWorkerEnd, sel_getName(element.selector), sequence);
         [localException raise];
       }
       NS_ENDHANDLER
@@ -696,6 +894,7 @@ if (NO == DKRingEmpty)\
       // completion.
       performRequest(element.target, element.selector, element.object);
     }
+    DKTrace(DKTraceWorkerEnd, sel_getName(element.selector), sequence);
   }
   else
   {
@@ -705,6 +904,7 @@ if (NO == DKRingEmpty)\
       *returnPointer = 0;
     }
   }
+  [arp release];
 }
 
 - (void)enterInitialize
@@ -863,17 +1063,20 @@ if (NO == DKRingEmpty)\
     {
       if (1 == initializeRefCount)
       {
-        // Start the worker thread if necessary:
-        if (__sync_bool_compare_and_swap(&threadStarted, 0, 1))
+        /*
+         * Only start the worker thread if something was scheduled while in
+         * synchronized mode. Otherwise, the thread will be started once the
+         * first request is inserted into the ring buffer.
+         */
+        if ((0 != NSCountMapTable(syncedWatchers))
+          || (0 != NSCountMapTable(syncedTimers)))
         {
-          [workerThread start];
-	  NSDebugMLog(@"Worker thread started.");
+          [self _startWorkerThread];
+          // Move the watchers to the worker thread
+          [self _transferWatchersToWorkerThread];
+          // Move the timers as well:
+          [self _transferTimersToWorkerThread];
         }
-
-        // Move the watchers to the worker thread
-        [self _transferWatchersToWorkerThread];
-        // Move the timers as well:
-        [self _transferTimersToWorkerThread];
       }
     }
     NS_HANDLER
@@ -42,16 +42,26 @@
 /**
  * Returns an interface set up with all methods defined in the Objective-C
  * class given. This does not include methods defined in superclasses.
+ * Interfaces are cached per class and shared between proxies, so the result
+ * must be copied before it is modified. Classes that gain or replace methods
+ * at runtime need to be passed to +invalidateInterfaceForObjCClass:.
  */
 + (id)interfaceForObjCClass: (Class)theClass;
 
 /**
  * Returns an interface set up with all methods defined in the Objective-C
  * protocols given. This does not include methods declared by protocols adopted.
- * by this protocol.
+ * by this protocol. Interfaces are cached per protocol and shared, like those
+ * returned by +interfaceForObjCClass:.
  */
 + (id)interfaceForObjCProtocol: (Protocol*)theProtocol;
 
+/**
+ * Discards the cached interface for <var>theClass</var>, so that methods added
+ * to or replaced in the class at runtime are picked up.
+ */
++ (void)invalidateInterfaceForObjCClass: (Class)theClass;
+
 /**
  * Returns all methods in the interface
  */
@@ -21,7 +21,10 @@
    */
 
 #import <Foundation/NSDictionary.h>
+#import <Foundation/NSLock.h>
 #import <Foundation/NSMapTable.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSNull.h>
 #import <Foundation/NSObjCRuntime.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSUserDefaults.h>
@@ -36,8 +39,11 @@
 #include "config.h"
 #undef INCLUDE_RUNTIME_H
 
+#import "DBusKit/DKGeneratedIntrospection.h"
 #import "DBusKit/DKNotificationCenter.h"
+#import "DKAllocationCounters.h"
 
+#import "DKArgument.h"
 #import "DKMethod.h"
 #import "DKProperty.h"
 #import "DKPropertyMethod.h"
@@ -46,10 +52,118 @@
 #import "DKEndpoint.h"
 #import "DKProxy+Private.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+/*
+ * Interfaces generated from the Objective-C runtime, keyed by Class or
+ * Protocol. Classes with no exportable methods map to NSNull.
+ */
+static NSMapTable *objCInterfaceCache;
+
+/*
+ * The value of the GSPermittedMessages default the cached interfaces were
+ * generated for.
+ */
+static NSArray *cachedPermittedMessages;
+
+/*
+ * Set whenever the user defaults change, so that the GSPermittedMessages
+ * default only needs to be read again after a change.
+ */
+static volatile int defaultsChanged = 1;
+
+static NSLock *objCInterfaceCacheLock;
+
+/*
+ * Chain of introspection tables registered by code generated with
+ * dk_make_dispatch. Tables are only ever prepended, so readers can walk the
+ * chain without locking.
+ */
+static DKGeneratedIntrospectionTable *generatedTables;
+
+void
+DKRegisterGeneratedIntrospection(DKGeneratedIntrospectionTable *table)
+{
+  DKGeneratedIntrospectionTable *head = NULL;
+  if (NULL == table)
+  {
+    return;
+  }
+  do
+  {
+    head = generatedTables;
+    table->next = head;
+  } while (!__sync_bool_compare_and_swap(&generatedTables, head, table));
+}
+
+static const DKGeneratedInterface*
+DKGeneratedInterfaceForObjCName(const char *objCName, BOOL isProtocol)
+{
+  DKGeneratedIntrospectionTable *table = generatedTables;
+  while (NULL != table)
+  {
+    unsigned int i = 0;
+    for (i = 0; i < table->interfaceCount; i++)
+    {
+      const DKGeneratedInterface *genIf = &table->interfaces[i];
+      if (((0 != genIf->isProtocol) == isProtocol)
+        && (0 == strcmp(objCName, genIf->objCName)))
+      {
+        return genIf;
+      }
+    }
+    table = table->next;
+  }
+  return NULL;
+}
+
+/*
+ * Checks whether we want to permit exporting a method, the checks correspond
+ * to those in gnustep-gui's GSServicesManager. (the userData:error: methods
+ * are not useful yet, though. They have an out parameter and require
+ * special-casing.) <var>messages</var> is the value of the GSPermittedMessages
+ * default.
+ */
+static BOOL
+DKIsPermittedSelectorName(NSString *selName, NSArray *messages)
+{
+  return (([selName hasPrefix: @"application:"] == YES)
+    || ([selName hasSuffix: @":userData:error:"] == YES)
+    || ([messages containsObject: selName]));
+}
 
 @implementation DKInterface
 
++ (void)initialize
+{
+  if ([DKInterface class] == self)
+  {
+    objCInterfaceCache = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+      NSObjectMapValueCallBacks, 64);
+    objCInterfaceCacheLock = [NSLock new];
+    [[NSNotificationCenter defaultCenter] addObserver: self
+                                             selector: @selector(_defaultsDidChange:)
+                                                 name: NSUserDefaultsDidChangeNotification
+                                               object: nil];
+  }
+}
+
++ (void)_defaultsDidChange: (NSNotification*)notification
+{
+  defaultsChanged = 1;
+}
+
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationInterface);
+  }
+  return obj;
+}
 
 + (id)interfaceForObjCClassOrProtocol: (void*)entity
                               isClass: (BOOL)isClass
@@ -128,15 +242,7 @@
     }
     selName = [NSString stringWithUTF8String: sel_getName(selector)];
 
-    /*
-     * Check whether we want to permit exporting this method, the checks
-     * correspond to those in gnustep-gui's GSServicesManager. (the
-     * userData:error: methods are not useful yet, though. They have an out
-     * parameter and require special-casing.
-     */
-    if (([selName hasPrefix: @"application:"] == YES)
-      || ([selName hasSuffix: @":userData:error:"] == YES)
-      || ([messages containsObject: selName]))
+    if (DKIsPermittedSelectorName(selName, messages))
     {
       DKMethod *theMethod = nil;
       if (isClass)
@@ -172,15 +278,178 @@
   return theIf;
 }
 
+/**
+ * Builds an interface from a table emitted by dk_make_dispatch. Methods with
+ * invalid signatures are skipped, as are methods that would not be exported
+ * when generating the interface from the runtime.
+ */
++ (id)interfaceForGeneratedInterface: (const DKGeneratedInterface*)genIf
+{
+  DKInterface *theIf = [[[DKInterface alloc] initWithName: [NSString stringWithUTF8String: genIf->interfaceName]
+                                                  parent: nil] autorelease];
+  NSArray *messages = [[NSUserDefaults standardUserDefaults] arrayForKey:
+    @"GSPermittedMessages"];
+  unsigned int i = 0;
+  for (i = 0; i < genIf->methodCount; i++)
+  {
+    const DKGeneratedMethod *genMethod = &genIf->methods[i];
+    DKMethod *theMethod = nil;
+    BOOL isValid = YES;
+    unsigned int j = 0;
+    if (NO == DKIsPermittedSelectorName([NSString stringWithUTF8String: genMethod->selector],
+      messages))
+    {
+      continue;
+    }
+    theMethod = [[DKMethod alloc] initWithName: [NSString stringWithUTF8String: genMethod->member]
+                                        parent: theIf];
+    [theMethod setAnnotationValue: [NSString stringWithUTF8String: genMethod->selector]
+                           forKey: @"org.gnustep.objc.selector"];
+    for (j = 0; j < genMethod->argumentCount; j++)
+    {
+      const DKGeneratedArgument *genArg = &genMethod->arguments[j];
+      NSString *argName = nil;
+      DKArgument *theArg = nil;
+      if (NULL != genArg->name)
+      {
+        argName = [NSString stringWithUTF8String: genArg->name];
+      }
+      theArg = [[DKArgument alloc] initWithDBusSignature: genArg->signature
+                                                    name: argName
+                                                  parent: theMethod];
+      if (nil == theArg)
+      {
+        NSWarnMLog(@"Invalid signature '%s' for generated method %s.",
+          genArg->signature,
+          genMethod->selector);
+        isValid = NO;
+        break;
+      }
+      if (NULL != genArg->className)
+      {
+        [theArg setAnnotationValue: [NSString stringWithUTF8String: genArg->className]
+                            forKey: @"org.gnustep.objc.class"];
+      }
+      [theMethod addArgument: theArg
+                   direction: (genArg->isOutput ? kDKArgumentDirectionOut
+                                                : kDKArgumentDirectionIn)];
+      [theArg release];
+    }
+    if (isValid)
+    {
+      [theIf addMethod: theMethod];
+    }
+    [theMethod release];
+  }
+  if (0 == [[theIf methods] count])
+  {
+    return nil;
+  }
+  return theIf;
+}
+
+/**
+ * Returns the interface for <var>entity</var> from the cache, generating it if
+ * necessary. Cache hits neither consult the runtime nor the user defaults:
+ * The whole cache is only checked against the GSPermittedMessages default
+ * after the defaults changed, and classes that gain methods at runtime need
+ * to be invalidated explicitly. The methods of the interface are installed
+ * before it is cached, so proxies sharing it only ever read it.
+ */
++ (id)cachedInterfaceForObjCClassOrProtocol: (void*)entity
+                                    isClass: (BOOL)isClass
+{
+  id theIf = nil;
+  if (NULL == entity)
+  {
+    return nil;
+  }
+
+  if (defaultsChanged)
+  {
+    NSArray *messages = nil;
+    defaultsChanged = 0;
+    messages = [[NSUserDefaults standardUserDefaults] arrayForKey:
+      @"GSPermittedMessages"];
+    [objCInterfaceCacheLock lock];
+    if ((messages != cachedPermittedMessages)
+      && (NO == [messages isEqual: cachedPermittedMessages]))
+    {
+      // Changing the permitted messages affects all interfaces.
+      NSResetMapTable(objCInterfaceCache);
+      ASSIGN(cachedPermittedMessages, messages);
+    }
+    [objCInterfaceCacheLock unlock];
+  }
+
+  [objCInterfaceCacheLock lock];
+  theIf = [(id)NSMapGet(objCInterfaceCache, entity) retain];
+  [objCInterfaceCacheLock unlock];
+
+  if (nil == theIf)
+  {
+    const DKGeneratedInterface *genIf = NULL;
+    if (NULL != generatedTables)
+    {
+      const char *objCName = isClass ? class_getName((Class)entity)
+        : protocol_getName((Protocol*)entity);
+      genIf = DKGeneratedInterfaceForObjCName(objCName, !isClass);
+    }
+    /*
+     * Generate the interface without holding the lock. If two threads race
+     * here, both interfaces are equivalent and the last one wins. Tables
+     * generated at build time take precedence over the runtime.
+     */
+    if (NULL != genIf)
+    {
+      theIf = [[self interfaceForGeneratedInterface: genIf] retain];
+    }
+    else
+    {
+      theIf = [[self interfaceForObjCClassOrProtocol: entity
+                                             isClass: isClass] retain];
+    }
+    if (nil == theIf)
+    {
+      theIf = [[NSNull null] retain];
+    }
+    else
+    {
+      [theIf installMethods];
+    }
+    [objCInterfaceCacheLock lock];
+    NSMapInsert(objCInterfaceCache, entity, theIf);
+    [objCInterfaceCacheLock unlock];
+  }
+  [theIf autorelease];
+
+  if ([theIf isKindOfClass: [NSNull class]])
+  {
+    return nil;
+  }
+  return theIf;
+}
+
 + (id)interfaceForObjCClass: (Class)theClass
 {
-  return [self interfaceForObjCClassOrProtocol: (void*)theClass
-                                       isClass: YES];
+  return [self cachedInterfaceForObjCClassOrProtocol: (void*)theClass
+                                             isClass: YES];
 }
 + (id)interfaceForObjCProtocol: (Protocol*)theProto
 {
-  return [self interfaceForObjCClassOrProtocol: (void*)theProto
-                                       isClass: NO];
+  return [self cachedInterfaceForObjCClassOrProtocol: (void*)theProto
+                                             isClass: NO];
+}
+
++ (void)invalidateInterfaceForObjCClass: (Class)theClass
+{
+  if (Nil == theClass)
+  {
+    return;
+  }
+  [objCInterfaceCacheLock lock];
+  NSMapRemove(objCInterfaceCache, (void*)theClass);
+  [objCInterfaceCacheLock unlock];
 }
 
 
@@ -284,6 +553,7 @@
 - (void) installMethod: (DKMethod*)method
            forSelector: (SEL)selector
 {
+  DKMethod *existing = nil;
   selector = sel_getUid(sel_getName(selector));
   if ((method == nil) || (0 == selector))
   {
@@ -295,7 +565,8 @@
   {
     [self addMethod: method];
   }
-  if (NULL != NSMapInsertIfAbsent(selectorToMethodMap, selector, method))
+  existing = NSMapInsertIfAbsent(selectorToMethodMap, selector, method);
+  if ((NULL != existing) && (method != existing))
   {
     NSWarnMLog(@"Overloading selector '%@' for method '%@' in interface '%@' not supported",
       NSStringFromSelector(selector),
@@ -609,6 +880,7 @@
   [signals release];
   [properties release];
   NSFreeMapTable(selectorToMethodMap);
+  DKCountDeallocation(DKAllocationInterface);
   [super dealloc];
 }
 @end
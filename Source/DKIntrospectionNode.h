@@ -24,6 +24,28 @@
 
 #import <Foundation/NSObject.h>
 @class DKProxy, NSString, NSXMLNode, NSXMLParser, NSMutableDictionary;
+
+/**
+ * Returns a uniqued, immutable copy of <var>string</var>. Introspection data
+ * for different proxies tends to contain the same interface, member,
+ * argument and annotation names over and over again. Nodes store the interned
+ * variants so that each of these strings is only kept in memory once per
+ * process. Interned strings are never released, so this must only be used for
+ * names from a bounded vocabulary, not for arbitrary values.
+ */
+NSString*
+DKInternString(NSString *string);
+
+/**
+ * Makes <var>proxy</var> the proxy that nodes without a proxy among their
+ * ancestors resolve to on the current thread, and returns the previous one.
+ * Interfaces generated from the Objective-C runtime are shared by all outgoing
+ * proxies for objects of the same class, so the proxy handling a call is set
+ * while its arguments and return value are converted.
+ */
+DKProxy*
+DKSetContextProxy(DKProxy *proxy);
+
 /**
  * DKIntrospectionNode is the common superclass of all elements that make up the
  * introspection graph for a D-Bus entity.
@@ -31,10 +53,21 @@
 @interface DKIntrospectionNode: NSObject <NSCopying>
 {
   NSString *name;
+  /**
+   * Most nodes do not carry annotations, so the dictionary is only created
+   * once the first annotation is recorded.
+   */
   NSMutableDictionary *annotations;
   id parent;
 }
 
+/**
+ * Returns whether the names of nodes of this class are interned. This is the
+ * case for interfaces and their members and arguments, but not for object path
+ * nodes, which are named after arbitrary path components.
+ */
++ (BOOL) internsNames;
+
 /**
  * Initializes with a name and a string.
  */
@@ -57,7 +90,8 @@
 - (void) setParent: (id)parent;
 
 /**
- * Returns the next parent proxy in the tree.
+ * Returns the next parent proxy in the tree, or the proxy set with
+ * DKSetContextProxy() if there is none.
  */
 - (DKProxy*) proxyParent;
 
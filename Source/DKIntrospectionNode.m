@@ -29,6 +29,8 @@
 #import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSDebug.h>
 #import <Foundation/NSDictionary.h>
+#import <Foundation/NSHashTable.h>
+#import <Foundation/NSLock.h>
 #import <Foundation/NSNull.h>
 #import <Foundation/NSObject.h>
 #import <Foundation/NSString.h>
@@ -39,8 +41,71 @@
 #import "config.h"
 #endif
 
+#include <pthread.h>
+
+static pthread_key_t contextProxyKey;
+static pthread_once_t contextProxyKeyOnce = PTHREAD_ONCE_INIT;
+
+static void
+DKCreateContextProxyKey(void)
+{
+  pthread_key_create(&contextProxyKey, NULL);
+}
+
+DKProxy*
+DKSetContextProxy(DKProxy *proxy)
+{
+  DKProxy *previous = nil;
+  pthread_once(&contextProxyKeyOnce, DKCreateContextProxyKey);
+  previous = pthread_getspecific(contextProxyKey);
+  pthread_setspecific(contextProxyKey, proxy);
+  return previous;
+}
+
+static NSHashTable *internedStrings;
+static NSLock *internLock;
+
+NSString*
+DKInternString(NSString *string)
+{
+  NSString *interned = nil;
+  if (nil == string)
+  {
+    return nil;
+  }
+  if (nil == internLock)
+  {
+    // Trigger +initialize:
+    [DKIntrospectionNode class];
+  }
+  [internLock lock];
+  interned = NSHashGet(internedStrings, string);
+  if (nil == interned)
+  {
+    interned = [string copy];
+    NSHashInsert(internedStrings, interned);
+    [interned release];
+  }
+  [internLock unlock];
+  return interned;
+}
+
 @implementation DKIntrospectionNode
 
++ (void)initialize
+{
+  if ([DKIntrospectionNode class] == self)
+  {
+    internedStrings = NSCreateHashTable(NSObjectHashCallBacks, 256);
+    internLock = [NSLock new];
+  }
+}
+
++ (BOOL) internsNames
+{
+  return YES;
+}
+
 - (id) initWithName: (NSString*)aName
              parent: (id)aParent
 {
@@ -48,9 +113,15 @@
   {
     return nil;
   }
-  ASSIGNCOPY(name,aName);
+  if ([[self class] internsNames])
+  {
+    ASSIGN(name,DKInternString(aName));
+  }
+  else
+  {
+    ASSIGNCOPY(name,aName);
+  }
   parent = aParent;
-  annotations = [NSMutableDictionary new];
   return self;
 }
 
@@ -75,7 +146,8 @@
   {
     return [parent proxyParent];
   }
-  return nil;
+  pthread_once(&contextProxyKeyOnce, DKCreateContextProxyKey);
+  return pthread_getspecific(contextProxyKey);
 }
 
 - (void) setAnnotationValue: (id)value
@@ -88,8 +160,12 @@
       value = [NSNull null];
 
     }
+    if (nil == annotations)
+    {
+      annotations = [[NSMutableDictionary alloc] initWithCapacity: 1];
+    }
     [annotations setObject: value
-                    forKey: key];
+                    forKey: DKInternString(key)];
 
   }
 }
@@ -110,6 +186,10 @@
 
 - (NSDictionary*)annotations
 {
+  if (nil == annotations)
+  {
+    return [NSDictionary dictionary];
+  }
   return [[annotations copy] autorelease];
 }
 
@@ -117,11 +197,12 @@
 {
   DKIntrospectionNode *newNode = nil;
   NSMutableDictionary *newAnnotations = nil;
-  NSString *newName = [[name copyWithZone: zone] autorelease];
   /*
+   * The name is interned and thus immutable, so we can share it with the copy.
    * Shallow copy is enough for annotations, they only contain immutable
    * strings.
    */
+  NSString *newName = name;
   newAnnotations = [annotations mutableCopyWithZone: zone];
   newNode = [[[self class] alloc] initWithName: newName
                                         parent: parent];
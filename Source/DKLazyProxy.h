@@ -0,0 +1,73 @@
+/** Interface for the DKLazyProxy class, a lightweight object path value.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+   */
+
+#import <Foundation/NSProxy.h>
+
+@class DKEndpoint, DKPort, DKProxy, NSString;
+
+/**
+ * DKLazyProxy is used to represent object paths that were received from D-Bus,
+ * e.g. as elements of an <code>ao</code> array or as signal arguments.
+ * Applications often receive many object paths but send messages only to a
+ * few of them, so DKLazyProxy only records the endpoint, service and path of
+ * the object. A full DKProxy is created (or reused) when the first message is
+ * sent to it and all further messages are forwarded to that proxy.
+ *
+ * DKLazyProxy instances pretend to be DKProxy instances and can be passed
+ * anywhere a proxy is accepted, including as arguments to D-Bus methods.
+ */
+@interface DKLazyProxy: NSProxy
+{
+  @private
+  DKEndpoint *endpoint;
+  NSString *service;
+  NSString *path;
+
+  /**
+   * The port to the service, created on demand.
+   */
+  DKPort *port;
+
+  /**
+   * The real proxy, created when the first message is forwarded.
+   */
+  DKProxy *proxy;
+}
+
+- (id)initWithEndpoint: (DKEndpoint*)anEndpoint
+               service: (NSString*)aService
+                  path: (NSString*)aPath;
+
+/**
+ * Returns the real proxy for the object, creating it if necessary.
+ */
+- (DKProxy*)_proxy;
+
+- (DKEndpoint*)_endpoint;
+
+- (NSString*)_service;
+
+- (NSString*)_path;
+
+- (DKPort*)_port;
+
+- (BOOL)_isLocal;
+
+- (BOOL)hasSameScopeAs: (DKProxy*)aProxy;
+@end
@@ -0,0 +1,214 @@
+/** Implementation of the DKLazyProxy class, a lightweight object path value.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+   */
+
+#import "DKLazyProxy.h"
+#import "DKAllocationCounters.h"
+#import "DKEndpoint.h"
+#import "DKObjectPathNode.h"
+#import "DKProxy+Private.h"
+
+#import "DBusKit/DKPort.h"
+
+#import <Foundation/NSInvocation.h>
+#import <Foundation/NSMethodSignature.h>
+#import <Foundation/NSString.h>
+
+#define INCLUDE_RUNTIME_H
+#include "config.h"
+#undef INCLUDE_RUNTIME_H
+
+@interface DKPort (DKPortPrivate)
+- (id)initWithRemote: (NSString*)remote
+          atEndpoint: (DKEndpoint*)ep;
+@end
+
+@implementation DKLazyProxy
+
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationLazyProxy);
+  }
+  return obj;
+}
+
+- (id)initWithEndpoint: (DKEndpoint*)anEndpoint
+               service: (NSString*)aService
+                  path: (NSString*)aPath
+{
+  // This class derives from NSProxy, hence no call to -[super init].
+  if ((nil == anEndpoint) || (0 == [aService length]))
+  {
+    [self release];
+    return nil;
+  }
+  if (0 == [aPath length])
+  {
+    aPath = @"/";
+  }
+  ASSIGN(endpoint, anEndpoint);
+  ASSIGNCOPY(service, aService);
+  ASSIGNCOPY(path, aPath);
+  return self;
+}
+
+- (DKProxy*)_proxy
+{
+  if (nil == proxy)
+  {
+    DKProxy *newProxy = [[DKProxy alloc] initWithEndpoint: endpoint
+                                               andService: service
+                                                  andPath: path];
+    if (NO == __sync_bool_compare_and_swap(&proxy, nil, newProxy))
+    {
+      [newProxy release];
+    }
+  }
+  return proxy;
+}
+
+- (DKEndpoint*)_endpoint
+{
+  return endpoint;
+}
+
+- (NSString*)_service
+{
+  return service;
+}
+
+- (NSString*)_path
+{
+  return path;
+}
+
+- (DKPort*)_port
+{
+  if (nil != proxy)
+  {
+    return [proxy _port];
+  }
+  if (nil == port)
+  {
+    DKPort *newPort = [[DKPort alloc] initWithRemote: service
+                                          atEndpoint: endpoint];
+    if (NO == __sync_bool_compare_and_swap(&port, nil, newPort))
+    {
+      [newPort release];
+    }
+  }
+  return port;
+}
+
+- (BOOL)_isLocal
+{
+  return NO;
+}
+
+- (BOOL)hasSameScopeAs: (DKProxy*)aProxy
+{
+  return [[self _port] isEqual: [aProxy _port]];
+}
+
+- (DKProxy*)proxyParent
+{
+  return [self _proxy];
+}
+
+- (BOOL)isKindOfClass: (Class)aClass
+{
+  // We stand in for a DKProxy.
+  if ([DKProxy class] == aClass)
+  {
+    return YES;
+  }
+  return [super isKindOfClass: aClass];
+}
+
+- (BOOL)conformsToProtocol: (Protocol*)aProto
+{
+  if (protocol_isEqual(@protocol(DKObjectPathNode), aProto))
+  {
+    return YES;
+  }
+  return [[self _proxy] conformsToProtocol: aProto];
+}
+
+- (BOOL)respondsToSelector: (SEL)aSelector
+{
+  if (class_respondsToSelector([DKLazyProxy class], aSelector))
+  {
+    return YES;
+  }
+  return [[self _proxy] respondsToSelector: aSelector];
+}
+
+- (NSMethodSignature*)methodSignatureForSelector: (SEL)aSelector
+{
+  return [[self _proxy] methodSignatureForSelector: aSelector];
+}
+
+- (void)forwardInvocation: (NSInvocation*)inv
+{
+  [inv invokeWithTarget: [self _proxy]];
+}
+
+- (BOOL)isEqual: (id)other
+{
+  if (other == self)
+  {
+    return YES;
+  }
+  if ((nil == other) || (NO == [other isKindOfClass: [DKProxy class]]))
+  {
+    return NO;
+  }
+  if ([other isProxy] && (NO == [other respondsToSelector: @selector(_path)]))
+  {
+    return NO;
+  }
+  return ([path isEqualToString: [other _path]]
+    && [service isEqualToString: [other _service]]
+    && [endpoint isEqual: [other _endpoint]]);
+}
+
+- (NSUInteger)hash
+{
+  return [path hash];
+}
+
+- (NSString*)description
+{
+  return [NSString stringWithFormat: @"<%@ %p: %@ at %@>",
+    NSStringFromClass([self class]), self, path, service];
+}
+
+- (void)dealloc
+{
+  [endpoint release];
+  [service release];
+  [path release];
+  [port release];
+  [proxy release];
+  DKCountDeallocation(DKAllocationLazyProxy);
+  [super dealloc];
+}
+@end
@@ -125,7 +125,7 @@
                   format: @"Out of memory when sending D-Bus message"];
     }
   }
-
+  [endpoint noteOutgoingMessage: msg];
 }
 
 - (DBusMessage*) DBusMessage
@@ -0,0 +1,80 @@
+/** Interface for recording and reading back raw D-Bus traffic.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/NSObject.h>
+#include <dbus/dbus.h>
+#include <stdint.h>
+#include <stdio.h>
+
+@class NSLock, NSString;
+
+/*
+ * Capture files start with an eight byte magic string and contain one record
+ * per message. Each record consists of a 16 byte header (the timestamp in
+ * nanoseconds since the capture started as a 64bit integer, the direction as a
+ * 32bit integer and the length of the message as a 32bit integer, all in host
+ * byte order) followed by the message in D-Bus wire format, as produced by
+ * dbus_message_marshal().
+ */
+
+/**
+ * DKMessageCapture writes the messages sent and received by an endpoint to a
+ * capture file, or reads them back from one. Recording is thread-safe.
+ */
+@interface DKMessageCapture: NSObject
+{
+  FILE *file;
+  NSLock *lock;
+  uint64_t startTime;
+  BOOL isWriting;
+}
+
+/**
+ * Creates (or truncates) the capture file at <var>path</var> for recording.
+ * Returns nil if the file cannot be opened.
+ */
+- (id)initForWritingAtPath: (NSString*)path;
+
+/**
+ * Opens the capture file at <var>path</var> for reading. Returns nil if the
+ * file cannot be opened or is not a capture file.
+ */
+- (id)initForReadingAtPath: (NSString*)path;
+
+/**
+ * Appends <var>msg</var> to the capture.
+ */
+- (void)recordMessage: (DBusMessage*)msg
+             outgoing: (BOOL)isOutgoing;
+
+/**
+ * Returns the next message from the capture, or NULL at the end of the file.
+ * The caller owns a reference to the returned message. If non-NULL,
+ * <var>isOutgoing</var> and <var>timestamp</var> are set to the direction and
+ * capture time (in nanoseconds) of the message.
+ */
+- (DBusMessage*)nextMessageOutgoing: (BOOL*)isOutgoing
+                          timestamp: (uint64_t*)timestamp;
+
+/**
+ * Flushes and closes the capture file. Further messages are ignored.
+ */
+- (void)close;
+@end
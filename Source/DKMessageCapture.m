@@ -0,0 +1,189 @@
+/** Implementation of DKMessageCapture for recording raw D-Bus traffic.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import "DKMessageCapture.h"
+
+#import <Foundation/NSLock.h>
+#import <Foundation/NSString.h>
+
+#ifndef DARLING
+#import <GNUstepBase/NSDebug+GNUstepBase.h>
+#else
+#import "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DKCaptureMagic "DKCAP001"
+#define DKCaptureMagicLength 8
+
+typedef struct
+{
+  uint64_t timestamp;
+  uint32_t direction;
+  uint32_t length;
+} DKCaptureRecordHeader;
+
+static uint64_t
+DKCaptureNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+@implementation DKMessageCapture
+
+- (id)initForWritingAtPath: (NSString*)path
+{
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  file = fopen([path fileSystemRepresentation], "wb");
+  if ((NULL == file)
+    || (1 != fwrite(DKCaptureMagic, DKCaptureMagicLength, 1, file)))
+  {
+    NSWarnMLog(@"Could not open capture file %@", path);
+    [self release];
+    return nil;
+  }
+  lock = [NSLock new];
+  startTime = DKCaptureNow();
+  isWriting = YES;
+  return self;
+}
+
+- (id)initForReadingAtPath: (NSString*)path
+{
+  char magic[DKCaptureMagicLength];
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  file = fopen([path fileSystemRepresentation], "rb");
+  if ((NULL == file)
+    || (1 != fread(magic, DKCaptureMagicLength, 1, file))
+    || (0 != memcmp(magic, DKCaptureMagic, DKCaptureMagicLength)))
+  {
+    NSWarnMLog(@"%@ is not a D-Bus capture file", path);
+    [self release];
+    return nil;
+  }
+  lock = [NSLock new];
+  return self;
+}
+
+- (void)recordMessage: (DBusMessage*)msg
+             outgoing: (BOOL)isOutgoing
+{
+  char *buffer = NULL;
+  int length = 0;
+  DKCaptureRecordHeader header;
+  if ((NULL == msg) || (NO == isWriting))
+  {
+    return;
+  }
+  if (NO == dbus_message_marshal(msg, &buffer, &length))
+  {
+    return;
+  }
+  header.timestamp = DKCaptureNow() - startTime;
+  header.direction = isOutgoing ? 1 : 0;
+  header.length = (uint32_t)length;
+  [lock lock];
+  if (NULL != file)
+  {
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(buffer, (size_t)length, 1, file);
+  }
+  [lock unlock];
+  dbus_free(buffer);
+}
+
+- (DBusMessage*)nextMessageOutgoing: (BOOL*)isOutgoing
+                          timestamp: (uint64_t*)timestamp
+{
+  DKCaptureRecordHeader header;
+  char *buffer = NULL;
+  DBusMessage *msg = NULL;
+  DBusError err;
+  if ((NULL == file) || isWriting)
+  {
+    return NULL;
+  }
+  [lock lock];
+  if (1 != fread(&header, sizeof(header), 1, file))
+  {
+    [lock unlock];
+    return NULL;
+  }
+  buffer = malloc(header.length);
+  if ((NULL == buffer)
+    || (1 != fread(buffer, header.length, 1, file)))
+  {
+    [lock unlock];
+    free(buffer);
+    NSWarnMLog(@"Truncated record in capture file");
+    return NULL;
+  }
+  [lock unlock];
+
+  dbus_error_init(&err);
+  msg = dbus_message_demarshal(buffer, (int)header.length, &err);
+  free(buffer);
+  if (NULL == msg)
+  {
+    NSWarnMLog(@"Invalid message in capture file: %s", err.message);
+    dbus_error_free(&err);
+    return NULL;
+  }
+  if (NULL != isOutgoing)
+  {
+    *isOutgoing = (0 != header.direction);
+  }
+  if (NULL != timestamp)
+  {
+    *timestamp = header.timestamp;
+  }
+  return msg;
+}
+
+- (void)close
+{
+  [lock lock];
+  if (NULL != file)
+  {
+    fclose(file);
+    file = NULL;
+  }
+  isWriting = NO;
+  [lock unlock];
+}
+
+- (void)dealloc
+{
+  [self close];
+  [lock release];
+  [super dealloc];
+}
+@end
@@ -23,6 +23,7 @@
    */
 
 #import "DKIntrospectionNode.h"
+#import <Foundation/NSDate.h>
 
 #define INCLUDE_RUNTIME_H
 #import "config.h"
@@ -52,6 +53,28 @@ enum
 {
   NSMutableArray *inArgs;
   NSMutableArray *outArgs;
+
+  /*
+   * Result cache settings made at runtime, which take precedence over the
+   * annotations. They are protected by a lock shared by all methods.
+   */
+  NSTimeInterval cacheTTL;
+  NSString *cacheInvalidationSignal;
+  BOOL hasCacheSettings;
+
+  /*
+   * Published result of -resultCacheTTL: 0 if not yet determined, 1 if
+   * results are not cached, 2 if they are. It is reset whenever the settings
+   * or annotations change and allows calls to methods whose results are not
+   * cached to skip the lock.
+   */
+  volatile int cacheState;
+
+  /*
+   * Cached result of -isIdempotent: 0 if not yet determined, 1 if the method
+   * is not idempotent, 2 if it is.
+   */
+  int idempotency;
 }
 
 /**
@@ -149,6 +172,39 @@ enum
  */
 - (BOOL) isOneway;
 
+/**
+ * Returns whether calling the method has no side effects, so that identical
+ * calls that are in flight at the same time can share one reply. This is the
+ * case for query methods of the standard org.freedesktop.DBus interfaces
+ * (e.g. GetNameOwner, Introspect or the property getters) and for methods
+ * carrying the <code>org.gnustep.dbuskit.Idempotent</code> annotation with the
+ * value "true".
+ */
+- (BOOL) isIdempotent;
+
+/**
+ * Returns the number of seconds for which results of the method may be served
+ * from the client-side result cache, as specified by the
+ * <code>org.gnustep.dbuskit.CacheTTL</code> annotation. Returns 0 (meaning
+ * that results are not cached) if the method does not carry the annotation.
+ */
+- (NSTimeInterval) resultCacheTTL;
+
+/**
+ * Returns the name of the signal that invalidates cached results of the
+ * method, as specified by the <code>org.gnustep.dbuskit.CacheInvalidatedBy</code>
+ * annotation. The name can be qualified with an interface name, otherwise the
+ * signal is expected on the interface of the method.
+ */
+- (NSString*) resultCacheInvalidationSignal;
+
+/**
+ * Overrides the result cache annotations of the method. This can safely be
+ * called while the method is being used from other threads.
+ */
+- (void) setResultCacheTTL: (NSTimeInterval)ttl
+        invalidationSignal: (NSString*)signal;
+
 /**
  * Returns whether D-Bus metadata indicates that the method has been deprecated.
  */
@@ -26,12 +26,15 @@
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
 #import <Foundation/NSInvocation.h>
+#import <Foundation/NSLock.h>
 #import <Foundation/NSMethodSignature.h>
 #import <Foundation/NSNull.h>
+#import <Foundation/NSSet.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSXMLNode.h>
 #import <Foundation/NSKeyValueCoding.h>
 
+#import "DKAllocationCounters.h"
 #import "DKArgument.h"
 #import "DKMethod.h"
 #import "DKBoxingUtils.h"
@@ -53,8 +56,51 @@
 #include <inttypes.h>
 
 
+/*
+ * Methods of the standard interfaces that only query state, so that identical
+ * calls issued at the same time can share a single reply.
+ */
+static NSSet *builtInIdempotentMethods;
+
+/*
+ * Protects the result cache settings of all methods.
+ */
+static NSLock *cacheSettingsLock;
+
 @implementation DKMethod
 
++ (void)initialize
+{
+  if ([DKMethod class] == self)
+  {
+    cacheSettingsLock = [NSLock new];
+    builtInIdempotentMethods = [[NSSet alloc] initWithObjects:
+      @"org.freedesktop.DBus.GetId",
+      @"org.freedesktop.DBus.GetNameOwner",
+      @"org.freedesktop.DBus.NameHasOwner",
+      @"org.freedesktop.DBus.ListNames",
+      @"org.freedesktop.DBus.ListActivatableNames",
+      @"org.freedesktop.DBus.ListQueuedOwners",
+      @"org.freedesktop.DBus.GetConnectionUnixUser",
+      @"org.freedesktop.DBus.GetConnectionUnixProcessID",
+      @"org.freedesktop.DBus.GetConnectionCredentials",
+      @"org.freedesktop.DBus.Introspectable.Introspect",
+      @"org.freedesktop.DBus.Peer.GetMachineId",
+      @"org.freedesktop.DBus.Properties.Get",
+      @"org.freedesktop.DBus.Properties.GetAll",
+      nil];
+  }
+}
+
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationMethod);
+  }
+  return obj;
+}
 
 + (id)methodWithObjCSelector: (SEL)theSel
                        types: (const char*)types
@@ -213,7 +259,7 @@
   for (int i = 0; i < argCount; i++)
   {
     CXCursor arg = clang_Cursor_getArgument(cursor, i);
-    CXString aName = clang_getCursorSpelling(cursor);
+    CXString aName = clang_getCursorSpelling(arg);
     NSString *argName = [NSString stringWithUTF8String: clang_getCString(aName)];
     clang_disposeString(aName);
     DKArgument *thisArg = [[DKArgument alloc] initWithCXType: clang_getCursorType(arg)
@@ -225,6 +271,7 @@
     }
     [theMethod addArgument: thisArg
                  direction: kDKArgumentDirectionIn];
+    [thisArg release];
   }
   return theMethod;
 }
@@ -512,6 +559,106 @@
   return [[annotations valueForKey: @"org.freedesktop.DBus.Method.NoReply"] isEqualToString: @"true"];
 }
 
+- (NSTimeInterval) resultCacheTTL
+{
+  NSTimeInterval value = 0;
+  if (1 == cacheState)
+  {
+    return 0;
+  }
+  [cacheSettingsLock lock];
+  if (hasCacheSettings)
+  {
+    value = cacheTTL;
+  }
+  else
+  {
+    id ttl = [annotations valueForKey: @"org.gnustep.dbuskit.CacheTTL"];
+    if ([ttl isKindOfClass: [NSString class]])
+    {
+      value = MAX([ttl doubleValue], 0);
+    }
+  }
+  cacheState = (value > 0) ? 2 : 1;
+  [cacheSettingsLock unlock];
+  return value;
+}
+
+- (NSString*) resultCacheInvalidationSignal
+{
+  id signal = nil;
+  [cacheSettingsLock lock];
+  if (hasCacheSettings)
+  {
+    signal = [[cacheInvalidationSignal retain] autorelease];
+    [cacheSettingsLock unlock];
+    return signal;
+  }
+  [cacheSettingsLock unlock];
+  signal = [annotations valueForKey: @"org.gnustep.dbuskit.CacheInvalidatedBy"];
+  if ([signal isKindOfClass: [NSString class]] && (0 != [signal length]))
+  {
+    return signal;
+  }
+  return nil;
+}
+
+- (void) setResultCacheTTL: (NSTimeInterval)ttl
+        invalidationSignal: (NSString*)signal
+{
+  if (0 == [signal length])
+  {
+    signal = nil;
+  }
+  [cacheSettingsLock lock];
+  cacheTTL = MAX(ttl, 0);
+  ASSIGNCOPY(cacheInvalidationSignal, signal);
+  hasCacheSettings = YES;
+  cacheState = 0;
+  [cacheSettingsLock unlock];
+}
+
+- (BOOL) _determineIdempotency
+{
+  NSString *interface = nil;
+  if ([[annotations valueForKey: @"org.gnustep.dbuskit.Idempotent"] isEqualToString: @"true"])
+  {
+    return YES;
+  }
+  interface = [self interface];
+  if (NO == [interface hasPrefix: @"org.freedesktop.DBus"])
+  {
+    return NO;
+  }
+  return [builtInIdempotentMethods containsObject:
+    [NSString stringWithFormat: @"%@.%@", interface, name]];
+}
+
+- (BOOL) isIdempotent
+{
+  /*
+   * This is checked for every synchronous call, so the result is cached.
+   * Racing threads will compute the same value, hence no lock is needed.
+   */
+  if (0 == idempotency)
+  {
+    idempotency = [self _determineIdempotency] ? 2 : 1;
+  }
+  return (2 == idempotency);
+}
+
+- (void) setAnnotationValue: (id)value
+                     forKey: (NSString*)key
+{
+  [super setAnnotationValue: value
+                     forKey: key];
+  // The annotation might change whether the method is idempotent or cached:
+  idempotency = 0;
+  [cacheSettingsLock lock];
+  cacheState = 0;
+  [cacheSettingsLock unlock];
+}
+
 
 - (void) unmarshallReturnValueFromIterator: (DBusMessageIter*)iter
                             intoInvocation: (NSInvocation*)inv
@@ -934,6 +1081,11 @@
   [newNode setInArgs: newIn];
   [newOut release];
   [newIn release];
+  [cacheSettingsLock lock];
+  newNode->hasCacheSettings = hasCacheSettings;
+  newNode->cacheTTL = cacheTTL;
+  newNode->cacheInvalidationSignal = [cacheInvalidationSignal copy];
+  [cacheSettingsLock unlock];
   return newNode;
 }
 
@@ -987,6 +1139,8 @@
 {
   [inArgs release];
   [outArgs release];
+  [cacheInvalidationSignal release];
+  DKCountDeallocation(DKAllocationMethod);
   [super dealloc];
 }
 @end
@@ -23,7 +23,13 @@
 
 #import "DKMessage.h"
 #import <Foundation/NSDate.h>
-@class DKMethod, DKProxy, NSInvocation;
+@class DKMethod, DKProxy, NSException, NSInvocation, NSThread;
+
+/**
+ * Returns the exception that cancelled calls complete with.
+ */
+NSException*
+DKCallCancelledException(void);
 
 /**
  * The DKMethodCall can be used to call methods on a remote object.
@@ -45,8 +51,69 @@
    * The timeout for the call;
    */
    NSInteger timeout;
+
+  /**
+   * The pending call for asynchronous sends.
+   */
+   DBusPendingCall *pendingCall;
+
+  /**
+   * Object that will be notified when an asynchronous call completes.
+   */
+   id completionTarget;
+
+  /**
+   * The selector that will be performed on the <ivar>completionTarget</ivar>.
+   */
+   SEL completionSelector;
+
+  /**
+   * The thread the asynchronous call was sent from, completion will be
+   * delivered there.
+   */
+   NSThread *completionThread;
+
+  /**
+   * Exception raised while handling the reply to an asynchronous call.
+   */
+   NSException *exception;
+
+  /**
+   * Arbitrary data associated with the call by its sender.
+   */
+   id userInfo;
+
+  /**
+   * Flag to make sure that the reply will only be handled once.
+   */
+   BOOL replyHandled;
+
+  /**
+   * Set if the call was cancelled before its reply was handled.
+   */
+   BOOL isCancelled;
+
+  /**
+   * The coalesced call this call is waiting on, if any. Used by -cancel to
+   * wake the waiting thread.
+   */
+   id coalescedCall;
 }
 
+/**
+ * Enables or disables coalescing of synchronous calls to idempotent methods
+ * (see -[DKMethod isIdempotent]). While enabled (the default), a call that is
+ * identical to one already in flight on the same endpoint does not send a
+ * message of its own but waits for the reply to the earlier call.
+ */
++ (void)setCoalescesIdempotentCalls: (BOOL)flag;
+
+/**
+ * Cancels the synchronous call <var>thread</var> is currently waiting for.
+ * Returns NO if the thread is not waiting for a reply.
+ */
++ (BOOL)cancelSynchronousCallOnThread: (NSThread*)thread;
+
 /**
  * Initializes the method call to be sent to the object represented by the
  * proxy. This involves serializing the arguments from the invocation into D-Bus
@@ -67,6 +134,18 @@
               method: (DKMethod*)aMethod
           invocation: (NSInvocation*)anInvocation;
 
+/**
+ * Initializes the method call with a copy of <var>aMessage</var>, which must
+ * be a method call message for <var>aMethod</var> without arguments. This
+ * avoids validating the destination, path, interface and member names for
+ * every call, which is useful when the same method is called repeatedly.
+ */
+- (id) initWithProxy: (DKProxy*)aProxy
+              method: (DKMethod*)aMethod
+          invocation: (NSInvocation*)anInvocation
+     templateMessage: (DBusMessage*)aMessage
+             timeout: (NSTimeInterval)interval;
+
 /**
  * Sends the method call asynchronously via D-Bus. User code should retrieve
  * the DKPendingCall object corresponding to this method call in order to get
@@ -80,4 +159,51 @@
  * of the call is deserialized as the return value of the invocation.)
  */
 - (void)sendSynchronously;
+
+/**
+ * Sends the method call via D-Bus without waiting for the reply. Once the
+ * reply has been deserialized into the invocation (or the call failed),
+ * <var>selector</var> is performed on <var>target</var> with the method call as
+ * its argument. This happens on the thread that sent the call, which needs to
+ * be running its run loop in order for the notification to be delivered.
+ */
+- (void)sendAsynchronouslyWithTarget: (id)target
+                            selector: (SEL)selector;
+
+/**
+ * Cancels the call if its reply has not been handled yet: The pending call is
+ * cancelled on the worker thread and its resources are released without
+ * waiting for the timeout. A thread waiting in -sendSynchronously raises a
+ * <code>DKDBusCallCancelledException</code>, an asynchronous call completes
+ * with that exception. Identical calls that were waiting for the reply
+ * to a cancelled call are not affected: They send their own message instead.
+ * Returns NO if the call had already completed.
+ */
+- (BOOL)cancel;
+
+/**
+ * Returns whether the call was cancelled.
+ */
+- (BOOL)isCancelled;
+
+/**
+ * Returns the invocation the arguments and return value are stored in.
+ */
+- (NSInvocation*)invocation;
+
+/**
+ * Returns the exception that occurred while handling an asynchronous call, or
+ * nil if the call succeeded.
+ */
+- (NSException*)exception;
+
+/**
+ * Associates arbitrary data with the call.
+ */
+- (void)setUserInfo: (id)info;
+
+/**
+ * Returns the data associated with the call.
+ */
+- (id)userInfo;
 @end
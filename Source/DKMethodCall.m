@@ -22,15 +22,21 @@
    */
 
 #import "DKMethodCall.h"
+#import "DKAllocationCounters.h"
 #import "DKProxy+Private.h"
 #import "DKEndpoint.h"
 #import "DKEndpointManager.h"
 #import "DKMethod.h"
+#import "DKResultCache.h"
+#import "DKTrace.h"
 
+#import <Foundation/NSData.h>
 #import <Foundation/NSDate.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
 #import <Foundation/NSInvocation.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSMapTable.h>
 #import <Foundation/NSMethodSignature.h>
 #import <Foundation/NSRunLoop.h>
 #import <Foundation/NSString.h>
@@ -47,9 +53,217 @@
 
 @interface DKMethodCall (Private)
 - (BOOL) serialize;
+- (void) _pendingCallCompleted;
+- (void) _performSynchronously;
+- (id) _initWithProxy: (DKProxy*)aProxy
+               method: (DKMethod*)aMethod
+           invocation: (NSInvocation*)anInvocation
+              message: (DBusMessage*)theMessage
+              timeout: (NSTimeInterval)aTimeout;
 @end
 
+/*
+ * Called by libdbus (on the worker thread) once the reply to an asynchronous
+ * call has arrived or the call timed out.
+ */
+static void
+DKMethodCallNotify(DBusPendingCall *pending, void *data)
+{
+  [(DKMethodCall*)data _pendingCallCompleted];
+}
+
+static void
+DKMethodCallRelease(void *data)
+{
+  [(id)data release];
+}
+
+NSException*
+DKCallCancelledException(void)
+{
+  return [NSException exceptionWithName: @"DKDBusCallCancelledException"
+                                 reason: @"The D-Bus method call was cancelled."
+                               userInfo: nil];
+}
+
+/*
+ * A call to an idempotent method that is in flight. Threads issuing an
+ * identical call while it is in flight wait for its reply instead of sending
+ * their own message.
+ */
+@interface DKCoalescedCall: NSObject
+{
+  NSCondition *condition;
+  DBusMessage *reply;
+  NSException *exception;
+  BOOL isComplete;
+}
+- (void)completeWithReply: (DBusMessage*)aReply
+                exception: (NSException*)anException;
+- (DBusMessage*)waitForReplyToCall: (DKMethodCall*)call;
+- (void)wakeWaiters;
+@end
+
+@implementation DKCoalescedCall
+- (id)init
+{
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  condition = [NSCondition new];
+  return self;
+}
+
+- (void)completeWithReply: (DBusMessage*)aReply
+                exception: (NSException*)anException
+{
+  [condition lock];
+  if (NULL != aReply)
+  {
+    reply = dbus_message_ref(aReply);
+  }
+  ASSIGN(exception, anException);
+  isComplete = YES;
+  [condition broadcast];
+  [condition unlock];
+}
+
+/**
+ * Blocks until the call completes and returns the reply with a reference owned
+ * by the caller, or raises the exception the call failed with. Returns NULL if
+ * the call completed without reply or exception because its leader was
+ * cancelled, in which case the caller needs to send its own message. Stops
+ * waiting if <var>call</var> is cancelled.
+ */
+- (DBusMessage*)waitForReplyToCall: (DKMethodCall*)call
+{
+  [condition lock];
+  while ((NO == isComplete) && (NO == [call isCancelled]))
+  {
+    [condition wait];
+  }
+  [condition unlock];
+  if (NO == isComplete)
+  {
+    [DKCallCancelledException() raise];
+  }
+  if (NULL == reply)
+  {
+    [exception raise];
+    return NULL;
+  }
+  return dbus_message_ref(reply);
+}
+
+/**
+ * Wakes the threads waiting for the call, so that they notice if the call
+ * they are waiting for has been cancelled.
+ */
+- (void)wakeWaiters
+{
+  [condition lock];
+  [condition broadcast];
+  [condition unlock];
+}
+
+- (void)dealloc
+{
+  if (NULL != reply)
+  {
+    dbus_message_unref(reply);
+  }
+  [exception release];
+  [condition release];
+  [super dealloc];
+}
+@end
+
+static NSMutableDictionary *coalescedCalls;
+static NSLock *coalescedCallsLock;
+static BOOL coalescesIdempotentCalls = YES;
+
+/*
+ * Maps threads to the synchronous call they are waiting for, so that the call
+ * can be cancelled from another thread.
+ */
+static NSMapTable *synchronousCalls;
+static NSLock *synchronousCallsLock;
+
+static void
+DKSetSynchronousCall(NSThread *thread, DKMethodCall *call)
+{
+  [synchronousCallsLock lock];
+  if (nil == call)
+  {
+    NSMapRemove(synchronousCalls, thread);
+  }
+  else
+  {
+    NSMapInsert(synchronousCalls, thread, call);
+  }
+  [synchronousCallsLock unlock];
+}
+
+/*
+ * Removes the shared call from the table, so that calls issued from now on
+ * will send a new message, and hands the reply to the waiting threads.
+ */
+static void
+DKFinishCoalescedCall(DKCoalescedCall *shared, NSData *key,
+  DBusMessage *reply, NSException *exception)
+{
+  [coalescedCallsLock lock];
+  if ([coalescedCalls objectForKey: key] == shared)
+  {
+    [coalescedCalls removeObjectForKey: key];
+  }
+  [coalescedCallsLock unlock];
+  [shared completeWithReply: reply
+                  exception: exception];
+}
+
 @implementation DKMethodCall
+
++ (void)initialize
+{
+  if ([DKMethodCall class] == self)
+  {
+    coalescedCalls = [NSMutableDictionary new];
+    coalescedCallsLock = [NSLock new];
+    synchronousCalls = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+      NSNonOwnedPointerMapValueCallBacks, 8);
+    synchronousCallsLock = [NSLock new];
+  }
+}
+
++ (void)setCoalescesIdempotentCalls: (BOOL)flag
+{
+  coalescesIdempotentCalls = flag;
+}
+
++ (BOOL)cancelSynchronousCallOnThread: (NSThread*)thread
+{
+  DKMethodCall *call = nil;
+  BOOL didCancel = NO;
+  [synchronousCallsLock lock];
+  call = [(DKMethodCall*)NSMapGet(synchronousCalls, thread) retain];
+  [synchronousCallsLock unlock];
+  didCancel = [call cancel];
+  [call release];
+  return didCancel;
+}
+
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationMethodCall);
+  }
+  return obj;
+}
+
 - (id) initWithProxy: (DKProxy*)aProxy
               method: (DKMethod*)aMethod
           invocation: (NSInvocation*)anInvocation
@@ -65,7 +279,6 @@
              timeout: (NSTimeInterval)aTimeout
 {
   DBusMessage *theMessage = NULL;
-  DKEndpoint *theEndpoint = [aProxy _endpoint];
   const char* dest = [[aProxy _service] UTF8String];
   const char* path = [[aProxy _path] UTF8String];
   const char* interface = [[aMethod interface] UTF8String];
@@ -85,22 +298,64 @@
     [self release];
     return nil;
   }
+  self = [self _initWithProxy: aProxy
+                       method: aMethod
+                   invocation: anInvocation
+                      message: theMessage
+                      timeout: aTimeout];
+  dbus_message_unref(theMessage);
+  return self;
+}
+
+- (id) initWithProxy: (DKProxy*)aProxy
+              method: (DKMethod*)aMethod
+          invocation: (NSInvocation*)anInvocation
+     templateMessage: (DBusMessage*)aMessage
+             timeout: (NSTimeInterval)aTimeout
+{
+  DBusMessage *theMessage = NULL;
+  if ((((nil == aProxy) || (nil == aMethod)) || (nil == anInvocation))
+    || (NULL == aMessage))
+  {
+    [self release];
+    return nil;
+  }
+  theMessage = dbus_message_copy(aMessage);
+  if (NULL == theMessage)
+  {
+    [self release];
+    return nil;
+  }
+  self = [self _initWithProxy: aProxy
+                       method: aMethod
+                   invocation: anInvocation
+                      message: theMessage
+                      timeout: aTimeout];
+  dbus_message_unref(theMessage);
+  return self;
+}
 
+/**
+ * Common initialization for both initializers. The message is not consumed.
+ */
+- (id) _initWithProxy: (DKProxy*)aProxy
+               method: (DKMethod*)aMethod
+           invocation: (NSInvocation*)anInvocation
+              message: (DBusMessage*)theMessage
+              timeout: (NSTimeInterval)aTimeout
+{
   /*
    * Initialize the superclass. Since we need the DBusPendingCall, we cannot use
-   * the resource preallocation feature. The superclass takes owenership of the
-   * DBusMessage.
+   * the resource preallocation feature. The superclass keeps its own reference
+   * to the DBusMessage.
    */
   if (nil == (self = [super initWithDBusMessage: theMessage
-                                    forEndpoint: theEndpoint
+                                    forEndpoint: [aProxy _endpoint]
                            preallocateResources: NO]))
   {
-    dbus_message_unref(theMessage);
     return nil;
   }
 
-  dbus_message_unref(theMessage);
-
   ASSIGN(invocation,anInvocation);
   ASSIGN(method,aMethod);
   if (0 == aTimeout)
@@ -108,12 +363,14 @@
     // Default timeout
     timeout = -1;
   }
-
-  /*
-   * Convert NSTimeInterval (seconds, floating point) into D-Bus representation
-   * (milliseconds, integer).
-   */
-  timeout = (NSInteger)(aTimeout * 1000.0);
+  else
+  {
+    /*
+     * Convert NSTimeInterval (seconds, floating point) into D-Bus
+     * representation (milliseconds, integer).
+     */
+    timeout = (NSInteger)(aTimeout * 1000.0);
+  }
 
   if (NO == [self serialize])
   {
@@ -129,6 +386,7 @@
   DBusMessageIter iter;
 
   dbus_message_iter_init_append(msg, &iter);
+  DKTrace(DKTraceMarshalBegin, [[method name] UTF8String], 0);
   NS_DURING
   {
     [method marshallFromInvocation: invocation
@@ -142,6 +400,7 @@
     didSucceed = NO;
   }
   NS_ENDHANDLER
+  DKTrace(DKTraceMarshalEnd, [[method name] UTF8String], 0);
   return didSucceed;
 }
 - (BOOL)hasObjectReturn
@@ -153,6 +412,29 @@
                              async: (BOOL)didAsyncOperation
 {
   DBusMessage *reply = dbus_pending_call_steal_reply(pending);
+  if (NULL == reply)
+  {
+    [NSException raise: @"DKDBusMethodReplyException"
+                format: @"Could not obtain reply for pending D-Bus method call."];
+  }
+  [endpoint noteReply: reply];
+  NS_DURING
+  {
+    [self handleReply: reply
+                async: didAsyncOperation];
+  }
+  NS_HANDLER
+  {
+    dbus_message_unref(reply);
+    [localException raise];
+  }
+  NS_ENDHANDLER
+  dbus_message_unref(reply);
+}
+
+- (void)handleReply: (DBusMessage*)reply
+              async: (BOOL)didAsyncOperation
+{
   int msgType;
   DBusError error;
   NSException *errorException = nil;
@@ -164,12 +446,6 @@
   NSAssert(!(didAsyncOperation && (NO == [self hasObjectReturn])),
     @"Filling asynchronous return values for non-objects is impossible.");
 
-  if (NULL == reply)
-  {
-    [NSException raise: @"DKDBusMethodReplyException"
-                format: @"Could not obtain reply for pending D-Bus method call."];
-  }
-
   msgType = dbus_message_get_type(reply);
 
   // Only accept error messages or method replies:
@@ -249,13 +525,16 @@
     // unmarshall.
     if (YES == (BOOL)dbus_message_iter_init(reply, &iter))
     {
+      DKTrace(DKTraceUnmarshalBegin, [[method name] UTF8String], 0);
       [method unmarshallFromIterator: &iter
                       intoInvocation: invocation
                          messageType: DBUS_MESSAGE_TYPE_METHOD_RETURN];
+      DKTrace(DKTraceUnmarshalEnd, [[method name] UTF8String], 0);
     }
   }
   NS_HANDLER
   {
+    DKTrace(DKTraceUnmarshalEnd, [[method name] UTF8String], 0);
     errorException = localException;
   }
   NS_ENDHANDLER
@@ -289,11 +568,15 @@
  */
 - (BOOL)sendWithPendingCallAt: (DBusPendingCall**)pending
 {
-  return (BOOL)dbus_connection_send_with_reply([endpoint DBusConnection],
+  BOOL didSend = (BOOL)dbus_connection_send_with_reply([endpoint DBusConnection],
     msg,
     pending,
     timeout);
-
+  if (didSend)
+  {
+    [endpoint noteOutgoingMessage: msg];
+  }
+  return didSend;
 }
 - (void)sendAsynchronously
 {
@@ -307,14 +590,213 @@
   //TODO: Implement asynchronous behaviour.
 }
 
-- (void)sendSynchronously
+- (void)sendAsynchronouslyWithTarget: (id)target
+                            selector: (SEL)selector
+{
+  ASSIGN(completionTarget, target);
+  completionSelector = selector;
+  ASSIGN(completionThread, [NSThread currentThread]);
+  DKTrace(DKTraceAsyncCallBegin, [[method name] UTF8String], (uintptr_t)self);
+  [[DKEndpointManager sharedEndpointManager] boolReturnForPerformingSelector: @selector(_sendAsynchronously:)
+                                                                      target: self
+                                                                        data: NULL
+                                                               waitForReturn: NO];
+}
+
+/**
+ * Performs the completion selector on the target. Will be called on the thread
+ * that sent the call.
+ */
+- (void)_deliverCompletion: (id)ignored
+{
+  id target = completionTarget;
+  completionTarget = nil;
+  if ((nil != target) && (0 != completionSelector))
+  {
+    [target performSelector: completionSelector
+                 withObject: self];
+  }
+  [target release];
+}
+
+- (void)_scheduleCompletion
+{
+  DKTrace(DKTraceAsyncCallEnd, [[method name] UTF8String], (uintptr_t)self);
+  if ((nil == completionThread)
+    || [completionThread isEqual: [NSThread currentThread]]
+    || (NO == [completionThread isExecuting]))
+  {
+    [self _deliverCompletion: nil];
+  }
+  else
+  {
+    [self performSelector: @selector(_deliverCompletion:)
+                 onThread: completionThread
+               withObject: nil
+            waitUntilDone: NO];
+  }
+}
+
+/**
+ * Sends the message and installs the completion callback. Runs on the worker
+ * thread.
+ */
+- (BOOL)_sendAsynchronously: (id)ignored
 {
   DBusPendingCall *pending = NULL;
+  if (isCancelled)
+  {
+    // -cancel has already delivered the completion.
+    return NO;
+  }
+  if ((NO == [self sendWithPendingCallAt: &pending]) || (NULL == pending))
+  {
+    ASSIGN(exception, [NSException exceptionWithName: @"DKDBusDisconnectedException"
+                                              reason: @"Could not send D-Bus message."
+                                            userInfo: nil]);
+    [self _scheduleCompletion];
+    return NO;
+  }
+  pendingCall = pending;
+  dbus_pending_call_set_notify(pendingCall,
+    DKMethodCallNotify,
+    (void*)[self retain],
+    DKMethodCallRelease);
+
+  // The reply might have arrived before we installed the callback:
+  if (dbus_pending_call_get_completed(pendingCall))
+  {
+    [self _pendingCallCompleted];
+  }
+  return YES;
+}
+
+- (void)_pendingCallCompleted
+{
+  DBusPendingCall *pending = NULL;
+  if (NO == __sync_bool_compare_and_swap(&replyHandled, NO, YES))
+  {
+    return;
+  }
+  pending = __sync_lock_test_and_set(&pendingCall, NULL);
+
+  // Keep ourselves alive, libdbus will drop its reference when we are done.
+  [[self retain] autorelease];
+  if (NULL != msg)
+  {
+    dbus_message_unref(msg);
+    msg = NULL;
+  }
+  NS_DURING
+  {
+    [self handleReplyFromPendingCall: pending
+                               async: NO];
+  }
+  NS_HANDLER
+  {
+    ASSIGN(exception, localException);
+  }
+  NS_ENDHANDLER
+  dbus_pending_call_unref(pending);
+  [self _scheduleCompletion];
+}
+
+/**
+ * Cancels the pending call and drops the reference to it. Runs on the worker
+ * thread.
+ */
+- (BOOL)_discardPendingCall: (id)ignored
+{
+  DBusPendingCall *pending = __sync_lock_test_and_set(&pendingCall, NULL);
+  if (NULL == pending)
+  {
+    return NO;
+  }
+  dbus_pending_call_cancel(pending);
+  dbus_pending_call_unref(pending);
+  return YES;
+}
+
+- (BOOL)cancel
+{
+  DKCoalescedCall *shared = nil;
+  if (NO == __sync_bool_compare_and_swap(&replyHandled, NO, YES))
+  {
+    return NO;
+  }
+  isCancelled = YES;
+  [coalescedCallsLock lock];
+  shared = [coalescedCall retain];
+  [coalescedCallsLock unlock];
+  [shared wakeWaiters];
+  [shared release];
+  if (nil != completionThread)
+  {
+    ASSIGN(exception, DKCallCancelledException());
+    [self _scheduleCompletion];
+  }
+  [[DKEndpointManager sharedEndpointManager] boolReturnForPerformingSelector: @selector(_discardPendingCall:)
+                                                                      target: self
+                                                                        data: NULL
+                                                               waitForReturn: NO];
+  return YES;
+}
+
+- (BOOL)isCancelled
+{
+  return isCancelled;
+}
+
+/**
+ * Marks the reply to a synchronous call as handled. Raises if the call has
+ * been cancelled.
+ */
+- (void)_claimReply
+{
+  if (NO == __sync_bool_compare_and_swap(&replyHandled, NO, YES))
+  {
+    [DKCallCancelledException() raise];
+  }
+}
+
+- (NSInvocation*)invocation
+{
+  return invocation;
+}
+
+- (NSException*)exception
+{
+  return exception;
+}
+
+- (void)setUserInfo: (id)info
+{
+  ASSIGN(userInfo, info);
+}
+
+- (id)userInfo
+{
+  return userInfo;
+}
+
+/**
+ * Sends the message and waits for the reply, which is returned with a
+ * reference owned by the caller.
+ */
+- (DBusMessage*)_sendAndWaitForReply
+{
+  DBusPendingCall *pending = NULL;
+  DBusPendingCall *published = NULL;
+  DBusMessage *reply = NULL;
   // -1 means default timeout
   BOOL couldSend = NO;
   NSInteger count = 0;
   DKEndpointManager *manager = [DKEndpointManager sharedEndpointManager];
   IMP isSynchronizing = [manager methodForSelector: @selector(isSynchronizing)];
+  if (isCancelled)
+  {
+    [DKCallCancelledException() raise];
+  }
   couldSend = [manager boolReturnForPerformingSelector: @selector(sendWithPendingCallAt:)
                                                 target: self
                                                   data: (void*)&pending
@@ -333,6 +815,8 @@
 
   }
 
+  // Make the pending call available to -cancel:
+  __sync_lock_test_and_set(&pendingCall, dbus_pending_call_ref(pending));
   do
   {
     // Determine wether the manager is in synchronized mode and we need to use
@@ -352,7 +836,256 @@
       // Otherwise, we need to the runloop to complete our request.
       [[NSRunLoop currentRunLoop] runUntilDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
     }
-  } while (NO == (BOOL)dbus_pending_call_get_completed(pending));
+  } while ((NO == replyHandled)
+    && (NO == (BOOL)dbus_pending_call_get_completed(pending)));
+
+  if (NO == __sync_bool_compare_and_swap(&replyHandled, NO, YES))
+  {
+    /*
+     * The call was cancelled. -cancel might have run before the pending call
+     * was available, so we make sure it gets discarded.
+     */
+    dbus_pending_call_unref(pending);
+    [manager boolReturnForPerformingSelector: @selector(_discardPendingCall:)
+                                      target: self
+                                        data: NULL
+                               waitForReturn: NO];
+    [DKCallCancelledException() raise];
+  }
+  published = __sync_lock_test_and_set(&pendingCall, NULL);
+  if (NULL != published)
+  {
+    dbus_pending_call_unref(published);
+  }
+  reply = dbus_pending_call_steal_reply(pending);
+  dbus_pending_call_unref(pending);
+  if (NULL == reply)
+  {
+    [NSException raise: @"DKDBusMethodReplyException"
+                format: @"Could not obtain reply for pending D-Bus method call."];
+  }
+  [endpoint noteReply: reply];
+  return reply;
+}
+
+/**
+ * Returns the key identifying identical calls (for coalescing and result
+ * caching): The endpoint followed by the message in wire format. The message is copied because marshalling locks it,
+ * which would prevent libdbus from assigning a serial when sending it.
+ */
+- (NSData*)_callKey
+{
+  DBusMessage *copy = dbus_message_copy(msg);
+  NSMutableData *key = nil;
+  char *buffer = NULL;
+  int length = 0;
+  if (NULL == copy)
+  {
+    return nil;
+  }
+  if (dbus_message_marshal(copy, &buffer, &length))
+  {
+    key = [NSMutableData dataWithBytes: &endpoint
+                                length: sizeof(endpoint)];
+    [key appendBytes: buffer
+              length: (NSUInteger)length];
+    dbus_free(buffer);
+  }
+  dbus_message_unref(copy);
+  return key;
+}
+
+/**
+ * Returns the shared call that identical calls wait on, or nil if the call
+ * should not be coalesced. Sets <var>isLeader</var> to YES if the receiver is
+ * responsible for sending the message and completing the shared call.
+ */
+- (DKCoalescedCall*)_coalescedCallForKey: (NSData*)key
+                                isLeader: (BOOL*)isLeader
+{
+  DKCoalescedCall *shared = nil;
+  *isLeader = NO;
+  if (nil == key)
+  {
+    return nil;
+  }
+  [coalescedCallsLock lock];
+  shared = [coalescedCalls objectForKey: key];
+  if (nil == shared)
+  {
+    shared = [DKCoalescedCall new];
+    [coalescedCalls setObject: shared
+                       forKey: key];
+    *isLeader = YES;
+  }
+  else
+  {
+    [shared retain];
+  }
+  [coalescedCallsLock unlock];
+  return shared;
+}
+
+/**
+ * Waits for the reply to the coalesced call <var>shared</var>, which is
+ * published so that -cancel can wake the waiting thread.
+ */
+- (DBusMessage*)_waitForCoalescedCall: (DKCoalescedCall*)shared
+{
+  DBusMessage *reply = NULL;
+  [coalescedCallsLock lock];
+  coalescedCall = shared;
+  [coalescedCallsLock unlock];
+  NS_DURING
+  {
+    reply = [shared waitForReplyToCall: self];
+  }
+  NS_HANDLER
+  {
+    [coalescedCallsLock lock];
+    coalescedCall = nil;
+    [coalescedCallsLock unlock];
+    [localException raise];
+  }
+  NS_ENDHANDLER
+  [coalescedCallsLock lock];
+  coalescedCall = nil;
+  [coalescedCallsLock unlock];
+  return reply;
+}
+
+- (void)sendSynchronously
+{
+  NSThread *thread = [NSThread currentThread];
+  DKMethodCall *previous = nil;
+  [synchronousCallsLock lock];
+  previous = (DKMethodCall*)NSMapGet(synchronousCalls, thread);
+  [synchronousCallsLock unlock];
+  DKSetSynchronousCall(thread, self);
+  NS_DURING
+  {
+    [self _performSynchronously];
+  }
+  NS_HANDLER
+  {
+    DKSetSynchronousCall(thread, previous);
+    [localException raise];
+  }
+  NS_ENDHANDLER
+  DKSetSynchronousCall(thread, previous);
+}
+
+/**
+ * Returns the group the reply is cached in and makes sure that the signal
+ * invalidating the group is watched for before the call is sent, so that an
+ * invalidation cannot be missed while the call is in flight. Watching the
+ * signal has no effect once it is being watched.
+ */
+- (NSString*)_cacheGroupInCache: (DKResultCache*)cache
+{
+  NSString *group = [DKResultCache groupForMessage: msg
+                                          endpoint: endpoint];
+  NSString *signal = [method resultCacheInvalidationSignal];
+  if (nil != signal)
+  {
+    [cache invalidateGroup: group
+                  onSignal: signal
+                 interface: [method interface]
+                     proxy: [method proxyParent]];
+  }
+  return group;
+}
+
+- (void)_performSynchronously
+{
+  DKEndpointManager *manager = [DKEndpointManager sharedEndpointManager];
+  DKResultCache *cache = [DKResultCache sharedCache];
+  DBusMessage *reply = NULL;
+  DKCoalescedCall *shared = nil;
+  NSData *key = nil;
+  NSString *group = nil;
+  uint64_t generation = 0;
+  NSTimeInterval ttl = [method resultCacheTTL];
+  BOOL canCoalesce = NO;
+  BOOL isLeader = NO;
+  BOOL didSend = NO;
+  DKTrace(DKTraceCallBegin, [[method name] UTF8String], 0);
+
+  /*
+   * Waiting for another thread to receive the reply is only safe if the worker
+   * thread is processing the connection. Otherwise, the reply might only be
+   * received once the run loop of the waiting thread runs again.
+   */
+  canCoalesce = (coalescesIdempotentCalls
+    && [method isIdempotent]
+    && [manager isWorkerThreadRunning]
+    && (NO == [manager isSynchronizing])
+    && (NO == [[NSThread currentThread] isEqual: [manager workerThread]]));
+  if (canCoalesce || (ttl > 0))
+  {
+    key = [self _callKey];
+  }
+  if (ttl > 0)
+  {
+    reply = [cache replyForKey: key];
+  }
+  if (NULL == reply)
+  {
+    if (canCoalesce)
+    {
+      shared = [self _coalescedCallForKey: key
+                                 isLeader: &isLeader];
+    }
+
+    NS_DURING
+    {
+      if ((nil != shared) && (NO == isLeader))
+      {
+        reply = [self _waitForCoalescedCall: shared];
+      }
+      // If the leader was cancelled, we need to send the message ourselves:
+      if (NULL == reply)
+      {
+        if (ttl > 0)
+        {
+          group = [self _cacheGroupInCache: cache];
+          generation = [cache generationForGroup: group];
+        }
+        reply = [self _sendAndWaitForReply];
+        didSend = YES;
+        if ((ttl > 0)
+          && (DBUS_MESSAGE_TYPE_METHOD_RETURN == dbus_message_get_type(reply)))
+        {
+          [cache storeReply: reply
+                     forKey: key
+                      group: group
+                 generation: generation
+                        ttl: ttl];
+        }
+      }
+    }
+    NS_HANDLER
+    {
+      /*
+       * The cancellation only concerns the leader itself, so the waiting calls
+       * are released without an exception and send their own messages.
+       */
+      if (isLeader)
+      {
+        DKFinishCoalescedCall(shared, key, NULL,
+          isCancelled ? nil : localException);
+      }
+      [shared release];
+      DKTrace(DKTraceCallEnd, [[method name] UTF8String], 0);
+      [localException raise];
+    }
+    NS_ENDHANDLER
+    if (isLeader)
+    {
+      DKFinishCoalescedCall(shared, key, reply, nil);
+    }
+    [shared release];
+  }
 
   //Now we are sure that we don't need the message any more.
   if (NULL != msg)
@@ -363,24 +1096,39 @@
 
   NS_DURING
   {
-    [self handleReplyFromPendingCall: pending
-                               async: NO];
+    // Replies we did not receive ourselves have not been claimed yet:
+    if (NO == didSend)
+    {
+      [self _claimReply];
+    }
+    [self handleReply: reply
+                async: NO];
   }
   NS_HANDLER
   {
-    // Throw away the pending call
-    if (NULL != pending)
-    {
-      dbus_pending_call_unref(pending);
-      pending = NULL;
-    }
+    dbus_message_unref(reply);
+    DKTrace(DKTraceCallEnd, [[method name] UTF8String], 0);
     [localException raise];
   }
   NS_ENDHANDLER
-  if (NULL != pending)
+  dbus_message_unref(reply);
+  DKTrace(DKTraceCallEnd, [[method name] UTF8String], 0);
+}
+
+- (void)dealloc
+{
+  if (NULL != pendingCall)
   {
-    dbus_pending_call_unref(pending);
-    pending = NULL;
+    dbus_pending_call_unref(pendingCall);
+    pendingCall = NULL;
   }
+  [invocation release];
+  [method release];
+  [completionTarget release];
+  [completionThread release];
+  [exception release];
+  [userInfo release];
+  DKCountDeallocation(DKAllocationMethodCall);
+  [super dealloc];
 }
 @end
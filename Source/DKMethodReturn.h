@@ -24,7 +24,7 @@
 
 #import "DKMessage.h"
 
-@class DKMethod, NSException, NSInvocation;
+@class DKMethod, DKProxy, NSException, NSInvocation;
 @protocol DKExportableObjectPathNode;
 
 /**
@@ -44,6 +44,12 @@
    */
   DKMethod *method;
 
+  /**
+   * The proxy for the local object. Methods generated from the Objective-C
+   * runtime are shared between proxies and resolve it while being marshalled.
+   */
+  DKProxy *proxy;
+
   /**
    * The D-Bus message we are replying to. We need to reference it in case the
    * invocation generates an exception.
@@ -22,6 +22,7 @@
    Boston, MA 02111 USA.
    */
 
+#import "DKAllocationCounters.h"
 #import "DKMethod.h"
 #import "DKMethodReturn.h"
 #import "DKObjectPathNode.h"
@@ -40,10 +41,21 @@
 #include <dbus/dbus.h>
 @implementation DKMethodReturn
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationMethodReturn);
+  }
+  return obj;
+}
+
 - (void)deserializeArguments
 {
 
   DBusMessageIter iter;
+  DKProxy *previous = DKSetContextProxy(proxy);
   dbus_message_iter_init(original, &iter);
   NSDebugMLog(@"Deserializing arguments from method call");
   NS_DURING
@@ -54,10 +66,12 @@
   }
   NS_HANDLER
   {
+    DKSetContextProxy(previous);
     NSWarnMLog(@"Could not unmarshall arguments from D-Bus message. Exception raised: %@", localException);
     [localException raise];
   }
   NS_ENDHANDLER
+  DKSetContextProxy(previous);
 }
 
 - (id) initAsReplyToDBusMessage: (DBusMessage*)aMsg
@@ -67,7 +81,8 @@
 		   sendOutright: (BOOL)sendNow
 {
   DBusMessage *theReply = NULL;
-  DKEndpoint *ep = [[aProxy proxyParent] _endpoint];
+  DKProxy *theProxy = [aProxy proxyParent];
+  DKEndpoint *ep = [theProxy _endpoint];
   // Sanity check:
   if ((NULL == aMsg) || (nil == aMethod) || (nil == anInvocation) || (nil == ep))
   {
@@ -89,6 +104,7 @@
   dbus_message_ref(original);
   ASSIGN(method,aMethod);
   ASSIGN(invocation,anInvocation);
+  ASSIGN(proxy,theProxy);
   // Unmarshall the arguments from the method call.
   NS_DURING
   {
@@ -123,6 +139,7 @@
 - (void)serialize
 {
   DBusMessageIter iter;
+  DKProxy *previous = DKSetContextProxy(proxy);
 
   dbus_message_iter_init_append(msg, &iter);
   NSDebugMLog(@"Serializing return value into reply");
@@ -134,10 +151,12 @@
   }
   NS_HANDLER
   {
+    DKSetContextProxy(previous);
     NSWarnMLog(@"Could not marshall return value into D-Bus message. Exception raised: %@", localException);
     [localException raise];
   }
   NS_ENDHANDLER
+  DKSetContextProxy(previous);
 }
 
 /**
@@ -199,8 +218,10 @@
 {
   [invocation release];
   [method release];
+  [proxy release];
   dbus_message_unref(original);
   original = NULL;
+  DKCountDeallocation(DKAllocationMethodReturn);
   [super dealloc];
 }
 @end
@@ -22,6 +22,7 @@
 
 #import "DBusKit/DKNotificationCenter.h"
 #import "DBusKit/DKPort.h"
+#import "DKAllocationCounters.h"
 #import "DKArgument.h"
 #import "DKInterface.h"
 #import "DKSignal.h"
@@ -31,7 +32,11 @@
 
 #import "DKEndpoint.h"
 #import "DKEndpointManager.h"
+#import "DKLazyProxy.h"
+#import "DKTrace.h"
 
+#import <Foundation/NSArray.h>
+#import <Foundation/NSAutoreleasePool.h>
 #import <Foundation/NSDebug.h>
 #import <Foundation/NSCharacterSet.h>
 #import <Foundation/NSDictionary.h>
@@ -61,6 +66,40 @@
 
 @class DKObservation;
 
+/*
+ * The observer tables are published as immutable snapshots, which the signal
+ * path reads without taking the locks that serialize changes to the tables.
+ * The spin lock only covers loading and retaining the snapshot pointer, so that
+ * a writer cannot release a snapshot that a reader is about to retain.
+ */
+static inline id
+DKRetainSnapshot(id *slot, int *spinLock)
+{
+  id snapshot = nil;
+  while (__sync_lock_test_and_set(spinLock, 1))
+  {
+    sched_yield();
+  }
+  snapshot = [*slot retain];
+  __sync_lock_release(spinLock);
+  return snapshot;
+}
+
+static inline void
+DKPublishSnapshot(id *slot, int *spinLock, id snapshot)
+{
+  id oldSnapshot = nil;
+  [snapshot retain];
+  while (__sync_lock_test_and_set(spinLock, 1))
+  {
+    sched_yield();
+  }
+  oldSnapshot = *slot;
+  *slot = snapshot;
+  __sync_lock_release(spinLock);
+  [oldSnapshot release];
+}
+
 /**
  * DKObservable encapsulates information about a specific signal configuration
  * that is being observed by an object. It contains a match rule for userInfo
@@ -78,6 +117,24 @@
    */
   NSHashTable *observations;
 
+  /**
+   * Index of the observations by observer, allowing all observations of an
+   * observer to be removed without enumerating <ivar>observations</ivar>.
+   */
+  NSMapTable *observationsByObserver;
+
+  /**
+   * Immutable copy of <ivar>observations</ivar> used when delivering
+   * notifications.
+   */
+  NSArray *observationSnapshot;
+
+  /**
+   * Spin lock protecting access to the <ivar>observationSnapshot</ivar>
+   * pointer.
+   */
+  int snapshotLock;
+
   /**
    * Specifies whether the observable is watching for changes in the owner of a
    * name. This is required to prevent an infinite loop, because observables
@@ -132,6 +189,16 @@
 
 @implementation DKObservable
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationObservable);
+  }
+  return obj;
+}
+
 - (id)initWithBusType: (DKDBusBusType)aType;
 {
   NSPointerFunctionsOptions strongObjectOptions =
@@ -145,9 +212,22 @@
   rules = [[NSMutableDictionary alloc] initWithObjectsAndKeys: @"signal", @"type", nil];
   observations = [[NSHashTable alloc] initWithOptions: strongObjectOptions
                                              capacity: 5];
+  observationsByObserver = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+    NSObjectMapValueCallBacks, 5);
+  observationSnapshot = [NSArray new];
   return self;
 }
 
+/**
+ * Publishes the current set of observations for delivery. Needs to be called
+ * after every change to <ivar>observations</ivar>.
+ */
+- (void)_publishObservations
+{
+  DKPublishSnapshot(&observationSnapshot, &snapshotLock,
+    NSAllHashTableObjects(observations));
+}
+
 /**
  * Adds a DKObservation (i.e. observer/selector-pair.) to the observable.
  * Whenever a signal matching the observable is received, the corresponding
@@ -167,7 +247,17 @@
   oldObservation = [observations member: observation];
   if (nil == oldObservation)
   {
+    id observer = [observation observer];
+    NSHashTable *observerTable = NSMapGet(observationsByObserver, observer);
+    if (nil == observerTable)
+    {
+      observerTable = NSCreateHashTable(NSObjectHashCallBacks, 2);
+      NSMapInsert(observationsByObserver, observer, observerTable);
+      [observerTable release];
+    }
+    NSHashInsert(observerTable, observation);
     [observations addObject: observation];
+    [self _publishObservations];
   }
 }
 
@@ -179,60 +269,35 @@
   DKObservation *oldObservation = [observations member: observation];
   if (nil != oldObservation)
   {
+    id observer = [oldObservation observer];
+    NSHashTable *observerTable = NSMapGet(observationsByObserver, observer);
+    if (nil != observerTable)
+    {
+      NSHashRemove(observerTable, oldObservation);
+      if (0 == NSCountHashTable(observerTable))
+      {
+        NSMapRemove(observationsByObserver, observer);
+      }
+    }
     [observations removeObject: oldObservation];
+    [self _publishObservations];
   }
 }
 
 /**
- * Removes all observations for the given observer.
+ * Removes all observations for the given observer. This only touches the
+ * observations of <var>observer</var>.
  */
 - (void)removeObservationsForObserver: (id)observer
 {
-  NSHashEnumerator theEnum = NSEnumerateHashTable(observations);
-  // Construct a table to hold the observables to remove because we can't modify
-  // the table while enumerating.
-  NSHashTable *removeTable = [[NSHashTable alloc] initWithOptions: (NSPointerFunctionsObjectPersonality | NSPointerFunctionsStrongMemory)
-                                                         capacity: 10];
-  DKObservation *thisObservation = nil;
-  NS_DURING
-  {
-    while (nil != (thisObservation = NSNextHashEnumeratorItem(&theEnum)))
-    {
-      if (observer == [thisObservation observer])
-      {
-        NSHashInsert(removeTable,thisObservation);
-      }
-    }
-  }
-  NS_HANDLER
+  NSHashTable *observerTable = NSMapGet(observationsByObserver, observer);
+  if (nil == observerTable)
   {
-    NSEndHashTableEnumeration(&theEnum);
-    NS_DURING
-    {
-      [observations minusHashTable: removeTable];
-    }
-    NS_HANDLER
-    {
-      [removeTable release];
-      [localException raise];
-    }
-    NS_ENDHANDLER
-    [removeTable release];
-    [localException raise];
-  }
-  NS_ENDHANDLER
-  NSEndHashTableEnumeration(&theEnum);
-  NS_DURING
-  {
-    [observations minusHashTable: removeTable];
-  }
-  NS_HANDLER
-  {
-    [removeTable release];
-    [localException raise];
+    return;
   }
-  NS_ENDHANDLER
-  [removeTable release];
+  [observations minusHashTable: observerTable];
+  NSMapRemove(observationsByObserver, observer);
+  [self _publishObservations];
 }
 
 /**
@@ -240,13 +305,10 @@
  */
 - (void)notifyWithNotification: (NSNotification*)notification
 {
-  NSHashEnumerator obsEnum = NSEnumerateHashTable(observations);
-  DKObservation *thisObservation = nil;
-  while (nil != (thisObservation = NSNextHashEnumeratorItem(&obsEnum)))
-  {
-    [thisObservation notifyWithNotification: notification];
-  }
-  NSEndHashTableEnumeration(&obsEnum);
+  NSArray *snapshot = DKRetainSnapshot(&observationSnapshot, &snapshotLock);
+  [snapshot makeObjectsPerformSelector: @selector(notifyWithNotification:)
+                            withObject: notification];
+  [snapshot release];
 }
 
 /**
@@ -512,12 +574,25 @@
   }
   [rules release];
   [observations release];
+  NSFreeMapTable(observationsByObserver);
+  [observationSnapshot release];
+  DKCountDeallocation(DKAllocationObservable);
   [super dealloc];
 }
 @end
 
 @implementation DKObservation
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationObservation);
+  }
+  return obj;
+}
+
 - (id)initWithObserver: (id)anObserver
               selector: (SEL)aSelector
 {
@@ -575,6 +650,7 @@
 
 - (void)dealloc
 {
+  DKCountDeallocation(DKAllocationObservation);
   [super dealloc];
 }
 @end
@@ -583,6 +659,7 @@
 
 static DKNotificationCenter *systemCenter;
 static DKNotificationCenter *sessionCenter;
+static NSRecursiveLock *centerLock;
 
 /**
  * The result handling function called by libdbus. It is important to keep in
@@ -594,8 +671,14 @@ static DBusHandlerResult
 DKHandleSignal(DBusConnection *connection, DBusMessage *msg, void *userData);
 
 @interface DKNotificationCenter (DKNotificationCenterPrivate)
+- (id)_initWithoutBus;
 - (id)initWithBusType: (DKDBusBusType)type;
 
+- (NSArray*)_observablesMatchingMessage: (DBusMessage*)msg
+                               userInfo: (NSDictionary**)userInfo
+                                 signal: (DKSignal**)signal
+                                standin: (DKProxyStandin**)standin;
+
 - (DKSignal*)_signalForNotificationName: (NSString*)name;
 - (DKSignal*)_signalForNotificationName: (NSString*)name
                            generateStub: (BOOL)generateStub;
@@ -614,6 +697,8 @@ DKHandleSignal(DBusConnection *connection, DBusMessage *msg, void *userData);
 - (void)_removeObserver: (id)observer
           forObservable: (DKObservable*)observable;
 
+- (void)_removeMatchRule: (NSString*)rule;
+
 - (DKObservable*)_observableForSignalName: (NSString*)signalName
                                 interface: (NSString*)interfaceName
                                    sender: (DKProxy*)sender
@@ -644,10 +729,11 @@ static DKEndpointManager *manager;
   if ([DKNotificationCenter class] == self)
   {
     manager = [DKEndpointManager sharedEndpointManager];
-    [manager enterInitialize];
-    systemCenter = [[DKNotificationCenter alloc] initWithBusType: DKDBusSystemBus];
-    sessionCenter = [[DKNotificationCenter alloc] initWithBusType: DKDBusSessionBus];
-    [manager leaveInitialize];
+    /*
+     * The centers are created lazily by +centerForBusType: because creating
+     * them requires connecting to the bus.
+     */
+    centerLock = [NSRecursiveLock new];
   }
 }
 
@@ -673,34 +759,74 @@ static DKEndpointManager *manager;
 + (id)centerForBusType: (DKDBusBusType)type
 {
   DKNotificationCenter *center = nil;
-  switch (type)
+  /*
+   * The centers are always read under the lock, so that no thread can see a
+   * center before its initialization is visible.
+   */
+  [centerLock lock];
+  NS_DURING
   {
-    case DKDBusSystemBus:
-      if (systemCenter == nil)
-      {
-	systemCenter = [[DKNotificationCenter alloc] initWithBusType: type];
-      }
-      center = systemCenter;
-      break;
-    case DKDBusSessionBus:
-      if (sessionCenter == nil)
-      {
-	sessionCenter = [[DKNotificationCenter alloc] initWithBusType: type];
-      }
-      center = sessionCenter;
-      break;
-    default:
-      break;
+    switch (type)
+    {
+      case DKDBusSystemBus:
+        if (systemCenter == nil)
+        {
+          systemCenter = [[DKNotificationCenter alloc] initWithBusType: type];
+        }
+        center = systemCenter;
+        break;
+      case DKDBusSessionBus:
+        if (sessionCenter == nil)
+        {
+          sessionCenter = [[DKNotificationCenter alloc] initWithBusType: type];
+        }
+        center = sessionCenter;
+        break;
+      default:
+        break;
+    }
+  }
+  NS_HANDLER
+  {
+    [centerLock unlock];
+    [localException raise];
   }
+  NS_ENDHANDLER
+  [centerLock unlock];
   return center;
 }
 
-- (id)initWithBusType: (DKDBusBusType)type
+/*
+ * Initializes a center that is not connected to a bus. It can decode captured
+ * signals and match them against its observables, but cannot observe a bus.
+ */
+- (id)_initWithoutBus
 {
   if (nil == (self = [super init]))
   {
     return nil;
   }
+  lock = [[NSRecursiveLock alloc] init];
+  signalInfo = [[NSMutableDictionary alloc] init];
+  notificationNames = [[NSMutableDictionary alloc] init];
+  notificationNamesBySignal = [[NSMapTable alloc]initWithKeyOptions: NSPointerFunctionsObjectPersonality
+                                                       valueOptions: NSPointerFunctionsObjectPersonality
+                                                           capacity: 5];
+  observables = NSCreateHashTable(NSObjectHashCallBacks, 5);
+  observablesByObserver = NSCreateMapTable(NSNonOwnedPointerMapKeyCallBacks,
+    NSObjectMapValueCallBacks, 5);
+  pendingRuleRemovals = [[NSCountedSet alloc] init];
+  observablesLock = [[NSRecursiveLock alloc] init];
+  observableSnapshot = [NSArray new];
+  return self;
+}
+
+- (id)initWithBusType: (DKDBusBusType)type
+{
+  if (nil == (self = [self _initWithoutBus]))
+  {
+    return nil;
+  }
   // Trigger initialization of the bus proxy:
   bus = [DKDBus busWithBusType: type];
 
@@ -710,14 +836,6 @@ static DKEndpointManager *manager;
     return nil;
   }
 
-  lock = [[NSRecursiveLock alloc] init];
-  signalInfo = [[NSMutableDictionary alloc] init];
-  notificationNames = [[NSMutableDictionary alloc] init];
-  notificationNamesBySignal = [[NSMapTable alloc]initWithKeyOptions: NSPointerFunctionsObjectPersonality
-                                                       valueOptions: NSPointerFunctionsObjectPersonality
-                                                           capacity: 5];
-  observables = NSCreateHashTable(NSObjectHashCallBacks, 5);
-
   // Install the observer for the Disconnected signal on the bus object. We need
   // to do that here, because DKNotificationCenter depends on the existance of
   // the bus object and doing it from the bus object would create a circular
@@ -1115,20 +1233,33 @@ static DKEndpointManager *manager;
 			  	filters: filterDict];
 }
 
+/**
+ * Publishes the current set of observables to the signal path. Needs to be
+ * called with <ivar>observablesLock</ivar> held after every change to
+ * <ivar>observables</ivar>.
+ */
+- (void)_publishObservables
+{
+  DKPublishSnapshot(&observableSnapshot, &snapshotLock,
+    NSAllHashTableObjects(observables));
+}
+
 /**
  * Return an array of all observables that will match for <var>userInfo</var>.
+ * This works on the published snapshot and does not block while observers are
+ * being added or removed.
  */
 - (NSArray*)_observablesMatchingUserInfo: (NSDictionary*)userInfo
 {
-  NSHashEnumerator obsEnum;
-  DKObservable *thisObservable = nil;
+  NSArray *snapshot = DKRetainSnapshot(&observableSnapshot, &snapshotLock);
   NSMutableArray *array = nil;
-  [lock lock];
+  NSUInteger count = [snapshot count];
+  NSUInteger i = 0;
   NS_DURING
   {
-    obsEnum = NSEnumerateHashTable(observables);
-    while (nil != (thisObservable = NSNextHashEnumeratorItem(&obsEnum)))
+    for (i = 0; i < count; i++)
     {
+      DKObservable *thisObservable = [snapshot objectAtIndex: i];
       if ([thisObservable matchesUserInfo: userInfo])
       {
 	if (nil == array)
@@ -1141,14 +1272,11 @@ static DKEndpointManager *manager;
   }
   NS_HANDLER
   {
-    NSEndHashTableEnumeration(&obsEnum);
-    [lock unlock];
+    [snapshot release];
     [localException raise];
   }
   NS_ENDHANDLER
-
-  NSEndHashTableEnumeration(&obsEnum);
-  [lock unlock];
+  [snapshot release];
   return array;
 }
 
@@ -1156,7 +1284,7 @@ static DKEndpointManager *manager;
 {
   // We obtain the (recursive lock) in order to make sure that we will succeed
   // in inserting the observation.
-  if (NO == [lock tryLock])
+  if (NO == [observablesLock tryLock])
   {
     // if we could not obtain the lock, try again:
     [manager boolReturnForPerformingSelector: @selector(_createObservationForDictionary:)
@@ -1173,7 +1301,7 @@ static DKEndpointManager *manager;
   [dict release];
   // Cast to void to suppress warning
   (void)__sync_fetch_and_sub(&queueCount, 1);
-  [lock unlock];
+  [observablesLock unlock];
 }
 
 /**
@@ -1214,6 +1342,23 @@ static DKEndpointManager *manager;
              forObservable: observable];
 }
 
+/**
+ * Records that <var>observer</var> has observations for <var>observable</var>.
+ * Needs to be called with <ivar>observablesLock</ivar> held.
+ */
+- (void)_indexObservable: (DKObservable*)observable
+             forObserver: (id)observer
+{
+  NSHashTable *observerTable = NSMapGet(observablesByObserver, observer);
+  if (nil == observerTable)
+  {
+    observerTable = NSCreateHashTable(NSObjectHashCallBacks, 2);
+    NSMapInsert(observablesByObserver, observer, observerTable);
+    [observerTable release];
+  }
+  NSHashInsertIfAbsent(observerTable, observable);
+}
+
 /**
  * Installs the necessary entries for observables and observations in the
  * respective tables and adds the D-Bus match rule if necessary.
@@ -1228,7 +1373,7 @@ static DKEndpointManager *manager;
     return;
   }
 
-  if (NO == [lock tryLock])
+  if (NO == [observablesLock tryLock])
   {
 
     // If we could not obtain the lock, we schedule creation of the observation.
@@ -1255,9 +1400,24 @@ static DKEndpointManager *manager;
     }
     else
     {
-      [(id<DKDBusStub>)bus AddMatch: [observable ruleString]];
+      NSString *rule = [observable ruleString];
+      if (0 != [pendingRuleRemovals countForObject: rule])
+      {
+        // The rule is still installed, we just don't remove it:
+	[pendingRuleRemovals removeObject: rule];
+      }
+      else
+      {
+        [(id<DKDBusStub>)bus AddMatch: rule];
+      }
     }
     [observable addObservation: observation];
+    [self _indexObservable: observable
+               forObserver: [observation observer]];
+    if (nil == oldObservable)
+    {
+      [self _publishObservables];
+    }
   }
   NS_HANDLER
   {
@@ -1265,24 +1425,27 @@ static DKEndpointManager *manager;
     {
       [self _removeHandler];
     }
-    [lock unlock];
+    [observablesLock unlock];
     [localException raise];
   }
   NS_ENDHANDLER
 
-  [lock unlock];
+  [observablesLock unlock];
 }
 
 /**
  * Removes the observer/observable combination from all tables it appears in.
- * Also removes match rules and handlers if necessary.
+ * Also removes match rules and handlers if necessary. Only the observables the
+ * observer is watching are considered, and the match rules of observables that
+ * were left empty are removed in a batch on the worker thread.
  */
 - (void)_removeObserver: (id)observer
           forObservable: (DKObservable*)observable
 {
-  NSHashEnumerator observableEnum;
+  NSHashTable *observerTable = nil;
+  NSArray *candidates = nil;
   NSHashEnumerator cleanupEnum;
-  NSHashTable *cleanupTable = NSCreateHashTable(NSObjectHashCallBacks, 10);
+  NSHashTable *cleanupTable = nil;
   NSUInteger initialCount = 0;
   NSUInteger iteration = 0;
   if (nil == observable)
@@ -1304,11 +1467,19 @@ static DKEndpointManager *manager;
   }
 
 
-  [lock lock];
+  [observablesLock lock];
+  observerTable = NSMapGet(observablesByObserver, observer);
+  if (nil == observerTable)
+  {
+    // Nothing to do if the observer isn't watching anything.
+    [observablesLock unlock];
+    return;
+  }
+
   // Count the table so we know how many observables there were before we
   // started removing stuff.
-
   initialCount = NSCountHashTable(observables);
+  cleanupTable = NSCreateHashTable(NSObjectHashCallBacks, 10);
 
   /*
    * First stage of cleanup: Remove references to the observation from the
@@ -1316,41 +1487,48 @@ static DKEndpointManager *manager;
    */
   NS_DURING
   {
-    DKObservable *thisObservable = nil;
     SEL matchSel = @selector(matchesUserInfo:);
     IMP matchesUserInfo = [observable methodForSelector: matchSel];
     SEL ruleSel = @selector(rules);
     IMP getRules = [observable methodForSelector: ruleSel];
-    observableEnum = NSEnumerateHashTable(observables);
+    NSUInteger count = 0;
+    NSUInteger i = 0;
 
-    while (nil != (thisObservable = NSNextHashEnumeratorItem(&observableEnum)))
+    // We modify the observer table while going through it, so we need a copy:
+    candidates = NSAllHashTableObjects(observerTable);
+    count = [candidates count];
+    for (i = 0; i < count; i++)
     {
+      DKObservable *thisObservable = [candidates objectAtIndex: i];
       NSDictionary *rules = getRules(thisObservable, ruleSel);
       if ((BOOL)(uintptr_t)matchesUserInfo(observable, matchSel, rules))
       {
         [thisObservable removeObservationsForObserver: observer];
+        NSHashRemove(observerTable, thisObservable);
 	// If we removed the last observation, add the observable to the cleanup
-	// table because we cannot modify the table we are enumerating.
+	// table.
 	if (0 == ([thisObservable observationCount]))
 	{
 	  NSHashInsertIfAbsent(cleanupTable, thisObservable);
 	}
       }
     }
+    if (0 == NSCountHashTable(observerTable))
+    {
+      NSMapRemove(observablesByObserver, observer);
+    }
   }
   NS_HANDLER
   {
-    NSEndHashTableEnumeration(&observableEnum);
     [cleanupTable release];
-    [lock unlock];
+    [observablesLock unlock];
     [localException raise];
   }
   NS_ENDHANDLER
-  NSEndHashTableEnumeration(&observableEnum);
 
   /*
-   * Second stage of cleanup: If we left an empty observable, remove it and the
-   * corresponding match rule.
+   * Second stage of cleanup: If we left an empty observable, remove it and
+   * schedule removal of the corresponding match rule.
    */
   NS_DURING
   {
@@ -1358,20 +1536,7 @@ static DKEndpointManager *manager;
     cleanupEnum = NSEnumerateHashTable(cleanupTable);
     while(nil != (thisObservable = NSNextHashEnumeratorItem(&cleanupEnum)))
     {
-      /*
-       * NOTE: We don't really care if removing the match rule fails. Once we
-       * waive all references to the observable, we will just ignore the
-       * callbacks libdbus generates for the match rule.
-       */
-      NS_DURING
-      {
-        [(id<DKDBusStub>)bus RemoveMatch: [thisObservable ruleString]];
-      }
-      NS_HANDLER
-      {
-	NSWarnMLog(@"Could not remove match rule from D-Bus: %@", localException);
-      }
-      NS_ENDHANDLER
+      [self _removeMatchRule: [thisObservable ruleString]];
       NSHashRemove(observables, thisObservable);
     }
   }
@@ -1379,11 +1544,20 @@ static DKEndpointManager *manager;
   {
     NSEndHashTableEnumeration(&cleanupEnum);
     [cleanupTable release];
-    [lock unlock];
+    [observablesLock unlock];
     [localException raise];
   }
   NS_ENDHANDLER
   NSEndHashTableEnumeration(&cleanupEnum);
+  /*
+   * Republishing the snapshot copies all observables, so it is linear in their
+   * total number. We do it once for all observables removed here, and only if
+   * removing the observer did leave some of them empty.
+   */
+  if (0 != NSCountHashTable(cleanupTable))
+  {
+    [self _publishObservables];
+  }
   [cleanupTable release];
   /*
    * Third stage of cleanup: If we have no observables left, also remove the
@@ -1393,7 +1567,76 @@ static DKEndpointManager *manager;
   {
     [self _removeHandler];
   }
-  [lock unlock];
+  [observablesLock unlock];
+}
+
+/**
+ * Schedules removal of a match rule from the bus. Rules are collected and
+ * removed in one go by -_flushMatchRuleRemovals: on the worker thread, so that
+ * removing many observers does not cost a bus round trip each. Needs to be
+ * called with <ivar>observablesLock</ivar> held.
+ */
+- (void)_removeMatchRule: (NSString*)rule
+{
+  [pendingRuleRemovals addObject: rule];
+  if (NO == ruleRemovalScheduled)
+  {
+    ruleRemovalScheduled = YES;
+    [manager boolReturnForPerformingSelector: @selector(_flushMatchRuleRemovals:)
+                                      target: self
+                                        data: NULL
+                               waitForReturn: NO];
+  }
+}
+
+/**
+ * Removes all match rules scheduled for removal from the bus. Runs on the
+ * worker thread, which must not block on <ivar>observablesLock</ivar>: The lock
+ * is held while adding match rules, which needs the worker to send the
+ * message.
+ */
+- (void)_flushMatchRuleRemovals: (id)ignored
+{
+  NSCountedSet *rules = nil;
+  NSEnumerator *ruleEnum = nil;
+  NSString *thisRule = nil;
+  if (NO == [observablesLock tryLock])
+  {
+    // If we could not obtain the lock, try again:
+    [manager boolReturnForPerformingSelector: @selector(_flushMatchRuleRemovals:)
+                                      target: self
+                                        data: NULL
+                               waitForReturn: NO];
+    return;
+  }
+  rules = pendingRuleRemovals;
+  pendingRuleRemovals = [[NSCountedSet alloc] init];
+  ruleRemovalScheduled = NO;
+  [observablesLock unlock];
+
+  ruleEnum = [rules objectEnumerator];
+  while (nil != (thisRule = [ruleEnum nextObject]))
+  {
+    NSUInteger count = [rules countForObject: thisRule];
+    while (count--)
+    {
+      /*
+       * NOTE: We don't really care if removing the match rule fails. Once we
+       * waive all references to the observable, we will just ignore the
+       * callbacks libdbus generates for the match rule.
+       */
+      NS_DURING
+      {
+        [(id<DKDBusStub>)bus RemoveMatch: thisRule];
+      }
+      NS_HANDLER
+      {
+	NSWarnMLog(@"Could not remove match rule from D-Bus: %@", localException);
+      }
+      NS_ENDHANDLER
+    }
+  }
+  [rules release];
 }
 
 
@@ -1795,6 +2038,7 @@ static DKEndpointManager *manager;
   NSArray *matchingObservables = [infoDict objectForKey: @"matches"];
   NSEnumerator *userInfoEnum = [userInfo keyEnumerator];
   NSString *key = nil;
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
 
   //Fixup the userInfo:
   while (nil != (key = [userInfoEnum nextObject]))
@@ -1802,7 +2046,13 @@ static DKEndpointManager *manager;
     id object = [userInfo objectForKey: key];
     if ([object isKindOfClass: [DKProxyStandin class]])
     {
-      object = [(DKProxyStandin*)object proxy];
+      /*
+       * Object paths in the arguments are rarely messaged by the observers,
+       * so we only hand out lightweight proxies for them.
+       */
+      object = [[[DKLazyProxy alloc] initWithEndpoint: [object _endpoint]
+                                              service: [object _service]
+                                                 path: [object _path]] autorelease];
     }
     [fixedInfo setObject: object
                   forKey: key];
@@ -1812,21 +2062,24 @@ static DKEndpointManager *manager;
 					     userInfo: fixedInfo];
   [matchingObservables makeObjectsPerformSelector: @selector(notifyWithNotification:)
                                        withObject: notification];
-
+  [arp release];
 }
 
 /**
- * Handles a message caught by the handler. If the signal is not yet known to
- * the center, this will generate arguments from the D-Bus signature. This
- * method also deserializes the message into an userInfo dictionary for use in
- * the notification. This is necessary to determine whether the message matches
- * one or more of the registered observables. If so, generation and dispatching
- * to the observers will be scheduled.
+ * Decodes a signal message into the userInfo dictionary for its notification
+ * and returns the observables matching it, or nil if there are none. If the
+ * signal is not yet known to the center, arguments are generated from the
+ * D-Bus signature. The signal the message was decoded with and a standin for
+ * the object that emitted it are returned by reference. This does not talk to
+ * the bus, so it also works for captured messages.
  */
-- (BOOL)_handleMessage: (DBusMessage*)msg
+- (NSArray*)_observablesMatchingMessage: (DBusMessage*)msg
+                               userInfo: (NSDictionary**)userInfo
+                                 signal: (DKSignal**)signal
+                                standin: (DKProxyStandin**)standin
 {
   const char *cSignal = dbus_message_get_member(msg);
-  NSString *signal = nil;
+  NSString *signalName = nil;
   const char *cInterface = dbus_message_get_interface(msg);
   NSString *interface = nil;
   const char *cSender = dbus_message_get_sender(msg);
@@ -1837,98 +2090,124 @@ static DKEndpointManager *manager;
   NSString *destination = nil;
   const char *signature = dbus_message_get_signature(msg);
   id theNull = [NSNull null];
+  DBusMessageIter iter;
+  NSMutableDictionary *info = nil;
 
   // We cannot add nil to the userInfo, so we replace empty things with NSNull
-  signal = (NULL != cSignal) ? [NSString stringWithUTF8String: cSignal] : theNull;
+  signalName = (NULL != cSignal) ? [NSString stringWithUTF8String: cSignal] : theNull;
   interface = (NULL != cInterface) ? [NSString stringWithUTF8String: cInterface] : theNull;
   sender = (NULL != cSender) ? [NSString stringWithUTF8String: cSender] : theNull;
   path = (NULL != cPath) ? [NSString stringWithUTF8String: cPath]: theNull;
   destination = (NULL != cDestination) ? [NSString stringWithUTF8String: cDestination] : theNull;
 
+  /*
+   * We do not hold the lock here: Signal lookup locks the signal tables only
+   * briefly and matching works on the published snapshot of observables.
+   *
+   * Copying the signal allows us to set the sender as its parent (circumventing
+   * the interface at this time. This is needed because the arguments might need
+   * to construct object paths and such. We also need to reference the
+   * original signal because we need it to look up the notification name.
+   */
+  DKSignal *origSignal = [self _signalWithName: signalName
+                                   inInterface: interface];
+  DKSignal *theSignal = [[origSignal copy] autorelease];
 
-  [lock lock];
-  NS_DURING
+  /* Construct a intermediary proxy for the object emitting the signal: */
+  DKProxyStandin *senderNode = (id)theNull;
+  if ((NO == [theNull isEqual: sender]) && (nil != bus))
   {
-    DBusMessageIter iter;
-    NSMutableDictionary *userInfo = nil;
-    NSDictionary *infoDict = nil;
-    NSArray *matchingObservables = nil;
-
-    /*
-     * Copying the signal allows us to set the sender as its parent (circumventing
-     * the interface at this time. This is needed because the arguments might need
-     * to construct object paths and such. We also need to reference the
-     * original signal because we need it to look up the notification name.
-     */
-    DKSignal *origSignal = [self _signalWithName: signal
-                                     inInterface: interface];
-    DKSignal *theSignal = [[origSignal copy] autorelease];
-
-    /* Construct a intermediary proxy for the object emitting the signal: */
-    DKProxyStandin *senderNode = (id)theNull;
-    if (NO == [theNull isEqual: sender])
-    {
-      // Sender will only be nil for in process signals:
-      senderNode = [[[DKProxyStandin alloc] initWithEndpoint: [bus _endpoint]
-                                                     service: sender
-                                                        path: path] autorelease];
-      [theSignal setParent: senderNode];
-    }
+    // Sender will only be nil for in process signals:
+    senderNode = [[[DKProxyStandin alloc] initWithEndpoint: [bus _endpoint]
+                                                   service: sender
+                                                      path: path] autorelease];
+    [theSignal setParent: senderNode];
+  }
 
-    userInfo = [[NSMutableDictionary alloc] initWithObjectsAndKeys: signal, @"member",
-      interface, @"interface",
-      sender, @"sender",
-      path, @"path",
-      destination, @"destination",
-      nil];
+  info = [NSMutableDictionary dictionaryWithObjectsAndKeys: signalName, @"member",
+    interface, @"interface",
+    sender, @"sender",
+    path, @"path",
+    destination, @"destination",
+    nil];
 
-    if (([theSignal isStub]) && (NULL != signature))
+  if (([theSignal isStub]) && (NULL != signature))
+  {
+    if ('\0' != signature[0])
     {
-      if ('\0' != signature[0])
+      DBusSignatureIter sigIter;
+      NSMutableArray *args = [NSMutableArray array];
+      dbus_signature_iter_init(&sigIter, signature);
+      do
       {
-        DBusSignatureIter iter;
-        NSMutableArray *args = [NSMutableArray array];
-        dbus_signature_iter_init(&iter, signature);
-        do
-        {
-          char *sig = dbus_signature_iter_get_signature(&iter);
-  	  DKArgument *arg = [[DKArgument alloc] initWithDBusSignature: sig
-	                                                         name: nil
-	                                                       parent: theSignal];
-	  [args addObject: arg];
-        } while (dbus_signature_iter_next(&iter));
-        [theSignal setArguments: args];
-      }
+        char *sig = dbus_signature_iter_get_signature(&sigIter);
+        DKArgument *arg = [[DKArgument alloc] initWithDBusSignature: sig
+                                                               name: nil
+                                                             parent: theSignal];
+        [args addObject: arg];
+        [arg release];
+        dbus_free(sig);
+      } while (dbus_signature_iter_next(&sigIter));
+      [theSignal setArguments: args];
     }
+  }
 
-    dbus_message_iter_init(msg, &iter);
-    [userInfo addEntriesFromDictionary: [theSignal userInfoFromIterator: &iter]];
+  dbus_message_iter_init(msg, &iter);
+  [info addEntriesFromDictionary: [theSignal userInfoFromIterator: &iter]];
 
-    matchingObservables = [self _observablesMatchingUserInfo: userInfo];
-    if (nil == matchingObservables)
-    {
-      NSDebugMLog(@"Signal %@ is not being observed by the notification center.", signal);
-      [lock unlock];
-      return NO;
-    }
-    infoDict = [NSDictionary dictionaryWithObjectsAndKeys: senderNode, @"standin",
-      userInfo, @"userInfo",
-      origSignal, @"signal",
-      matchingObservables, @"matches", nil];
-    // Schedule sending out the notifications:
-    [[NSRunLoop currentRunLoop] performSelector: @selector(_fixupProxyAndNotify:)
-                                         target: self
-                                       argument: infoDict
-                                          order: 0
-                                          modes: [NSArray arrayWithObject: NSDefaultRunLoopMode]];
+  if (NULL != userInfo)
+  {
+    *userInfo = info;
   }
-  NS_HANDLER
+  if (NULL != signal)
   {
-    [lock unlock];
-    [localException raise];
+    *signal = origSignal;
   }
-  NS_ENDHANDLER
-  [lock unlock];
+  if (NULL != standin)
+  {
+    *standin = senderNode;
+  }
+  return [self _observablesMatchingUserInfo: info];
+}
+
+/**
+ * Handles a message caught by the handler. The message is deserialized into an
+ * userInfo dictionary for use in the notification, which is necessary to
+ * determine whether the message matches one or more of the registered
+ * observables. If so, generation and dispatching to the observers will be
+ * scheduled.
+ */
+- (BOOL)_handleMessage: (DBusMessage*)msg
+{
+  NSDictionary *userInfo = nil;
+  DKSignal *origSignal = nil;
+  DKProxyStandin *senderNode = nil;
+  NSArray *matchingObservables = nil;
+  NSDictionary *infoDict = nil;
+
+  DKTrace(DKTraceSignal, dbus_message_get_member(msg),
+    dbus_message_get_serial(msg));
+
+  matchingObservables = [self _observablesMatchingMessage: msg
+                                                 userInfo: &userInfo
+                                                   signal: &origSignal
+                                                  standin: &senderNode];
+  if (nil == matchingObservables)
+  {
+    NSDebugMLog(@"Signal %s is not being observed by the notification center.",
+      dbus_message_get_member(msg));
+    return NO;
+  }
+  infoDict = [NSDictionary dictionaryWithObjectsAndKeys: senderNode, @"standin",
+    userInfo, @"userInfo",
+    origSignal, @"signal",
+    matchingObservables, @"matches", nil];
+  // Schedule sending out the notifications:
+  [[NSRunLoop currentRunLoop] performSelector: @selector(_fixupProxyAndNotify:)
+                                       target: self
+                                     argument: infoDict
+                                        order: 0
+                                        modes: [NSArray arrayWithObject: NSDefaultRunLoopMode]];
   return YES;
 }
 
@@ -1939,7 +2218,9 @@ static DKEndpointManager *manager;
  */
 - (void)_syncStateWithBus
 {
-  [lock lock];
+  [observablesLock lock];
+  // Match rules of the old connection are gone anyways:
+  [pendingRuleRemovals removeAllObjects];
   NS_DURING
   {
     if (0 != NSCountHashTable(observables))
@@ -1971,15 +2252,16 @@ static DKEndpointManager *manager;
       NS_ENDHANDLER
 
       NSEndHashTableEnumeration(&theEnum);
+      [self _publishObservables];
     } //end of if-statement
   }
   NS_HANDLER
   {
-    [lock unlock];
+    [observablesLock unlock];
     [localException raise];
   }
   NS_ENDHANDLER
-  [lock unlock];
+  [observablesLock unlock];
 }
 
 - (void)dealloc
@@ -1989,6 +2271,10 @@ static DKEndpointManager *manager;
   [notificationNames release];
   NSFreeMapTable(notificationNamesBySignal);
   NSFreeHashTable(observables);
+  NSFreeMapTable(observablesByObserver);
+  [pendingRuleRemovals release];
+  [observableSnapshot release];
+  [observablesLock release];
   [lock release];
   [super dealloc];
 }
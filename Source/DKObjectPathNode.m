@@ -22,6 +22,7 @@
    */
 
 #import "DKObjectPathNode.h"
+#import "DKAllocationCounters.h"
 #import "DKInterface.h"
 #import "DKMethodReturn.h"
 #import "DKProxy+Private.h"
@@ -42,6 +43,11 @@
 
 @implementation DKObjectPathNode
 
++ (BOOL) internsNames
+{
+  return NO;
+}
+
 - (id) initWithName: (NSString*)aName
              parent: (id)aParent
 {
@@ -322,6 +328,16 @@
 
 @implementation DKProxyStandin
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationProxyStandin);
+  }
+  return obj;
+}
+
 - (id)initWithEndpoint: (DKEndpoint*)anEndpoint
                service: (NSString*)aService
                   path: (NSString*)aPath
@@ -383,6 +399,7 @@
   DESTROY(endpoint);
   DESTROY(service);
   DESTROY(path);
+  DKCountDeallocation(DKAllocationProxyStandin);
   [super dealloc];
 }
 @end
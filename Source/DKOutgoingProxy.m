@@ -22,6 +22,7 @@
    */
 
 #import "DKOutgoingProxy.h"
+#import "DKAllocationCounters.h"
 #import "DKPort+Private.h"
 #import "DKInterface.h"
 #import "DKMethod.h"
@@ -49,7 +50,20 @@
 #import <Foundation/NSGarbageCollector.h>
 #endif
 
+#include <stdlib.h>
+
 @implementation DKOutgoingProxy
+
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationOutgoingProxy);
+  }
+  return obj;
+}
+
 + (id)proxyWithName: (NSString*)aName
              parent: (id<DKObjectPathNode>)parentNode
              object: (id)anObject
@@ -355,9 +369,47 @@
   return DBUS_HANDLER_RESULT_HANDLED;
 }
 
+/**
+ * Adds an interface generated from the Objective-C runtime to the proxy,
+ * unless the proxy already has an interface of that name (e.g. one loaded from
+ * an introspection file). The generated interfaces are shared between all
+ * proxies for objects of the same class and have no proxy as their parent.
+ * DKMethodReturn makes the proxy handling a call available to them while the
+ * call is converted.
+ */
+- (void)_addGeneratedInterface: (DKInterface*)theIf
+{
+  if ((nil == theIf) || (nil != [[self _interfaces] objectForKey: [theIf name]]))
+  {
+    return;
+  }
+  [self _addInterface: theIf];
+}
+
+/**
+ * Introspects the Objective-C class of the object, its superclasses, and the
+ * protocols they adopt. The interfaces are only generated once per class or
+ * protocol and cached by DKInterface.
+ */
 - (void)_installClassPermittedMessages
 {
-	// Introspects the Obj-C class of the object
+  Class theClass = object_getClass(object);
+  while (Nil != theClass)
+  {
+    unsigned int protocolCount = 0;
+    Protocol **protocols = class_copyProtocolList(theClass, &protocolCount);
+    unsigned int i = 0;
+    [self _addGeneratedInterface: [DKInterface interfaceForObjCClass: theClass]];
+    for (i = 0; i < protocolCount; i++)
+    {
+      [self _addGeneratedInterface: [DKInterface interfaceForObjCProtocol: protocols[i]]];
+    }
+    if (NULL != protocols)
+    {
+      free(protocols);
+    }
+    theClass = class_getSuperclass(theClass);
+  }
 }
 
 
@@ -377,6 +429,7 @@
   */
   if (DK_CACHE_BUILT > state)
   {
+    [self _installClassPermittedMessages];
     state = DK_CACHE_BUILT; 
     [self _installAllInterfaces];
   }
@@ -506,4 +559,10 @@
 {
   [super _addInterface: iface];
 }
+
+- (void)dealloc
+{
+  DKCountDeallocation(DKAllocationOutgoingProxy);
+  [super dealloc];
+}
 @end
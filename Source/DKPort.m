@@ -22,11 +22,15 @@
 
 #import "DBusKit/DKPort.h"
 #import "DBusKit/DKNotificationCenter.h"
+#import "DKAllocationCounters.h"
+#import "DKTrace.h"
 #import "DKProxy+Private.h"
 #import "DKPort+Private.h"
 #import "DKOutgoingProxy.h"
 #import "DKEndpoint.h"
 #import "DKEndpointManager.h"
+#import "DKMethodCall.h"
+#import "DKResultCache.h"
 
 #import <Foundation/NSArray.h>
 #import <Foundation/NSConnection.h>
@@ -166,6 +170,45 @@ static DKPort *sharedSystemPort;
   [[DKEndpointManager sharedEndpointManager] enableThread];
 }
 
++ (void)setWorkerThreadCPU: (NSInteger)cpu
+        schedulingPriority: (NSInteger)priority
+          busyPollInterval: (NSTimeInterval)interval
+{
+  [[DKEndpointManager sharedEndpointManager] setWorkerCPU: cpu
+                                       schedulingPriority: priority
+                                         busyPollInterval: interval];
+}
+
++ (void)setTracingEnabled: (BOOL)flag
+{
+  DKTraceSetEnabled(flag);
+}
+
++ (BOOL)writeTraceToFile: (NSString*)path
+{
+  return DKTraceWriteChromeJSON([path fileSystemRepresentation]);
+}
+
++ (NSDictionary*)allocationStatistics
+{
+  return DKAllocationStatistics();
+}
+
++ (void)setCoalescesIdempotentCalls: (BOOL)flag
+{
+  [DKMethodCall setCoalescesIdempotentCalls: flag];
+}
+
++ (NSDictionary*)resultCacheStatistics
+{
+  return [[DKResultCache sharedCache] statistics];
+}
+
++ (void)setResultCacheCapacity: (NSUInteger)capacity
+{
+  [[DKResultCache sharedCache] setCapacity: capacity];
+}
+
 - (void)_registerNotifications
 {
   DKDBusBusType busType = [endpoint DBusBusType];
@@ -374,6 +417,55 @@ static DKPort *sharedSystemPort;
   return endpoint;
 }
 
+- (void)setCollectsStatistics: (BOOL)yesno
+{
+  [endpoint setCollectsStatistics: yesno];
+}
+
+- (BOOL)startCapturingToFile: (NSString*)path
+{
+  return [endpoint startCapturingToFile: path];
+}
+
+- (void)stopCapturing
+{
+  [endpoint stopCapturing];
+}
+
+- (NSDictionary*)statistics
+{
+  DKEndpointStatistics stats = [endpoint statistics];
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedLongLong: stats.messagesSent], @"messagesSent",
+    [NSNumber numberWithUnsignedLongLong: stats.bytesSent], @"bytesSent",
+    [NSNumber numberWithUnsignedLongLong: stats.messagesReceived], @"messagesReceived",
+    [NSNumber numberWithUnsignedLongLong: stats.bytesReceived], @"bytesReceived",
+    [NSNumber numberWithUnsignedLongLong: stats.maxMessageSize], @"maxMessageSize",
+    [NSNumber numberWithUnsignedLongLong: stats.outgoingQueueSize], @"outgoingQueueSize",
+    [NSNumber numberWithDouble: (stats.dispatchTime / 1000000.0)], @"dispatchTime",
+    nil];
+}
+
+- (void)setMaximumReceivedSize: (NSUInteger)size
+{
+  [endpoint setMaximumReceivedSize: size];
+}
+
+- (void)setMaximumMessageSize: (NSUInteger)size
+{
+  [endpoint setMaximumMessageSize: size];
+}
+
+- (void)setOutgoingQueueThreshold: (NSUInteger)size
+{
+  [endpoint setOutgoingQueueThreshold: size];
+}
+
+- (void)setMessageSizeThreshold: (NSUInteger)size
+{
+  [endpoint setMessageSizeThreshold: size];
+}
+
 /**
  * Returns the name of the remote.
  */
@@ -24,22 +24,68 @@
 
 #import "DBusKit/DKPort.h"
 #import "DBusKit/DKPortNameServer.h"
+#import "DBusKit/DKNotificationCenter.h"
 
+#import "DKEndpoint.h"
 #import "DKEndpointManager.h"
+#import "DKPort+Private.h"
+#import "DKProxy+Private.h"
 
+#import <Foundation/NSArray.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSHashTable.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSMapTable.h>
+#import <Foundation/NSNotification.h>
 #import <Foundation/NSString.h>
+#import <Foundation/NSThread.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSValue.h>
 
 #include <stdint.h>
 #include <dbus/dbus.h>
 
+NSString *DKPortNameAcquiredNotification = @"DKPortNameAcquiredNotification";
+NSString *DKPortNameLostNotification = @"DKPortNameLostNotification";
+
 @interface DKPortNameServer (Private)
 
 - (id) initWithBusType: (DKDBusBusType)type;
+- (void)_checkPort: (DKPort*)port;
+- (void)_observeNameOwnership;
+- (void)_recordStatus: (DKPortNameRegistrationStatus)status
+              forName: (NSString*)name;
+- (void)_recordThreadForName: (NSString*)name;
+- (void)_postNotificationName: (NSString*)notificationName
+                      forName: (NSString*)name;
+- (void)_notifyTargetWithReply: (NSDictionary*)reply
+                     resultKey: (NSString*)key;
 @end
 
+/*
+ * The DKPortNameFlags do not use the same bit positions as the flags in the
+ * D-Bus specification, so they need to be converted before being sent to the
+ * bus.
+ */
+static uint32_t
+DKDBusNameFlagsFromPortNameFlags(DKPortNameFlags flags)
+{
+  uint32_t dbusFlags = 0;
+  if (flags & DKPortNameAllowReplacement)
+  {
+    dbusFlags |= DBUS_NAME_FLAG_ALLOW_REPLACEMENT;
+  }
+  if (flags & DKPortNameDoNotQueue)
+  {
+    dbusFlags |= DBUS_NAME_FLAG_DO_NOT_QUEUE;
+  }
+  if (flags & DKPortNameReplaceExisting)
+  {
+    dbusFlags |= DBUS_NAME_FLAG_REPLACE_EXISTING;
+  }
+  return dbusFlags;
+}
+
 static DKPortNameServer *systemBusNameServer;
 static DKPortNameServer *sessionBusNameServer;
 
@@ -108,7 +154,9 @@ static DKPortNameServer *sessionBusNameServer;
   busType = type;
   queuedNames  = NSCreateHashTable(NSObjectHashCallBacks, 3);
   activeNames = NSCreateHashTable(NSObjectHashCallBacks, 3);
-
+  nameThreads = NSCreateMapTable(NSObjectMapKeyCallBacks,
+    NSObjectMapValueCallBacks, 3);
+  lock = [NSRecursiveLock new];
 
   return self;
 }
@@ -132,14 +180,263 @@ static DKPortNameServer *sessionBusNameServer;
                                         name: (NSString*)name
                                        flags: (DKPortNameFlags)flags
 {
-  [NSException raise: NSGenericException
-              format: @"Not implemented"];
-  return DKPortNameExists;
+  id<DKDBusStub> bus = [DKDBus busWithBusType: busType];
+  NSNumber *dbusFlags = [NSNumber numberWithUnsignedInt:
+    DKDBusNameFlagsFromPortNameFlags(flags)];
+  DKPortNameRegistrationStatus status;
+
+  [self _checkPort: port];
+  [self _observeNameOwnership];
+  [self _recordThreadForName: name];
+  status = [[bus RequestName: name : dbusFlags] unsignedIntValue];
+  [self _recordStatus: status
+              forName: name];
+  return status;
+}
+
+- (void)registerPort: (DKPort*)port
+                name: (NSString*)name
+               flags: (DKPortNameFlags)flags
+              target: (id)target
+            selector: (SEL)selector
+{
+  NSNumber *dbusFlags = [NSNumber numberWithUnsignedInt:
+    DKDBusNameFlagsFromPortNameFlags(flags)];
+  NSMutableDictionary *info = [NSMutableDictionary dictionaryWithObject: name
+                                                                 forKey: @"name"];
+
+  [self _checkPort: port];
+  [self _observeNameOwnership];
+  [self _recordThreadForName: name];
+  if (nil != target)
+  {
+    [info setObject: target
+             forKey: @"target"];
+    [info setObject: NSStringFromSelector(selector)
+             forKey: @"selector"];
+  }
+  [[DKDBus busWithBusType: busType] callMethod: @selector(RequestName::)
+                                 withArguments: [NSArray arrayWithObjects: name, dbusFlags, nil]
+                                        target: self
+                                      selector: @selector(_requestNameCompleted:)
+                                      userInfo: info];
 }
 
 - (void)removePortForName: (NSString*)name
 {
+  id<DKDBusStub> bus = [DKDBus busWithBusType: busType];
+  if (nil == name)
+  {
+    return;
+  }
+  [bus ReleaseName: name];
+  [lock lock];
+  NSHashRemove(activeNames, name);
+  NSHashRemove(queuedNames, name);
+  NSMapRemove(nameThreads, name);
+  [lock unlock];
+}
+
+- (void)startServiceWithName: (NSString*)name
+                      target: (id)target
+                    selector: (SEL)selector
+{
+  NSMutableDictionary *info = [NSMutableDictionary dictionaryWithObject: name
+                                                                 forKey: @"name"];
+  if (nil != target)
+  {
+    [info setObject: target
+             forKey: @"target"];
+    [info setObject: NSStringFromSelector(selector)
+             forKey: @"selector"];
+  }
+  // The flags argument to StartServiceByName is currently unused by D-Bus.
+  [[DKDBus busWithBusType: busType] callMethod: @selector(StartServiceByName::)
+                                 withArguments: [NSArray arrayWithObjects: name,
+                                                  [NSNumber numberWithUnsignedInt: 0], nil]
+                                        target: self
+                                      selector: @selector(_startServiceCompleted:)
+                                      userInfo: info];
+}
+
+- (void)_checkPort: (DKPort*)port
+{
+  if ((nil != port) && ([[port endpoint] DBusBusType] != busType))
+  {
+    [NSException raise: @"DKInvalidArgumentException"
+                format: @"Cannot register a name for a port on a different bus."];
+  }
+}
+
+/*
+ * Passes the reply to an asynchronous call made with
+ * -callMethod:withArguments:target:selector:userInfo: on to the target the
+ * caller specified, if any.
+ */
+- (void)_notifyTargetWithReply: (NSDictionary*)reply
+                     resultKey: (NSString*)key
+{
+  NSDictionary *info = [reply objectForKey: @"userInfo"];
+  id target = [info objectForKey: @"target"];
+  NSException *exception = [reply objectForKey: @"exception"];
+  id result = [reply objectForKey: @"result"];
+  NSMutableDictionary *targetReply = nil;
+  if (nil == target)
+  {
+    return;
+  }
+  targetReply = [NSMutableDictionary dictionaryWithObject: [info objectForKey: @"name"]
+                                                   forKey: @"name"];
+  if (nil != exception)
+  {
+    [targetReply setObject: exception
+                    forKey: @"exception"];
+  }
+  else if (nil != result)
+  {
+    [targetReply setObject: result
+                    forKey: key];
+  }
+  [target performSelector: NSSelectorFromString([info objectForKey: @"selector"])
+               withObject: targetReply];
+}
+
+- (void)_requestNameCompleted: (NSDictionary*)reply
+{
+  if (nil == [reply objectForKey: @"exception"])
+  {
+    [self _recordStatus: [[reply objectForKey: @"result"] unsignedIntValue]
+                forName: [[reply objectForKey: @"userInfo"] objectForKey: @"name"]];
+  }
+  [self _notifyTargetWithReply: reply
+                     resultKey: @"status"];
+}
+
+- (void)_startServiceCompleted: (NSDictionary*)reply
+{
+  [self _notifyTargetWithReply: reply
+                     resultKey: @"result"];
+}
 
+- (void)_recordStatus: (DKPortNameRegistrationStatus)status
+              forName: (NSString*)name
+{
+  [lock lock];
+  switch (status)
+  {
+    case DKPortNamePrimaryOwner:
+    case DKPortNameAlreadyOwner:
+      NSHashRemove(queuedNames, name);
+      NSHashInsertIfAbsent(activeNames, name);
+      break;
+    case DKPortNameQueued:
+      NSHashInsertIfAbsent(queuedNames, name);
+      break;
+    default:
+      break;
+  }
+  [lock unlock];
+}
+
+/*
+ * Remembers the calling thread as the one to notify about changes in the
+ * ownership of <var>name</var>.
+ */
+- (void)_recordThreadForName: (NSString*)name
+{
+  [lock lock];
+  NSMapInsert(nameThreads, name, [NSThread currentThread]);
+  [lock unlock];
+}
+
+/*
+ * Posts a notification about <var>name</var> to the default notification
+ * center of the thread that requested the name. The signals announcing the
+ * change are received on the worker thread.
+ */
+- (void)_postNotificationName: (NSString*)notificationName
+                      forName: (NSString*)name
+{
+  NSNotification *notification = [NSNotification notificationWithName: notificationName
+                                                                object: self
+                                                              userInfo: [NSDictionary dictionaryWithObject: name
+                                                                                                    forKey: @"name"]];
+  NSThread *thread = nil;
+  [lock lock];
+  thread = [[(NSThread*)NSMapGet(nameThreads, name) retain] autorelease];
+  [lock unlock];
+  if ((nil == thread) || [thread isFinished]
+    || [thread isEqual: [NSThread currentThread]])
+  {
+    [[NSNotificationCenter defaultCenter] postNotification: notification];
+    return;
+  }
+  [[NSNotificationCenter defaultCenter] performSelector: @selector(postNotification:)
+                                               onThread: thread
+                                             withObject: notification
+                                          waitUntilDone: NO];
+}
+
+/**
+ * Starts watching the NameAcquired and NameLost signals the first time a name
+ * is requested, so that the tables stay correct when queued names become
+ * active or active names are replaced by another connection.
+ */
+- (void)_observeNameOwnership
+{
+  DKNotificationCenter *center = nil;
+  DKDBus *bus = nil;
+  if (observingNames)
+  {
+    return;
+  }
+  [lock lock];
+  if (NO == observingNames)
+  {
+    center = [DKNotificationCenter centerForBusType: busType];
+    bus = [DKDBus busWithBusType: busType];
+    [center addObserver: self
+               selector: @selector(_nameAcquired:)
+                 signal: @"NameAcquired"
+              interface: @"org.freedesktop.DBus"
+                 sender: bus
+            destination: nil];
+    [center addObserver: self
+               selector: @selector(_nameLost:)
+                 signal: @"NameLost"
+              interface: @"org.freedesktop.DBus"
+                 sender: bus
+            destination: nil];
+    observingNames = YES;
+  }
+  [lock unlock];
+}
+
+- (void)_nameAcquired: (NSNotification*)notification
+{
+  NSString *name = [[notification userInfo] objectForKey: @"arg0"];
+  if (NO == [name isKindOfClass: [NSString class]])
+  {
+    return;
+  }
+  [self _recordStatus: DKPortNamePrimaryOwner
+              forName: name];
+  [self _postNotificationName: DKPortNameAcquiredNotification
+                      forName: name];
+}
+
+- (void)_nameLost: (NSNotification*)notification
+{
+  NSString *name = [[notification userInfo] objectForKey: @"arg0"];
+  if (NO == [name isKindOfClass: [NSString class]])
+  {
+    return;
+  }
+  [lock lock];
+  NSHashRemove(activeNames, name);
+  [lock unlock];
+  [self _postNotificationName: DKPortNameLostNotification
+                      forName: name];
 }
 
 - (NSUInteger) retainCount
@@ -164,6 +461,8 @@ static DKPortNameServer *sessionBusNameServer;
 {
   NSFreeHashTable(queuedNames);
   NSFreeHashTable(activeNames);
+  NSFreeMapTable(nameThreads);
+  [lock release];
   [super dealloc];
 }
 @end
@@ -0,0 +1,184 @@
+/** Implementation of DKPreparedCall to call a D-Bus method repeatedly.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import "DBusKit/DKPreparedCall.h"
+#import "DKMethod.h"
+#import "DKMethodCall.h"
+#import "DKProxy+Private.h"
+
+#import <Foundation/NSException.h>
+#import <Foundation/NSInvocation.h>
+#import <Foundation/NSMethodSignature.h>
+#import <Foundation/NSString.h>
+
+#ifndef DARLING
+#import <GNUstepBase/NSDebug+GNUstepBase.h>
+#else
+#import "config.h"
+#endif
+
+#include <dbus/dbus.h>
+#include <stdarg.h>
+
+@implementation DKPreparedCall
+
++ (id)preparedCallWithProxy: (DKProxy*)aProxy
+                   selector: (SEL)selector
+{
+  return [[[self alloc] initWithProxy: aProxy
+                             selector: selector] autorelease];
+}
+
+- (id)initWithProxy: (DKProxy*)aProxy
+           selector: (SEL)selector
+{
+  NSMethodSignature *signature = nil;
+  DKMethod *theMethod = nil;
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  theMethod = [aProxy DBusMethodForSelector: selector];
+  if (nil == theMethod)
+  {
+    [self release];
+    [NSException raise: @"DKInvalidArgumentException"
+                format: @"D-Bus object %@ does not recognize %@",
+      aProxy,
+      NSStringFromSelector(selector)];
+  }
+
+  /*
+   * Use the signature the proxy would use for a message send, this is the
+   * point where it gets validated against the D-Bus method.
+   */
+  signature = [aProxy methodSignatureForSelector: selector];
+  if (nil == signature)
+  {
+    signature = [theMethod methodSignature];
+  }
+  if (NO == [theMethod isValidForMethodSignature: signature])
+  {
+    [self release];
+    [NSException raise: @"DKInvalidArgumentException"
+                format: @"D-Bus object %@: Mismatched method signature for %@.",
+      aProxy,
+      NSStringFromSelector(selector)];
+  }
+
+  message = dbus_message_new_method_call([[aProxy _service] UTF8String],
+    [[aProxy _path] UTF8String],
+    [[theMethod interface] UTF8String],
+    [[theMethod name] UTF8String]);
+  if (NULL == message)
+  {
+    [self release];
+    return nil;
+  }
+  ASSIGN(proxy, aProxy);
+  ASSIGN(method, theMethod);
+  ASSIGN(invocation, [NSInvocation invocationWithMethodSignature: signature]);
+  [invocation setTarget: proxy];
+  [invocation setSelector: selector];
+  argumentCount = [signature numberOfArguments] - 2;
+  return self;
+}
+
+- (NSMethodSignature*)methodSignature
+{
+  return [invocation methodSignature];
+}
+
+- (NSUInteger)numberOfArguments
+{
+  return argumentCount;
+}
+
+/**
+ * Sends the call with the arguments already stored in the invocation.
+ */
+- (void)_invokeWithReturnValue: (void*)returnValue
+{
+  DKMethodCall *call = [[DKMethodCall alloc] initWithProxy: proxy
+                                                    method: method
+                                                invocation: invocation
+                                           templateMessage: message
+                                                   timeout: 0];
+  if (nil == call)
+  {
+    [NSException raise: @"DKDBusOutOfMemoryException"
+                format: @"Could not create D-Bus method call."];
+  }
+  NS_DURING
+  {
+    [call sendSynchronously];
+  }
+  NS_HANDLER
+  {
+    [call release];
+    [localException raise];
+  }
+  NS_ENDHANDLER
+  [call release];
+  if ((NULL != returnValue)
+    && ('v' != *[[invocation methodSignature] methodReturnType]))
+  {
+    [invocation getReturnValue: returnValue];
+  }
+}
+
+- (void)invokeWithArguments: (void**)arguments
+                returnValue: (void*)returnValue
+{
+  NSUInteger i = 0;
+  for (i = 0; i < argumentCount; i++)
+  {
+    [invocation setArgument: arguments[i]
+                    atIndex: (i + 2)];
+  }
+  [self _invokeWithReturnValue: returnValue];
+}
+
+- (void)invokeWithReturnValue: (void*)returnValue, ...
+{
+  va_list arguments;
+  NSUInteger i = 0;
+  va_start(arguments, returnValue);
+  for (i = 0; i < argumentCount; i++)
+  {
+    [invocation setArgument: va_arg(arguments, void*)
+                    atIndex: (i + 2)];
+  }
+  va_end(arguments);
+  [self _invokeWithReturnValue: returnValue];
+}
+
+- (void)dealloc
+{
+  if (NULL != message)
+  {
+    dbus_message_unref(message);
+  }
+  [invocation release];
+  [method release];
+  [proxy release];
+  [super dealloc];
+}
+@end
@@ -39,7 +39,7 @@ enum
 };
 
 
-@class DKInterface, DKNotificationCenter, NSXMLNode;
+@class DKInterface, DKMethod, DKNotificationCenter, NSXMLNode;
 
 @interface DKProxy (DKProxyPrivate) <DKObjectPathNode>
 - (DKPort*)_port;
@@ -54,6 +54,7 @@ enum
 - (BOOL)isKindOfClass: (Class)cls;
 - (DKProxy*)proxyParent;
 - (void)_installAllInterfaces;
+- (DKMethod*)DBusMethodForSelector: (SEL)selector;
 @end
 
 @interface DKDBus (DKDBusPrivate)
@@ -73,6 +74,9 @@ enum
 - (NSString*)GetNameOwner: (NSString*)name;
 - (void)AddMatch: (NSString*)matchRule;
 - (void)RemoveMatch: (NSString*)matchRule;
+- (NSNumber*)RequestName: (NSString*)name : (NSNumber*)flags;
+- (NSNumber*)ReleaseName: (NSString*)name;
+- (NSNumber*)StartServiceByName: (NSString*)name : (NSNumber*)flags;
 @end
 
 /**
@@ -21,6 +21,7 @@
    Boston, MA 02111 USA.
    */
 
+#import "DKAllocationCounters.h"
 #import "DKArgument.h"
 #import "DKEndpoint.h"
 #import "DKEndpointManager.h"
@@ -30,6 +31,7 @@
 #import "DKMethodCall.h"
 #import "DKProperty.h"
 #import "DKProxy+Private.h"
+#import "DKTrace.h"
 
 #import "DBusKit/DKNotificationCenter.h"
 
@@ -37,6 +39,7 @@
 #include "config.h"
 #undef INCLUDE_RUNTIME_H
 
+#import <Foundation/NSArray.h>
 #import <Foundation/NSCoder.h>
 #import <Foundation/NSData.h>
 #import <Foundation/NSException.h>
@@ -78,6 +81,18 @@ static IMP getServiceName;
 #define DK_PORT_ENDPOINT getEndpoint(port, getEndpointSelector)
 #define DK_PORT_SERVICE getServiceName(port, getServiceNameSelector)
 
+/*
+ * Table of all live proxies, keyed by a string identifying endpoint, service
+ * and path. It is used to hand out existing proxies instead of creating and
+ * introspecting new ones for the same object. The proxies are not retained,
+ * each one removes its entry in -dealloc. Only instances of DKProxy itself are
+ * registered, subclasses manage their instances on their own.
+ */
+static NSMapTable *liveProxies;
+static NSLock *liveProxiesLock;
+
+
+@class DKDeferredCall;
 
 @interface DKProxy (DKProxyInternal)
 
@@ -85,6 +100,15 @@ static IMP getServiceName;
 - (DKMethod*)_methodForSelector: (SEL)aSelector
                    waitForCache: (BOOL)doWait;
 - (BOOL)_buildMethodCache: (id)ignored;
+- (void)_buildMethodCacheFromData: (NSData*)introspectionData;
+- (void)_introspectionFailedWithException: (NSException*)exception;
+- (DKDeferredCall*)_deferCallMethod: (SEL)selector
+                      withArguments: (NSArray*)arguments
+                             target: (id)target
+                           selector: (SEL)callback
+                           userInfo: (id)userInfo;
+- (void)_removeDeferredCall: (id)call;
+- (void)_sendDeferredCalls;
 - (void)_installIntrospectionMethod;
 
 /* Define introspect on ourselves. */
@@ -108,8 +132,217 @@ DKInterface *_DKInterfaceIntrospectable;
 
 NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\"\n\"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">";
 
+/*
+ * A call made with -callMethod:withArguments:target:selector:userInfo: before
+ * the method cache of the proxy was built. It waits in the deferredCalls list
+ * of the proxy and is sent from the thread that made it once the proxy has
+ * been introspected.
+ */
+@interface DKDeferredCall : NSObject
+{
+  DKProxy *proxy;
+  SEL selector;
+  NSArray *arguments;
+  id target;
+  SEL callback;
+  id userInfo;
+  NSThread *thread;
+  NSLock *lock;
+  /* The call that was sent once the method cache was ready. */
+  id call;
+  BOOL isCancelled;
+  BOOL isFinished;
+}
+- (id)initWithProxy: (DKProxy*)aProxy
+             method: (SEL)aSelector
+          arguments: (NSArray*)args
+             target: (id)aTarget
+           selector: (SEL)aCallback
+           userInfo: (id)info;
+- (void)send;
+- (void)failWithException: (NSException*)exception;
+- (BOOL)cancel;
+- (BOOL)isCancelled;
+@end
+
+@implementation DKDeferredCall
+- (id)initWithProxy: (DKProxy*)aProxy
+             method: (SEL)aSelector
+          arguments: (NSArray*)args
+             target: (id)aTarget
+           selector: (SEL)aCallback
+           userInfo: (id)info
+{
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  ASSIGN(proxy, aProxy);
+  selector = aSelector;
+  ASSIGNCOPY(arguments, args);
+  ASSIGN(target, aTarget);
+  callback = aCallback;
+  ASSIGN(userInfo, info);
+  ASSIGN(thread, [NSThread currentThread]);
+  lock = [NSLock new];
+  return self;
+}
+
+/*
+ * Performs <var>aSelector</var> on the thread that made the call.
+ */
+- (void)_performOnCallingThread: (SEL)aSelector
+                     withObject: (id)object
+{
+  if ([thread isEqual: [NSThread currentThread]]
+    || (NO == [thread isExecuting]))
+  {
+    [self performSelector: aSelector
+               withObject: object];
+  }
+  else
+  {
+    [self performSelector: aSelector
+                 onThread: thread
+               withObject: object
+            waitUntilDone: NO];
+  }
+}
+
+- (void)_deliverException: (NSException*)exception
+{
+  NSMutableDictionary *reply = nil;
+  if (nil == target)
+  {
+    return;
+  }
+  reply = [NSMutableDictionary dictionaryWithCapacity: 2];
+  [reply setObject: exception
+            forKey: @"exception"];
+  if (nil != userInfo)
+  {
+    [reply setObject: userInfo
+              forKey: @"userInfo"];
+  }
+  [target performSelector: callback
+               withObject: reply];
+}
+
+- (void)_send: (id)ignored
+{
+  NSException *exception = nil;
+  [lock lock];
+  if (isCancelled || isFinished)
+  {
+    [lock unlock];
+    return;
+  }
+  isFinished = YES;
+  NS_DURING
+  {
+    ASSIGN(call, [proxy callMethod: selector
+                     withArguments: arguments
+                            target: target
+                          selector: callback
+                          userInfo: userInfo]);
+  }
+  NS_HANDLER
+  {
+    exception = localException;
+  }
+  NS_ENDHANDLER
+  [lock unlock];
+  if (nil != exception)
+  {
+    [self _deliverException: exception];
+  }
+}
+
+- (void)_fail: (NSException*)exception
+{
+  [lock lock];
+  if (isCancelled || isFinished)
+  {
+    [lock unlock];
+    return;
+  }
+  isFinished = YES;
+  [lock unlock];
+  [self _deliverException: exception];
+}
+
+- (void)send
+{
+  [self _performOnCallingThread: @selector(_send:)
+                     withObject: nil];
+}
+
+- (void)failWithException: (NSException*)exception
+{
+  [self _performOnCallingThread: @selector(_fail:)
+                     withObject: exception];
+}
+
+- (BOOL)cancel
+{
+  id sentCall = nil;
+  BOOL didCancel = NO;
+  [lock lock];
+  if (isCancelled)
+  {
+    [lock unlock];
+    return NO;
+  }
+  if (isFinished)
+  {
+    sentCall = [call retain];
+    [lock unlock];
+    didCancel = [sentCall cancel];
+    [sentCall release];
+    return didCancel;
+  }
+  isCancelled = YES;
+  [lock unlock];
+  [proxy _removeDeferredCall: self];
+  [self _performOnCallingThread: @selector(_deliverException:)
+                     withObject: DKCallCancelledException()];
+  return YES;
+}
+
+- (BOOL)isCancelled
+{
+  BOOL cancelled = NO;
+  [lock lock];
+  cancelled = isCancelled || [call isCancelled];
+  [lock unlock];
+  return cancelled;
+}
+
+- (void)dealloc
+{
+  [proxy release];
+  [arguments release];
+  [target release];
+  [userInfo release];
+  [thread release];
+  [lock release];
+  [call release];
+  [super dealloc];
+}
+@end
+
 @implementation DKProxy
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationProxy);
+  }
+  return obj;
+}
+
 + (void)initialize
 {
   if ([DKProxy class] == self)
@@ -137,6 +370,9 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
     getServiceNameSelector = @selector(serviceName);
     getServiceName = class_getMethodImplementation([DKPort class],
       getServiceNameSelector);
+    liveProxies = NSCreateMapTable(NSObjectMapKeyCallBacks,
+      NSNonRetainedObjectMapValueCallBacks, 64);
+    liveProxiesLock = [NSLock new];
   }
 }
 
@@ -188,11 +424,28 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
               path: (NSString*)aPath
 {
   // This class derives from NSProxy, hence no call to -[super init].
+  NSString *key = nil;
+  DKProxy *existing = nil;
   if (((nil == aPort)) || (nil == aPath))
   {
     [self release];
     return nil;
   }
+  if ([DKProxy class] == object_getClass(self))
+  {
+    key = [NSString stringWithFormat: @"%p %@ %@",
+      getEndpoint(aPort, getEndpointSelector),
+      getServiceName(aPort, getServiceNameSelector),
+      aPath];
+    [liveProxiesLock lock];
+    existing = [NSMapGet(liveProxies, key) retain];
+    [liveProxiesLock unlock];
+    if (nil != existing)
+    {
+      [self release];
+      return existing;
+    }
+  }
   ASSIGNCOPY(path, aPath);
   ASSIGN(port, aPort);
   tableLock = [[NSLock alloc] init];
@@ -200,6 +453,27 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   state = DK_NO_TABLES;
   [self _setupTables];
   [self _installIntrospectionMethod];
+
+  /*
+   * Only publish the proxy once it is completely set up. If another thread
+   * registered a proxy for the same object in the meantime, we use that one.
+   */
+  if (nil != key)
+  {
+    [liveProxiesLock lock];
+    existing = [NSMapGet(liveProxies, key) retain];
+    if (nil == existing)
+    {
+      NSMapInsert(liveProxies, key, self);
+      ASSIGN(uniqueKey, key);
+    }
+    [liveProxiesLock unlock];
+    if (nil != existing)
+    {
+      [self release];
+      return existing;
+    }
+  }
   return self;
 }
 
@@ -666,6 +940,306 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   [call release];
 }
 
+- (id)callMethod: (SEL)selector
+   withArguments: (NSArray*)arguments
+          target: (id)target
+        selector: (SEL)callback
+        userInfo: (id)userInfo
+{
+  DKMethod *method = nil;
+  NSMethodSignature *signature = nil;
+  NSInvocation *inv = nil;
+  DKMethodCall *call = nil;
+  NSMutableDictionary *info = nil;
+  NSUInteger count = [arguments count];
+  NSUInteger i = 0;
+  DKDeferredCall *deferred = [self _deferCallMethod: selector
+                                      withArguments: arguments
+                                             target: target
+                                           selector: callback
+                                           userInfo: userInfo];
+
+  if (nil != deferred)
+  {
+    return deferred;
+  }
+  method = [self DBusMethodForSelector: selector];
+  if (nil == method)
+  {
+    NSString *interface = nil;
+    SEL newSel = [self _unmangledSelector: selector
+                                interface: &interface];
+    if (0 != newSel)
+    {
+      selector = newSel;
+      if (nil != interface)
+      {
+        [tableLock lock];
+        method = [(DKInterface*)[interfaces objectForKey: interface] DBusMethodForSelector: newSel];
+        [tableLock unlock];
+      }
+      else
+      {
+        method = [self DBusMethodForSelector: newSel];
+      }
+    }
+  }
+  if (nil == method)
+  {
+    [NSException raise: @"DKInvalidArgumentException"
+                format: @"D-Bus object %@ for service %@ does not recognize %@",
+      path,
+      DK_PORT_SERVICE,
+     NSStringFromSelector(selector)];
+  }
+
+  // The boxed signature takes an object for every D-Bus argument:
+  signature = [method methodSignature];
+  if (([signature numberOfArguments] - 2) != count)
+  {
+    [NSException raise: @"DKInvalidArgumentException"
+                format: @"D-Bus object %@ for service %@: %@ expects %lu arguments, got %lu.",
+      path,
+      DK_PORT_SERVICE,
+      NSStringFromSelector(selector),
+      (unsigned long)([signature numberOfArguments] - 2),
+      (unsigned long)count];
+  }
+
+  inv = [NSInvocation invocationWithMethodSignature: signature];
+  [inv setTarget: self];
+  [inv setSelector: selector];
+  for (i = 0; i < count; i++)
+  {
+    id arg = [arguments objectAtIndex: i];
+    [inv setArgument: &arg
+             atIndex: (i + 2)];
+  }
+  [inv retainArguments];
+
+  info = [NSMutableDictionary dictionaryWithCapacity: 3];
+  if (nil != target)
+  {
+    [info setObject: target
+             forKey: @"target"];
+    [info setObject: NSStringFromSelector(callback)
+             forKey: @"selector"];
+  }
+  if (nil != userInfo)
+  {
+    [info setObject: userInfo
+             forKey: @"userInfo"];
+  }
+
+  call = [[DKMethodCall alloc] initWithProxy: self
+                                      method: method
+                                  invocation: inv];
+  [call setUserInfo: info];
+  [call sendAsynchronouslyWithTarget: self
+                            selector: @selector(_asynchronousCallCompleted:)];
+  return [call autorelease];
+}
+
+/**
+ * Queues a call made with -callMethod:withArguments:target:selector:userInfo:
+ * if the method cache has not been built yet, so that the caller does not wait
+ * for the proxy to be introspected. Unless this is already happening, the
+ * proxy is introspected asynchronously on the worker thread. Returns nil if the
+ * call can be sent right away.
+ */
+- (DKDeferredCall*)_deferCallMethod: (SEL)selector
+                      withArguments: (NSArray*)arguments
+                             target: (id)target
+                           selector: (SEL)callback
+                           userInfo: (id)userInfo
+{
+  DKDeferredCall *deferred = nil;
+  BOOL startIntrospection = NO;
+  if (sel_isEqual(@selector(Introspect), selector))
+  {
+    return nil;
+  }
+  [condition lock];
+  if (DK_CACHE_READY != state)
+  {
+    deferred = [[DKDeferredCall alloc] initWithProxy: self
+                                              method: selector
+                                           arguments: arguments
+                                              target: target
+                                            selector: callback
+                                            userInfo: userInfo];
+    if (nil == deferredCalls)
+    {
+      deferredCalls = [NSMutableArray new];
+    }
+    [deferredCalls addObject: deferred];
+    if (DK_HAVE_INTROSPECT >= state)
+    {
+      state = DK_BUILDING_CACHE;
+      startIntrospection = YES;
+    }
+  }
+  [condition unlock];
+
+  if (startIntrospection)
+  {
+    [[DKEndpointManager sharedEndpointManager] boolReturnForPerformingSelector: @selector(_introspectAsynchronously:)
+                                                                        target: self
+                                                                          data: NULL
+                                                                 waitForReturn: NO];
+  }
+  return [deferred autorelease];
+}
+
+/**
+ * Sends the Introspect call for the deferred calls. Runs on the worker thread,
+ * so that the reply is handled there and does not depend on the run loop of
+ * the thread that made the call.
+ */
+- (BOOL)_introspectAsynchronously: (id)ignored
+{
+  DKTrace(DKTraceIntrospectBegin, [path UTF8String], 0);
+  NS_DURING
+  {
+    [self callMethod: @selector(Introspect)
+       withArguments: [NSArray array]
+              target: self
+            selector: @selector(_introspectionReceived:)
+            userInfo: nil];
+  }
+  NS_HANDLER
+  {
+    DKTrace(DKTraceIntrospectEnd, [path UTF8String], 0);
+    [self _introspectionFailedWithException: localException];
+  }
+  NS_ENDHANDLER
+  return YES;
+}
+
+- (void)_introspectionReceived: (NSDictionary*)reply
+{
+  NSException *exception = [reply objectForKey: @"exception"];
+  if (nil == exception)
+  {
+    NS_DURING
+    {
+      [self _buildMethodCacheFromData: [[reply objectForKey: @"result"] dataUsingEncoding: NSUTF8StringEncoding]];
+    }
+    NS_HANDLER
+    {
+      exception = localException;
+    }
+    NS_ENDHANDLER
+  }
+  DKTrace(DKTraceIntrospectEnd, [path UTF8String], 0);
+  if (nil != exception)
+  {
+    [self _introspectionFailedWithException: exception];
+  }
+}
+
+/**
+ * Resets the proxy after introspecting it failed and fails the calls that were
+ * waiting for the method cache.
+ */
+- (void)_introspectionFailedWithException: (NSException*)exception
+{
+  NSArray *calls = nil;
+  [condition lock];
+  if (DK_CACHE_READY != state)
+  {
+    state = DK_HAVE_INTROSPECT;
+  }
+  calls = deferredCalls;
+  deferredCalls = nil;
+  [condition broadcast];
+  [condition unlock];
+  [calls makeObjectsPerformSelector: @selector(failWithException:)
+                         withObject: exception];
+  [calls release];
+}
+
+- (void)_removeDeferredCall: (id)call
+{
+  [condition lock];
+  [deferredCalls removeObjectIdenticalTo: call];
+  [condition unlock];
+}
+
+/**
+ * Sends the calls that were waiting for the method cache.
+ */
+- (void)_sendDeferredCalls
+{
+  NSArray *calls = nil;
+  [condition lock];
+  calls = deferredCalls;
+  deferredCalls = nil;
+  [condition unlock];
+  [calls makeObjectsPerformSelector: @selector(send)];
+  [calls release];
+}
+
++ (BOOL)cancelSynchronousCallOnThread: (NSThread*)thread
+{
+  return [DKMethodCall cancelSynchronousCallOnThread: thread];
+}
+
+- (void)setResultCacheTTL: (NSTimeInterval)ttl
+      invalidatedBySignal: (NSString*)signalName
+              forSelector: (SEL)selector
+{
+  DKMethod *method = [self DBusMethodForSelector: selector];
+  if (nil == method)
+  {
+    [NSException raise: @"DKInvalidArgumentException"
+                format: @"D-Bus object %@ for service %@ does not recognize %@",
+      path,
+      DK_PORT_SERVICE,
+      NSStringFromSelector(selector)];
+  }
+  [method setResultCacheTTL: ttl
+         invalidationSignal: signalName];
+}
+
+/**
+ * Reports the outcome of a call made with
+ * -callMethod:withArguments:target:selector:userInfo: to the caller.
+ */
+- (void)_asynchronousCallCompleted: (DKMethodCall*)call
+{
+  NSDictionary *info = [call userInfo];
+  id target = [info objectForKey: @"target"];
+  NSMutableDictionary *reply = nil;
+  if (nil == target)
+  {
+    return;
+  }
+  reply = [NSMutableDictionary dictionaryWithCapacity: 2];
+  if (nil != [info objectForKey: @"userInfo"])
+  {
+    [reply setObject: [info objectForKey: @"userInfo"]
+              forKey: @"userInfo"];
+  }
+  if (nil != [call exception])
+  {
+    [reply setObject: [call exception]
+              forKey: @"exception"];
+  }
+  else if ('@' == *[[[call invocation] methodSignature] methodReturnType])
+  {
+    id result = nil;
+    [[call invocation] getReturnValue: &result];
+    if (nil != result)
+    {
+      [reply setObject: result
+                forKey: @"result"];
+    }
+  }
+  [target performSelector: NSSelectorFromString([info objectForKey: @"selector"])
+               withObject: reply];
+}
+
 - (BOOL)isKindOfClass: (Class)aClass
 {
 #ifndef DARLING
@@ -757,6 +1331,35 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   return [port isEqual: [aProxy _port]];
 }
 
+/**
+ * Proxies are equal if they refer to the same object path of the same service
+ * on the same bus. This matches DKLazyProxy, which stands in for a proxy
+ * without creating it.
+ */
+- (BOOL)isEqual: (id)other
+{
+  if (other == self)
+  {
+    return YES;
+  }
+  if ((nil == other) || (NO == [other isKindOfClass: [DKProxy class]]))
+  {
+    return NO;
+  }
+  if ([other isProxy] && (NO == [other respondsToSelector: @selector(_path)]))
+  {
+    return NO;
+  }
+  return ([path isEqualToString: [other _path]]
+    && [DK_PORT_SERVICE isEqualToString: [other _service]]
+    && [DK_PORT_ENDPOINT isEqual: [other _endpoint]]);
+}
+
+- (NSUInteger)hash
+{
+  return [path hash];
+}
+
 - (void) _installIntrospectionMethod
 {
   [condition lock];
@@ -824,7 +1427,7 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   state = DK_CACHE_READY;
   [condition broadcast];
   [condition unlock];
-
+  [self _sendDeferredCalls];
 }
 
 - (void)_setupTables
@@ -909,11 +1512,8 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
 
 - (BOOL)_buildMethodCache: (id)ignored
 {
-  DKIntrospectionParserDelegate *delegate = [[DKIntrospectionParserDelegate alloc] initWithParentForNodes: self];
-  NSXMLParser *parser = nil;
   NSData *introspectionData = nil;
 
-
   [condition lock];
   while (DK_WILL_BUILD_CACHE != state)
   {
@@ -922,6 +1522,7 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   state = DK_BUILDING_CACHE;
   [condition unlock];
 
+  DKTrace(DKTraceIntrospectBegin, [path UTF8String], 0);
   // Get the introspection data, reset ourselves
   NS_DURING
   {
@@ -929,18 +1530,27 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   }
   NS_HANDLER
   {
-    [condition lock];
-    if (DK_CACHE_READY != state)
-    {
-      state = DK_HAVE_INTROSPECT;
-    }
-    [delegate release];
-    [condition broadcast];
-    [condition unlock];
+    DKTrace(DKTraceIntrospectEnd, [path UTF8String], 0);
+    [self _introspectionFailedWithException: localException];
     [localException raise];
   }
   NS_ENDHANDLER
 
+  [self _buildMethodCacheFromData: introspectionData];
+  DKTrace(DKTraceIntrospectEnd, [path UTF8String], 0);
+  return YES;
+}
+
+/**
+ * Generates the introspection tree from <var>introspectionData</var> and
+ * installs the interfaces found in it. Needs to be called in the
+ * DK_BUILDING_CACHE state.
+ */
+- (void)_buildMethodCacheFromData: (NSData*)introspectionData
+{
+  DKIntrospectionParserDelegate *delegate = [[DKIntrospectionParserDelegate alloc] initWithParentForNodes: self];
+  NSXMLParser *parser = nil;
+
   [condition lock];
 
   if (DK_BUILDING_CACHE == state)
@@ -975,7 +1585,6 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   // Cleanup
   [parser release];
   [delegate release];
-  return YES;
 }
 
 /*
@@ -1078,6 +1687,15 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
 
 - (void) dealloc
 {
+  if (nil != uniqueKey)
+  {
+    [liveProxiesLock lock];
+    if (self == NSMapGet(liveProxies, uniqueKey))
+    {
+      NSMapRemove(liveProxies, uniqueKey);
+    }
+    [liveProxiesLock unlock];
+  }
   [port release];
   [path release];
   [interfaces release];
@@ -1085,6 +1703,9 @@ NSString *kDKDBusDocType = @"<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS O
   [activeInterface release];
   [tableLock release];
   [condition release];
+  [deferredCalls release];
+  [uniqueKey release];
+  DKCountDeallocation(DKAllocationProxy);
   [super dealloc];
 }
 
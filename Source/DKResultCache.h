@@ -0,0 +1,123 @@
+/** Interface for the client-side cache of method results.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/NSObject.h>
+#include <dbus/dbus.h>
+#include <stdint.h>
+
+@class DKEndpoint, DKProxy, NSData, NSDictionary, NSLock, NSMutableArray,
+  NSMutableDictionary, NSString;
+
+/**
+ * DKResultCache stores the replies to calls of methods that have opted into
+ * result caching (see -[DKMethod resultCacheTTL]). Replies are keyed by the
+ * call message in wire format, i.e. by object, method and arguments, and
+ * expire after the time-to-live of the method. The number of cached replies is
+ * bounded: When the cache is full, expired replies are removed first, and the
+ * oldest reply otherwise.
+ *
+ * Replies are grouped by the method they belong to, so that all results for a
+ * method can be invalidated at once, e.g. when the remote object emits a
+ * signal indicating that its state changed.
+ */
+@interface DKResultCache: NSObject
+{
+  NSLock *lock;
+  NSMutableDictionary *entries;
+  NSMutableArray *order;
+  NSMutableDictionary *invalidators;
+  NSMutableDictionary *generations;
+  NSUInteger capacity;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t expirations;
+  uint64_t invalidations;
+}
+
+/**
+ * Returns the process-wide result cache.
+ */
++ (DKResultCache*)sharedCache;
+
+/**
+ * Returns the name of the group that replies to <var>msg</var>, sent through
+ * <var>endpoint</var>, belong to.
+ */
++ (NSString*)groupForMessage: (DBusMessage*)msg
+                    endpoint: (DKEndpoint*)endpoint;
+
+/**
+ * Returns the cached reply for <var>key</var> with a reference owned by the
+ * caller, or NULL if there is no reply or it has expired.
+ */
+- (DBusMessage*)replyForKey: (NSData*)key;
+
+/**
+ * Returns the number of times <var>group</var> has been invalidated. Callers
+ * obtain it before sending a call and pass it on when storing the reply.
+ */
+- (uint64_t)generationForGroup: (NSString*)group;
+
+/**
+ * Stores <var>reply</var> for <var>key</var> for <var>ttl</var> seconds. The
+ * reply is dropped if <var>group</var> has been invalidated since
+ * <var>generation</var> was obtained, because it might predate the change
+ * that caused the invalidation.
+ */
+- (void)storeReply: (DBusMessage*)reply
+            forKey: (NSData*)key
+             group: (NSString*)group
+        generation: (uint64_t)generation
+               ttl: (NSTimeInterval)ttl;
+
+/**
+ * Removes all replies belonging to <var>group</var> and starts a new
+ * generation for it.
+ */
+- (void)invalidateGroup: (NSString*)group;
+
+/**
+ * Arranges for <var>group</var> to be invalidated whenever <var>proxy</var>
+ * emits the signal named <var>signal</var>. The signal name may be qualified
+ * with an interface name, otherwise <var>interface</var> is used. Has no effect
+ * if the group is already being watched.
+ */
+- (void)invalidateGroup: (NSString*)group
+               onSignal: (NSString*)signal
+              interface: (NSString*)interface
+                  proxy: (DKProxy*)proxy;
+
+/**
+ * Sets the maximum number of cached replies. The default is 256.
+ */
+- (void)setCapacity: (NSUInteger)newCapacity;
+
+/**
+ * Removes all cached replies.
+ */
+- (void)removeAllReplies;
+
+/**
+ * Returns the hit, miss, eviction, expiration and invalidation counts as well
+ * as the number of cached replies and the capacity of the cache.
+ */
+- (NSDictionary*)statistics;
+@end
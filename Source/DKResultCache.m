@@ -0,0 +1,413 @@
+/** Implementation of the client-side cache of method results.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import "DKResultCache.h"
+#import "DKEndpoint.h"
+#import "DKProxy+Private.h"
+
+#import "DBusKit/DKNotificationCenter.h"
+
+#import <Foundation/NSArray.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSException.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#ifndef DARLING
+#import <GNUstepBase/NSDebug+GNUstepBase.h>
+#else
+#import "config.h"
+#endif
+
+#include <time.h>
+
+#define DKResultCacheDefaultCapacity 256
+
+static double
+DKResultCacheNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + ((double)now.tv_nsec / 1e9);
+}
+
+@interface DKResultCacheEntry: NSObject
+{
+  @public
+  DBusMessage *reply;
+  NSString *group;
+  double expiry;
+}
+@end
+
+@implementation DKResultCacheEntry
+- (void)dealloc
+{
+  if (NULL != reply)
+  {
+    dbus_message_unref(reply);
+  }
+  [group release];
+  [super dealloc];
+}
+@end
+
+/*
+ * Observes the signal that invalidates the replies of a group.
+ */
+@interface DKResultCacheInvalidator: NSObject
+{
+  NSString *group;
+}
+- (id)initWithGroup: (NSString*)aGroup;
+- (void)signalReceived: (NSNotification*)notification;
+@end
+
+@implementation DKResultCacheInvalidator
+- (id)initWithGroup: (NSString*)aGroup
+{
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  ASSIGNCOPY(group, aGroup);
+  return self;
+}
+
+- (void)signalReceived: (NSNotification*)notification
+{
+  [[DKResultCache sharedCache] invalidateGroup: group];
+}
+
+- (void)dealloc
+{
+  [group release];
+  [super dealloc];
+}
+@end
+
+static DKResultCache *sharedCache;
+
+@interface DKResultCache (Private)
+- (void)_removeEntryForKey: (NSData*)key;
+- (uint64_t)_generationForGroup: (NSString*)group;
+@end
+
+@implementation DKResultCache
+
++ (void)initialize
+{
+  if ([DKResultCache class] == self)
+  {
+    sharedCache = [[DKResultCache alloc] init];
+  }
+}
+
++ (DKResultCache*)sharedCache
+{
+  return sharedCache;
+}
+
++ (NSString*)groupForMessage: (DBusMessage*)msg
+                    endpoint: (DKEndpoint*)endpoint
+{
+  const char *destination = dbus_message_get_destination(msg);
+  const char *path = dbus_message_get_path(msg);
+  const char *interface = dbus_message_get_interface(msg);
+  const char *member = dbus_message_get_member(msg);
+  return [NSString stringWithFormat: @"%p %s %s %s.%s",
+    endpoint,
+    destination ? destination : "",
+    path ? path : "",
+    interface ? interface : "",
+    member ? member : ""];
+}
+
+- (id)init
+{
+  if (nil == (self = [super init]))
+  {
+    return nil;
+  }
+  lock = [NSLock new];
+  entries = [NSMutableDictionary new];
+  order = [NSMutableArray new];
+  invalidators = [NSMutableDictionary new];
+  generations = [NSMutableDictionary new];
+  capacity = DKResultCacheDefaultCapacity;
+  return self;
+}
+
+- (void)_removeEntryForKey: (NSData*)key
+{
+  // Retain the key, it might only be referenced by the collections.
+  [key retain];
+  [entries removeObjectForKey: key];
+  [order removeObject: key];
+  [key release];
+}
+
+/*
+ * Makes room for a new entry. Needs to be called with the lock held.
+ */
+- (void)_evictIfNeeded
+{
+  double now = 0;
+  NSUInteger i = 0;
+  if ([entries count] < capacity)
+  {
+    return;
+  }
+  now = DKResultCacheNow();
+  while (i < [order count])
+  {
+    NSData *key = [order objectAtIndex: i];
+    DKResultCacheEntry *entry = [entries objectForKey: key];
+    if (entry->expiry <= now)
+    {
+      [self _removeEntryForKey: key];
+      expirations++;
+    }
+    else
+    {
+      i++;
+    }
+  }
+  while (([entries count] >= capacity) && (0 != [order count]))
+  {
+    [self _removeEntryForKey: [order objectAtIndex: 0]];
+    evictions++;
+  }
+}
+
+- (DBusMessage*)replyForKey: (NSData*)key
+{
+  DKResultCacheEntry *entry = nil;
+  DBusMessage *reply = NULL;
+  if (nil == key)
+  {
+    return NULL;
+  }
+  [lock lock];
+  entry = [entries objectForKey: key];
+  if ((nil != entry) && (entry->expiry <= DKResultCacheNow()))
+  {
+    [self _removeEntryForKey: key];
+    expirations++;
+    entry = nil;
+  }
+  if (nil == entry)
+  {
+    misses++;
+  }
+  else
+  {
+    hits++;
+    reply = dbus_message_ref(entry->reply);
+  }
+  [lock unlock];
+  return reply;
+}
+
+/*
+ * Needs to be called with the lock held.
+ */
+- (uint64_t)_generationForGroup: (NSString*)group
+{
+  return [[generations objectForKey: group] unsignedLongLongValue];
+}
+
+- (uint64_t)generationForGroup: (NSString*)group
+{
+  uint64_t generation = 0;
+  if (nil == group)
+  {
+    return 0;
+  }
+  [lock lock];
+  generation = [self _generationForGroup: group];
+  [lock unlock];
+  return generation;
+}
+
+- (void)storeReply: (DBusMessage*)reply
+            forKey: (NSData*)key
+             group: (NSString*)group
+        generation: (uint64_t)generation
+               ttl: (NSTimeInterval)ttl
+{
+  DKResultCacheEntry *entry = nil;
+  if ((NULL == reply) || (nil == key) || (ttl <= 0) || (0 == capacity))
+  {
+    return;
+  }
+  entry = [DKResultCacheEntry new];
+  entry->reply = dbus_message_ref(reply);
+  entry->group = [group copy];
+  entry->expiry = DKResultCacheNow() + ttl;
+  [lock lock];
+  if (generation != [self _generationForGroup: group])
+  {
+    [lock unlock];
+    [entry release];
+    return;
+  }
+  if (nil != [entries objectForKey: key])
+  {
+    [self _removeEntryForKey: key];
+  }
+  [self _evictIfNeeded];
+  [entries setObject: entry
+              forKey: key];
+  [order addObject: key];
+  [lock unlock];
+  [entry release];
+}
+
+- (void)invalidateGroup: (NSString*)group
+{
+  NSUInteger i = 0;
+  if (nil == group)
+  {
+    return;
+  }
+  [lock lock];
+  [generations setObject: [NSNumber numberWithUnsignedLongLong:
+    ([self _generationForGroup: group] + 1)]
+                  forKey: group];
+  while (i < [order count])
+  {
+    NSData *key = [order objectAtIndex: i];
+    DKResultCacheEntry *entry = [entries objectForKey: key];
+    if ([entry->group isEqualToString: group])
+    {
+      [self _removeEntryForKey: key];
+      invalidations++;
+    }
+    else
+    {
+      i++;
+    }
+  }
+  [lock unlock];
+}
+
+- (void)invalidateGroup: (NSString*)group
+               onSignal: (NSString*)signal
+              interface: (NSString*)interface
+                  proxy: (DKProxy*)proxy
+{
+  DKResultCacheInvalidator *invalidator = nil;
+  NSRange dot = [signal rangeOfString: @"."
+                              options: NSBackwardsSearch];
+  if ((nil == group) || (0 == [signal length]))
+  {
+    return;
+  }
+  if (NSNotFound != dot.location)
+  {
+    interface = [signal substringToIndex: dot.location];
+    signal = [signal substringFromIndex: NSMaxRange(dot)];
+  }
+
+  [lock lock];
+  if (nil != [invalidators objectForKey: group])
+  {
+    [lock unlock];
+    return;
+  }
+  invalidator = [[DKResultCacheInvalidator alloc] initWithGroup: group];
+  [invalidators setObject: invalidator
+                   forKey: group];
+  [lock unlock];
+
+  // Registering the observer talks to the bus, so we must not hold the lock.
+  NS_DURING
+  {
+    [[DKNotificationCenter centerForBusType: [[proxy _endpoint] DBusBusType]]
+      addObserver: invalidator
+         selector: @selector(signalReceived:)
+           signal: signal
+        interface: interface
+           sender: proxy
+      destination: nil];
+  }
+  NS_HANDLER
+  {
+    NSWarnMLog(@"Could not watch %@ to invalidate cached results: %@",
+      signal, localException);
+    [lock lock];
+    [invalidators removeObjectForKey: group];
+    [lock unlock];
+  }
+  NS_ENDHANDLER
+  [invalidator release];
+}
+
+- (void)setCapacity: (NSUInteger)newCapacity
+{
+  [lock lock];
+  capacity = newCapacity;
+  while ([entries count] > capacity)
+  {
+    [self _removeEntryForKey: [order objectAtIndex: 0]];
+    evictions++;
+  }
+  [lock unlock];
+}
+
+- (void)removeAllReplies
+{
+  [lock lock];
+  [entries removeAllObjects];
+  [order removeAllObjects];
+  [lock unlock];
+}
+
+- (NSDictionary*)statistics
+{
+  NSDictionary *stats = nil;
+  [lock lock];
+  stats = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedLongLong: hits], @"hits",
+    [NSNumber numberWithUnsignedLongLong: misses], @"misses",
+    [NSNumber numberWithUnsignedLongLong: evictions], @"evictions",
+    [NSNumber numberWithUnsignedLongLong: expirations], @"expirations",
+    [NSNumber numberWithUnsignedLongLong: invalidations], @"invalidations",
+    [NSNumber numberWithUnsignedInteger: [entries count]], @"entries",
+    [NSNumber numberWithUnsignedInteger: capacity], @"capacity",
+    nil];
+  [lock unlock];
+  return stats;
+}
+
+- (void)dealloc
+{
+  [lock release];
+  [entries release];
+  [order release];
+  [invalidators release];
+  [generations release];
+  [super dealloc];
+}
+@end
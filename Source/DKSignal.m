@@ -22,6 +22,7 @@
    */
 
 #import "DKSignal.h"
+#import "DKAllocationCounters.h"
 
 #import "DKArgument.h"
 
@@ -46,6 +47,16 @@
 
 @implementation DKSignal
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationSignal);
+  }
+  return obj;
+}
+
 - (id) initWithName: (NSString*)aName
              parent: (id)aParent
 {
@@ -252,6 +263,7 @@
 - (void)dealloc
 {
   [args release];
+  DKCountDeallocation(DKAllocationSignal);
   [super dealloc];
 }
 @end
@@ -22,6 +22,7 @@
    Boston, MA 02111 USA.
    */
 
+#import "DKAllocationCounters.h"
 #import "DKSignal.h"
 #import "DKSignalEmission.h"
 #import "DKObjectPathNode.h"
@@ -46,6 +47,15 @@
 
 @implementation DKSignalEmission
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationSignalEmission);
+  }
+  return obj;
+}
 
 + (void)emitSignal: (DKSignal*)signal
                for: (id<DKExportableObjectPathNode>)proxy
@@ -157,4 +167,9 @@
     waitForReturn: NO];
 }
 
+- (void)dealloc
+{
+  DKCountDeallocation(DKAllocationSignalEmission);
+  [super dealloc];
+}
 @end
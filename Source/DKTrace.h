@@ -0,0 +1,115 @@
+/** Declarations of the DBusKit trace recorder.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/NSObject.h>
+#include <stdint.h>
+
+/*
+ * The trace recorder writes fixed-size events into a ring buffer owned by the
+ * recording thread, so that recording needs neither locks nor allocations.
+ * When a buffer wraps around, the oldest events are overwritten. The recorded
+ * events can be exported in the JSON format understood by chrome://tracing and
+ * Perfetto.
+ *
+ * Tracing is disabled by default. While it is disabled, the DKTrace() macro
+ * costs a single load and a (predicted) branch. Setting the DBUSKIT_TRACE
+ * environment variable to a file name enables tracing on startup and writes
+ * the trace to that file when the process exits.
+ */
+
+/**
+ * The kinds of events that can be recorded. Begin/end events need to be
+ * recorded on the same thread, with the exception of asynchronous calls, which
+ * are matched by the identifier passed as the argument.
+ */
+typedef enum
+{
+  DKTraceCallBegin = 0,
+  DKTraceCallEnd,
+  DKTraceAsyncCallBegin,
+  DKTraceAsyncCallEnd,
+  DKTraceMarshalBegin,
+  DKTraceMarshalEnd,
+  DKTraceUnmarshalBegin,
+  DKTraceUnmarshalEnd,
+  DKTraceWorkerEnqueue,
+  DKTraceWorkerBegin,
+  DKTraceWorkerEnd,
+  DKTraceDispatchBegin,
+  DKTraceDispatchEnd,
+  DKTraceSignal,
+  DKTraceIntrospectBegin,
+  DKTraceIntrospectEnd
+} DKTraceEventType;
+
+/**
+ * Nonzero while tracing is enabled. Use the DKTrace() macro instead of
+ * checking this directly.
+ */
+extern volatile int DKTraceIsEnabled;
+
+/**
+ * Records an event of <var>type</var> for the current thread. At most the
+ * first 43 bytes of <var>name</var> (which may be NULL) are stored.
+ * <var>argument</var> is used to correlate asynchronous calls and worker
+ * handoffs.
+ */
+void
+DKTraceRecord(DKTraceEventType type, const char *name, uint64_t argument);
+
+/**
+ * Records an event if tracing is enabled. The name expression is only
+ * evaluated in that case.
+ */
+#define DKTrace(type, name, argument) do {\
+  if (__builtin_expect(DKTraceIsEnabled, 0))\
+  {\
+    DKTraceRecord((type), (name), (uint64_t)(argument));\
+  }\
+} while (0)
+
+/**
+ * Enables or disables recording of trace events.
+ */
+void
+DKTraceSetEnabled(BOOL flag);
+
+/**
+ * Discards all events recorded so far.
+ */
+void
+DKTraceReset(void);
+
+/**
+ * Writes all recorded events to the file at <var>path</var> in Chrome trace
+ * event format. Tracing should be disabled while the trace is being written,
+ * otherwise events recorded in the meantime might be garbled. Returns NO if
+ * the file could not be written.
+ */
+BOOL
+DKTraceWriteChromeJSON(const char *path);
+
+/**
+ * Enables tracing if the DBUSKIT_TRACE environment variable is set, and
+ * arranges for the trace to be written to the file it names on exit. Only
+ * has an effect the first time it is called.
+ */
+void
+DKTraceInitializeFromEnvironment(void);
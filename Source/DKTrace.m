@@ -0,0 +1,343 @@
+/** Implementation of the DBusKit trace recorder.
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import "DKTrace.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Number of events per thread, needs to be 2^n. With 64 byte events, this is
+ * 1MB per traced thread.
+ */
+#define DKTraceBufferSize ((uint64_t)16384)
+#define DKTraceBufferMask (DKTraceBufferSize - 1)
+
+#define DKTraceNameLength 44
+
+/*
+ * A single event. The layout is chosen so that an event occupies exactly 64
+ * bytes.
+ */
+typedef struct
+{
+  uint64_t timestamp;
+  uint64_t argument;
+  uint32_t type;
+  char name[DKTraceNameLength];
+} DKTraceEvent;
+
+typedef struct DKTraceBuffer
+{
+  DKTraceEvent *events;
+  /* Free-running count of events written, only modified by the owner. */
+  volatile uint64_t written;
+  uint32_t threadID;
+  struct DKTraceBuffer *next;
+} DKTraceBuffer;
+
+volatile int DKTraceIsEnabled = 0;
+
+static pthread_key_t traceKey;
+static pthread_once_t traceKeyOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * All buffers ever created. Buffers of threads that have exited are kept, so
+ * that their events can still be exported.
+ */
+static DKTraceBuffer *allBuffers = NULL;
+static pthread_mutex_t buffersLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t nextThreadID = 1;
+
+static char *traceFile = NULL;
+
+static void
+DKTraceCreateKey(void)
+{
+  pthread_key_create(&traceKey, NULL);
+}
+
+static DKTraceBuffer*
+DKTraceBufferForCurrentThread(void)
+{
+  DKTraceBuffer *buffer = NULL;
+  pthread_once(&traceKeyOnce, DKTraceCreateKey);
+  buffer = pthread_getspecific(traceKey);
+  if (NULL != buffer)
+  {
+    return buffer;
+  }
+  buffer = calloc(1, sizeof(DKTraceBuffer));
+  if (NULL == buffer)
+  {
+    return NULL;
+  }
+  buffer->events = calloc(DKTraceBufferSize, sizeof(DKTraceEvent));
+  if (NULL == buffer->events)
+  {
+    free(buffer);
+    return NULL;
+  }
+  pthread_mutex_lock(&buffersLock);
+  buffer->threadID = nextThreadID++;
+  buffer->next = allBuffers;
+  allBuffers = buffer;
+  pthread_mutex_unlock(&buffersLock);
+  pthread_setspecific(traceKey, buffer);
+  return buffer;
+}
+
+static inline uint64_t
+DKTraceNow(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((uint64_t)now.tv_sec * 1000000000) + (uint64_t)now.tv_nsec;
+}
+
+void
+DKTraceRecord(DKTraceEventType type, const char *name, uint64_t argument)
+{
+  DKTraceBuffer *buffer = DKTraceBufferForCurrentThread();
+  DKTraceEvent *event = NULL;
+  if (NULL == buffer)
+  {
+    return;
+  }
+  event = &buffer->events[buffer->written & DKTraceBufferMask];
+  event->timestamp = DKTraceNow();
+  event->argument = argument;
+  event->type = (uint32_t)type;
+  if (NULL != name)
+  {
+    strncpy(event->name, name, DKTraceNameLength - 1);
+    event->name[DKTraceNameLength - 1] = '\0';
+  }
+  else
+  {
+    event->name[0] = '\0';
+  }
+  // Publish the event only after it has been written completely.
+  __sync_synchronize();
+  buffer->written++;
+}
+
+void
+DKTraceSetEnabled(BOOL flag)
+{
+  DKTraceIsEnabled = (flag ? 1 : 0);
+  __sync_synchronize();
+}
+
+void
+DKTraceReset(void)
+{
+  DKTraceBuffer *buffer = NULL;
+  pthread_mutex_lock(&buffersLock);
+  for (buffer = allBuffers; NULL != buffer; buffer = buffer->next)
+  {
+    buffer->written = 0;
+  }
+  pthread_mutex_unlock(&buffersLock);
+}
+
+static void
+DKTraceWriteString(FILE *file, const char *string)
+{
+  const char *c = NULL;
+  fputc('"', file);
+  for (c = string; '\0' != *c; c++)
+  {
+    if (('"' == *c) || ('\\' == *c))
+    {
+      fputc('\\', file);
+      fputc(*c, file);
+    }
+    else if ((unsigned char)*c < 0x20)
+    {
+      fprintf(file, "\\u%04x", (unsigned int)(unsigned char)*c);
+    }
+    else
+    {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+/*
+ * Returns the phase and category of the Chrome trace event corresponding to
+ * the event type.
+ */
+static void
+DKTraceDescribeType(uint32_t type, const char **phase, const char **category)
+{
+  static const char *categories[] = {
+    "call", "call", "call", "call",
+    "marshal", "marshal", "unmarshal", "unmarshal",
+    "worker", "worker", "worker",
+    "dispatch", "dispatch",
+    "signal",
+    "introspect", "introspect"
+  };
+  static const char *phases[] = {
+    "B", "E", "b", "e",
+    "B", "E", "B", "E",
+    "i", "B", "E",
+    "B", "E",
+    "i",
+    "B", "E"
+  };
+  if (type > DKTraceIntrospectEnd)
+  {
+    *phase = "i";
+    *category = "unknown";
+    return;
+  }
+  *phase = phases[type];
+  *category = categories[type];
+}
+
+static void
+DKTraceWriteEvent(FILE *file, DKTraceEvent *event, uint32_t threadID,
+  int pid, BOOL *first)
+{
+  const char *phase = NULL;
+  const char *category = NULL;
+  DKTraceDescribeType(event->type, &phase, &category);
+  if (NO == *first)
+  {
+    fputs(",\n", file);
+  }
+  *first = NO;
+  fputs("{\"name\":", file);
+  DKTraceWriteString(file, ('\0' != event->name[0]) ? event->name : category);
+  fprintf(file, ",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%llu.%03llu,"
+    "\"pid\":%d,\"tid\":%u",
+    category, phase,
+    (unsigned long long)(event->timestamp / 1000),
+    (unsigned long long)(event->timestamp % 1000),
+    pid, threadID);
+  switch (event->type)
+  {
+    case DKTraceAsyncCallBegin:
+    case DKTraceAsyncCallEnd:
+      fprintf(file, ",\"id\":\"0x%llx\"", (unsigned long long)event->argument);
+      break;
+    case DKTraceWorkerEnqueue:
+    case DKTraceSignal:
+      fputs(",\"s\":\"t\"", file);
+      // Fall through
+    default:
+      fprintf(file, ",\"args\":{\"arg\":%llu}", (unsigned long long)event->argument);
+      break;
+  }
+  fputc('}', file);
+
+  // Draw an arrow from the enqueue operation to the worker picking it up:
+  if (DKTraceWorkerEnqueue == event->type)
+  {
+    fprintf(file, ",\n{\"name\":\"handoff\",\"cat\":\"worker\",\"ph\":\"s\","
+      "\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u,\"id\":%llu}",
+      (unsigned long long)(event->timestamp / 1000),
+      (unsigned long long)(event->timestamp % 1000),
+      pid, threadID, (unsigned long long)event->argument);
+  }
+  else if (DKTraceWorkerBegin == event->type)
+  {
+    fprintf(file, ",\n{\"name\":\"handoff\",\"cat\":\"worker\",\"ph\":\"f\","
+      "\"bp\":\"e\",\"ts\":%llu.%03llu,\"pid\":%d,\"tid\":%u,\"id\":%llu}",
+      (unsigned long long)(event->timestamp / 1000),
+      (unsigned long long)(event->timestamp % 1000),
+      pid, threadID, (unsigned long long)event->argument);
+  }
+}
+
+BOOL
+DKTraceWriteChromeJSON(const char *path)
+{
+  FILE *file = fopen(path, "w");
+  DKTraceBuffer *buffer = NULL;
+  BOOL first = YES;
+  int pid = (int)getpid();
+  if (NULL == file)
+  {
+    return NO;
+  }
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+  pthread_mutex_lock(&buffersLock);
+  for (buffer = allBuffers; NULL != buffer; buffer = buffer->next)
+  {
+    uint64_t end = buffer->written;
+    uint64_t start = 0;
+    uint64_t i = 0;
+    if (end > DKTraceBufferSize)
+    {
+      start = end - DKTraceBufferSize;
+    }
+    for (i = start; i < end; i++)
+    {
+      DKTraceWriteEvent(file, &buffer->events[i & DKTraceBufferMask],
+        buffer->threadID, pid, &first);
+    }
+  }
+  pthread_mutex_unlock(&buffersLock);
+  fputs("\n]}\n", file);
+  return (0 == fclose(file));
+}
+
+static void
+DKTraceWriteOnExit(void)
+{
+  DKTraceSetEnabled(NO);
+  if ((NULL != traceFile)
+    && (NO == DKTraceWriteChromeJSON(traceFile)))
+  {
+    fprintf(stderr, "DBusKit: Could not write trace to %s\n", traceFile);
+  }
+}
+
+static void
+DKTraceReadEnvironment(void)
+{
+  const char *path = getenv("DBUSKIT_TRACE");
+  if ((NULL == path) || ('\0' == *path))
+  {
+    return;
+  }
+  traceFile = strdup(path);
+  if (NULL == traceFile)
+  {
+    return;
+  }
+  atexit(DKTraceWriteOnExit);
+  DKTraceSetEnabled(YES);
+}
+
+void
+DKTraceInitializeFromEnvironment(void)
+{
+  static pthread_once_t environmentOnce = PTHREAD_ONCE_INIT;
+  pthread_once(&environmentOnce, DKTraceReadEnvironment);
+}
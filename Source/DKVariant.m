@@ -22,6 +22,7 @@
    */
 
 #import "DBusKit/DKVariant.h"
+#import "DKAllocationCounters.h"
 #import <Foundation/NSInvocation.h>
 #import <Foundation/NSLocale.h>
 #import <Foundation/NSString.h>
@@ -34,6 +35,16 @@
 
 @implementation DKVariant
 
++ (id)allocWithZone: (NSZone*)zone
+{
+  id obj = [super allocWithZone: zone];
+  if (nil != obj)
+  {
+    DKCountAllocation(DKAllocationVariant);
+  }
+  return obj;
+}
+
 + (id) variantWithObject: (id)obj
 {
   return [[[self alloc] initWithObject: obj] autorelease];
@@ -61,6 +72,7 @@
 - (void)dealloc
 {
   [object release];
+  DKCountDeallocation(DKAllocationVariant);
   [super dealloc];
 }
 
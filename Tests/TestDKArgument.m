@@ -23,6 +23,7 @@
 #import <Foundation/NSArray.h>
 #import <Foundation/NSDictionary.h>
 #import <Foundation/NSEnumerator.h>
+#import <Foundation/NSException.h>
 #import <Foundation/NSString.h>
 #import <Foundation/NSValue.h>
 #import <Foundation/NSXMLNode.h>
@@ -677,4 +678,65 @@ static NSDictionary *basicSigsAndClasses;
   [data release];
   [dataArg release];
 }
+
+- (void)testNestedMarshallingErrorIsReported
+{
+  DKArgument *arg = [[DKArgument alloc] initWithDBusSignature: "a{sv}"
+                                                         name: nil
+                                                       parent: nil];
+  NSArray *badStruct = [[NSArray alloc] initWithObjects: @"one", nil];
+  NSArray *inner = [[NSArray alloc] initWithObjects: badStruct, nil];
+  NSDictionary *good = [[NSDictionary alloc] initWithObjectsAndKeys:
+    [NSNumber numberWithInt: 5], @"five", nil];
+  DKMarshallingError error = {DKMarshallingSuccess, nil, nil};
+  DBusMessage *theMessage = NULL;
+  DBusMessageIter appendIter;
+  DBusMessageIter readIter;
+  theMessage = dbus_message_new_method_call("org.gnustep.dummy",
+    "/",
+    "org.gnustep.dummy",
+    "Dummy");
+  dbus_message_iter_init_append(theMessage, &appendIter);
+  UKTrue([arg marshallObject: good
+                intoIterator: &appendIter
+                       error: &error]);
+  UKIntsEqual(DKMarshallingSuccess, error.status);
+
+  // A struct argument cannot be used to unmarshall the dictionary:
+  dbus_message_iter_init(theMessage, &readIter);
+  DKArgument *structArg = [[DKArgument alloc] initWithDBusSignature: "(i)"
+                                                               name: nil
+                                                             parent: nil];
+  UKNil([structArg unmarshalledObjectFromIterator: &readIter
+                                            error: &error]);
+  UKIntsEqual(DKMarshallingTypeMismatch, error.status);
+  UKRaisesExceptionNamed([structArg unmarshalledObjectFromIterator: &readIter],
+    NSInternalInconsistencyException);
+  UKObjectsEqual(good, [arg unmarshalledObjectFromIterator: &readIter]);
+  dbus_message_unref(theMessage);
+
+  // Nested failures are propagated up to the outermost argument:
+  DKArgument *nestedArg = [[DKArgument alloc] initWithDBusSignature: "a(ii)"
+                                                               name: nil
+                                                             parent: nil];
+  error.status = DKMarshallingSuccess;
+  theMessage = dbus_message_new_method_call("org.gnustep.dummy",
+    "/",
+    "org.gnustep.dummy",
+    "Dummy");
+  dbus_message_iter_init_append(theMessage, &appendIter);
+  UKFalse([nestedArg marshallObject: inner
+                       intoIterator: &appendIter
+                              error: &error]);
+  UKIntsEqual(DKMarshallingInvalidObject, error.status);
+  UKObjectsSame(badStruct, error.object);
+  dbus_message_unref(theMessage);
+
+  [nestedArg release];
+  [structArg release];
+  [good release];
+  [inner release];
+  [badStruct release];
+  [arg release];
+}
 @end
@@ -0,0 +1,120 @@
+/* Unit tests for DKChannel
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+#import <Foundation/NSArray.h>
+#import <Foundation/NSData.h>
+#import <Foundation/NSFileHandle.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
+
+#import <UnitKit/UnitKit.h>
+
+#import "DBusKit/DKChannel.h"
+
+@interface TestDKChannel: NSObject <UKTest>
+@end
+
+@implementation TestDKChannel
+- (void)testRecordRoundTrip
+{
+  NSFileHandle *remote = nil;
+  DKChannel *writer = [DKChannel channelWithRecordSignature: @"ids"
+                                               remoteHandle: &remote];
+  DKChannel *reader = nil;
+  NSArray *record = nil;
+  NSUInteger i = 0;
+  UKNotNil(writer);
+  UKNotNil(remote);
+  reader = [[DKChannel alloc] initWithFileHandle: remote
+                                 recordSignature: nil];
+  UKNotNil(reader);
+  [writer setBatchSize: 7];
+  for (i = 0; i < 20; i++)
+  {
+    UKTrue([writer writeRecord: [NSArray arrayWithObjects:
+      [NSNumber numberWithInt: (int)i],
+      [NSNumber numberWithDouble: i / 2.0],
+      [NSString stringWithFormat: @"record %lu", (unsigned long)i], nil]]);
+  }
+  [writer close];
+
+  for (i = 0; i < 20; i++)
+  {
+    record = [reader readRecord];
+    UKIntsEqual(3, [record count]);
+    UKIntsEqual((int)i, [[record objectAtIndex: 0] intValue]);
+    UKObjectsEqual(([NSString stringWithFormat: @"record %lu", (unsigned long)i]),
+      [record objectAtIndex: 2]);
+  }
+  UKObjectsEqual(@"ids", [reader recordSignature]);
+  UKNil([reader readRecord]);
+  UKTrue([reader isAtEnd]);
+  [reader release];
+}
+
+- (void)testBadRecordIsRefusedWithoutLosingOthers
+{
+  NSFileHandle *remote = nil;
+  DKChannel *writer = [DKChannel channelWithRecordSignature: @"is"
+                                               remoteHandle: &remote];
+  DKChannel *reader = [[DKChannel alloc] initWithFileHandle: remote
+                                            recordSignature: @"is"];
+  NSArray *record = nil;
+  [writer setBatchSize: 3];
+  UKTrue([writer writeRecord: [NSArray arrayWithObjects:
+    [NSNumber numberWithInt: 1], @"one", nil]]);
+  UKRaisesException([writer writeRecord: [NSArray arrayWithObjects:
+    [NSNumber numberWithInt: 2], [NSArray array], nil]]);
+  UKTrue([writer writeRecord: [NSArray arrayWithObjects:
+    [NSNumber numberWithInt: 3], @"three", nil]]);
+  [writer close];
+
+  record = [reader readRecord];
+  UKIntsEqual(1, [[record objectAtIndex: 0] intValue]);
+  record = [reader readRecord];
+  UKIntsEqual(3, [[record objectAtIndex: 0] intValue]);
+  UKObjectsEqual(@"three", [record objectAtIndex: 1]);
+  UKNil([reader readRecord]);
+  [reader release];
+}
+
+- (void)testBackpressure
+{
+  NSFileHandle *remote = nil;
+  DKChannel *writer = [DKChannel channelWithRecordSignature: @"ay"
+                                               remoteHandle: &remote];
+  DKChannel *reader = [[DKChannel alloc] initWithFileHandle: remote
+                                            recordSignature: @"ay"];
+  NSArray *record = [NSArray arrayWithObject: [NSMutableData dataWithLength: 4096]];
+  NSUInteger accepted = 0;
+  [writer setBlocking: NO];
+  [writer setBatchSize: 1];
+  [writer setHighWaterMark: 65536];
+  [reader setBlocking: NO];
+  while ((accepted < 100000) && [writer writeRecord: record])
+  {
+    accepted++;
+  }
+  // The reader does not read, so the writer has to refuse records eventually.
+  UKTrue(accepted < 100000);
+  UKTrue([writer bufferedByteCount] > 0);
+  UKNotNil([reader readBatchData]);
+  [reader release];
+}
+@end
@@ -24,8 +24,11 @@
 #import <Foundation/NSNull.h>
 #import <UnitKit/UnitKit.h>
 
+#import "../Source/DKArgument.h"
 #import "../Source/DKInterface.h"
+#import "../Source/DKMethod.h"
 #import "../Source/DKProxy+Private.h"
+#import "DBusKit/DKGeneratedIntrospection.h"
 
 #include <string.h>
 @interface TestDKInterface: NSObject <UKTest>
@@ -53,6 +56,49 @@
 }
 @end
 
+/*
+ * Class exported through a table like the ones emitted by dk_make_dispatch.
+ * Only the first method passes the filter for exported methods.
+ */
+@interface GeneratedTestObject: NSObject
+- (NSString*)application: (id)app describe: (int)count;
+- (NSString*)describe: (int)count;
+@end
+
+@implementation GeneratedTestObject
+- (NSString*)application: (id)app describe: (int)count
+{
+  return nil;
+}
+
+- (NSString*)describe: (int)count
+{
+  return nil;
+}
+@end
+
+static const DKGeneratedArgument generatedArguments[] = {
+  {"s", NULL, "NSString", 1},
+  {"v", "app", NULL, 0},
+  {"i", "count", NULL, 0},
+};
+
+static const DKGeneratedArgument filteredArguments[] = {
+  {"s", NULL, "NSString", 1},
+  {"i", "count", NULL, 0},
+};
+
+static const DKGeneratedMethod generatedMethods[] = {
+  {"ApplicationDescribe", "application:describe:", generatedArguments, 3},
+  {"Describe", "describe:", filteredArguments, 2},
+};
+
+static const DKGeneratedInterface generatedInterfaces[] = {
+  {"GeneratedTestObject", 0, "org.gnustep.objc.class.GeneratedTestObject", generatedMethods, 2},
+};
+
+static DKGeneratedIntrospectionTable generatedTable = {generatedInterfaces, 1, NULL};
+
 @implementation TestDKInterface
 + (void)initialize
 {
@@ -101,4 +147,64 @@
   UKNil([[theIf methods] objectForKey: @"shouldNotBeExported"]);
 }
 
+- (void)testInterfacesAreCachedPerClass
+{
+  Class theClass = [ExportableTestObject class];
+  DKInterface *first = [DKInterface interfaceForObjCClass: theClass];
+  DKInterface *second = [DKInterface interfaceForObjCClass: theClass];
+  DKInterface *third = nil;
+  Method template = class_getInstanceMethod(theClass,
+    @selector(application:didSomethingWith:));
+  UKObjectsSame(first, second);
+  UKObjectsSame([DKInterface interfaceForObjCProtocol: objc_getProtocol("ExportableTestProtocol")],
+    [DKInterface interfaceForObjCProtocol: objc_getProtocol("ExportableTestProtocol")]);
+
+  // Adding a method at runtime requires invalidating the interface:
+  class_addMethod(theClass,
+    sel_registerName("application:didSomethingElseWith:"),
+    method_getImplementation(template),
+    method_getTypeEncoding(template));
+  UKObjectsSame(first, [DKInterface interfaceForObjCClass: theClass]);
+  [DKInterface invalidateInterfaceForObjCClass: theClass];
+  third = [DKInterface interfaceForObjCClass: theClass];
+  UKObjectsNotSame(first, third);
+  UKNotNil([[third methods] objectForKey: @"applicationDidSomethingElseWith"]);
+}
+
+- (void)testInterfaceFromGeneratedTable
+{
+  DKInterface *theIf = nil;
+  DKMethod *theMethod = nil;
+  DKRegisterGeneratedIntrospection(&generatedTable);
+  theIf = [DKInterface interfaceForObjCClass: [GeneratedTestObject class]];
+  UKNotNil(theIf);
+  UKObjectsEqual(@"org.gnustep.objc.class.GeneratedTestObject", [theIf name]);
+  theMethod = [[theIf methods] objectForKey: @"ApplicationDescribe"];
+  UKNotNil(theMethod);
+  UKObjectsEqual(@"application:describe:", [theMethod selectorString]);
+  UKObjectsEqual(@"s", [[theMethod DKArgumentAtIndex: -1] DBusTypeSignature]);
+  UKObjectsEqual(@"v", [[theMethod DKArgumentAtIndex: 0] DBusTypeSignature]);
+  UKObjectsEqual(@"i", [[theMethod DKArgumentAtIndex: 1] DBusTypeSignature]);
+  UKObjectsEqual(@"NSString",
+    [[theMethod DKArgumentAtIndex: -1] annotationValueForKey: @"org.gnustep.objc.class"]);
+  // Generated tables are subject to the same filter as the runtime:
+  UKNil([[theIf methods] objectForKey: @"Describe"]);
+}
+
+- (void)testNamesAreShared
+{
+  NSString *ifName = [NSString stringWithFormat: @"%@.%@", @"org.gnustep", @"Test"];
+  DKInterface *a = [[DKInterface alloc] initWithName: ifName
+                                              parent: nil];
+  DKInterface *b = [[DKInterface alloc] initWithName: [[ifName mutableCopy] autorelease]
+                                              parent: nil];
+  UKObjectsSame([a name], [b name]);
+  UKIntsEqual(0, [[a annotations] count]);
+  [a setAnnotationValue: @"Foo"
+                 forKey: @"org.gnustep.objc.protocol"];
+  UKObjectsEqual(@"Foo", [a annotationValueForKey: @"org.gnustep.objc.protocol"]);
+  UKIntsEqual(1, [[a annotations] count]);
+  [a release];
+  [b release];
+}
 @end
@@ -113,6 +113,19 @@
   UKObjectsEqual(@"- (NSString*)Introspect;", [method methodDeclaration]);
 }
 
+- (void)testIdempotentMethods
+{
+  DKMethod *introspect = [_DKInterfaceIntrospectable DBusMethodForSelector: @selector(Introspect)];
+  DKMethod *method = [[DKMethod alloc] initWithName: @"Fooify"
+                                             parent: nil];
+  UKTrue([introspect isIdempotent]);
+  UKFalse([method isIdempotent]);
+  [method setAnnotationValue: @"true"
+                      forKey: @"org.gnustep.dbuskit.Idempotent"];
+  UKTrue([method isIdempotent]);
+  [method release];
+}
+
 - (void)testReprarentInCopy
 {
   DKInterface *new = [_DKInterfaceIntrospectable copy];
@@ -21,19 +21,33 @@
 
    */
 #import <Foundation/NSConnection.h>
+#import <Foundation/NSException.h>
 #import <Foundation/NSInvocation.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
 #import <Foundation/NSMethodSignature.h>
+#import <Foundation/NSRunLoop.h>
 #import <Foundation/NSString.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSValue.h>
 #import <UnitKit/UnitKit.h>
 
 #import "DBusKit/DKPort.h"
 #import "DBusKit/DKProxy.h"
 #import "../Source/DKProxy+Private.h"
 #import "../Source/DKInterface.h"
+#import "../Source/DKEndpointManager.h"
 #import "../Source/DKMethodCall.h"
 #import "../Source/DKMethod.h"
 
 @interface TestDKMethodCall: NSObject <UKTest>
+{
+  DKMethodCall *completedCall;
+  NSConditionLock *workerLock;
+  NSLock *resultLock;
+  NSMutableDictionary *results;
+}
 @end
 
 @interface NSObject (FakeIntrospectionSelector)
@@ -67,4 +81,201 @@
   UKTrue([returnValue length] > 0);
   [call release];
 }
+
+- (void)callCompleted: (DKMethodCall*)call
+{
+  completedCall = call;
+}
+
+- (void)testAsynchronousMethodCall
+{
+  NSConnection *conn = nil;
+  id aProxy = nil;
+  NSMethodSignature *sig = [NSMethodSignature signatureWithObjCTypes: "@8@0:4"];
+  NSInvocation *inv = [NSInvocation invocationWithMethodSignature: sig];
+  DKMethodCall *call = nil;
+  id returnValue = nil;
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow: 5];
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: [[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"]];
+  aProxy = [conn rootProxy];
+  [inv setTarget: aProxy];
+  [inv setSelector: @selector(Introspect)];
+  call = [[DKMethodCall alloc] initWithProxy: aProxy
+                                      method: [_DKInterfaceIntrospectable DBusMethodForSelector: @selector(Introspect)]
+                                  invocation: inv];
+  completedCall = nil;
+  [call sendAsynchronouslyWithTarget: self
+                            selector: @selector(callCompleted:)];
+  while ((nil == completedCall) && ([deadline timeIntervalSinceNow] > 0))
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  }
+  UKObjectsSame(call, completedCall);
+  UKNil([call exception]);
+  UKDoesNotRaiseException([inv getReturnValue: &returnValue]);
+  UKNotNil(returnValue);
+  UKTrue([returnValue isKindOfClass: [NSString class]]);
+  [call release];
+}
+
+- (void)testCancelAsynchronousMethodCall
+{
+  NSConnection *conn = nil;
+  id aProxy = nil;
+  NSMethodSignature *sig = [NSMethodSignature signatureWithObjCTypes: "@8@0:4"];
+  NSInvocation *inv = [NSInvocation invocationWithMethodSignature: sig];
+  DKMethodCall *call = nil;
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow: 5];
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: [[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"]];
+  aProxy = [conn rootProxy];
+  [inv setTarget: aProxy];
+  [inv setSelector: @selector(Introspect)];
+  call = [[DKMethodCall alloc] initWithProxy: aProxy
+                                      method: [_DKInterfaceIntrospectable DBusMethodForSelector: @selector(Introspect)]
+                                  invocation: inv];
+  completedCall = nil;
+  [call sendAsynchronouslyWithTarget: self
+                            selector: @selector(callCompleted:)];
+  // The reply might win the race, in which case the call is not cancelled.
+  if ([call cancel])
+  {
+    UKTrue([call isCancelled]);
+    UKFalse([call cancel]);
+  }
+  while ((nil == completedCall) && ([deadline timeIntervalSinceNow] > 0))
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  }
+  UKObjectsSame(call, completedCall);
+  if ([call isCancelled])
+  {
+    UKStringsEqual(@"DKDBusCallCancelledException", [[call exception] name]);
+  }
+  else
+  {
+    UKNil([call exception]);
+  }
+  [call release];
+}
+
+/*
+ * Keeps the worker thread busy until workerLock is set to 1, so that calls
+ * stay in flight.
+ */
+- (BOOL)blockWorker: (id)ignored
+{
+  [workerLock lockWhenCondition: 1];
+  [workerLock unlock];
+  return YES;
+}
+
+/*
+ * Sends the call on a separate thread and records the name of the exception
+ * it raised, or the empty string if it succeeded.
+ */
+- (void)sendCallOnThread: (DKMethodCall*)call
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  NSString *result = @"";
+  NS_DURING
+  {
+    [call sendSynchronously];
+  }
+  NS_HANDLER
+  {
+    result = [localException name];
+  }
+  NS_ENDHANDLER
+  [resultLock lock];
+  [results setObject: result
+              forKey: [NSValue valueWithNonretainedObject: call]];
+  [resultLock unlock];
+  [arp release];
+}
+
+- (void)testCancelledLeaderDoesNotCancelCoalescedCalls
+{
+  NSConnection *conn = nil;
+  id aProxy = nil;
+  DKMethod *method = [_DKInterfaceIntrospectable DBusMethodForSelector: @selector(Introspect)];
+  NSMethodSignature *sig = [NSMethodSignature signatureWithObjCTypes: "@8@0:4"];
+  NSInvocation *leaderInv = [NSInvocation invocationWithMethodSignature: sig];
+  NSInvocation *followerInv = [NSInvocation invocationWithMethodSignature: sig];
+  DKMethodCall *leader = nil;
+  DKMethodCall *follower = nil;
+  NSDate *deadline = nil;
+  id returnValue = nil;
+  NSUInteger count = 0;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  [DKPort enableWorkerThread];
+  [DKMethodCall setCoalescesIdempotentCalls: YES];
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease]];
+  aProxy = [conn rootProxy];
+  // Make sure that the worker thread is running:
+  [aProxy Introspect];
+  [leaderInv setTarget: aProxy];
+  [leaderInv setSelector: @selector(Introspect)];
+  [followerInv setTarget: aProxy];
+  [followerInv setSelector: @selector(Introspect)];
+  leader = [[DKMethodCall alloc] initWithProxy: aProxy
+                                        method: method
+                                    invocation: leaderInv];
+  follower = [[DKMethodCall alloc] initWithProxy: aProxy
+                                          method: method
+                                      invocation: followerInv];
+  workerLock = [[NSConditionLock alloc] initWithCondition: 0];
+  resultLock = [NSLock new];
+  results = [NSMutableDictionary new];
+
+  /*
+   * While the worker is blocked, the leader cannot send its message, so the
+   * follower joins it and we can cancel the leader before the reply arrives.
+   */
+  [[DKEndpointManager sharedEndpointManager] boolReturnForPerformingSelector: @selector(blockWorker:)
+                                                                      target: self
+                                                                        data: NULL
+                                                               waitForReturn: NO];
+  [NSThread detachNewThreadSelector: @selector(sendCallOnThread:)
+                           toTarget: self
+                         withObject: leader];
+  [NSThread sleepForTimeInterval: 0.5];
+  [NSThread detachNewThreadSelector: @selector(sendCallOnThread:)
+                           toTarget: self
+                         withObject: follower];
+  [NSThread sleepForTimeInterval: 0.5];
+  UKTrue([leader cancel]);
+  [workerLock lock];
+  [workerLock unlockWithCondition: 1];
+
+  deadline = [NSDate dateWithTimeIntervalSinceNow: 5];
+  while ((count < 2) && ([deadline timeIntervalSinceNow] > 0))
+  {
+    [NSThread sleepForTimeInterval: 0.1];
+    [resultLock lock];
+    count = [results count];
+    [resultLock unlock];
+  }
+  UKIntsEqual(2, count);
+  UKStringsEqual(@"DKDBusCallCancelledException",
+    [results objectForKey: [NSValue valueWithNonretainedObject: leader]]);
+  UKStringsEqual(@"",
+    [results objectForKey: [NSValue valueWithNonretainedObject: follower]]);
+  UKDoesNotRaiseException([followerInv getReturnValue: &returnValue]);
+  UKTrue([returnValue isKindOfClass: [NSString class]]);
+  [results release];
+  results = nil;
+  [resultLock release];
+  resultLock = nil;
+  [workerLock release];
+  workerLock = nil;
+  [follower release];
+  [leader release];
+}
 @end
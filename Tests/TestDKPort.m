@@ -20,16 +20,29 @@
    Boston, MA 02111 USA.
 
    */
+#import <Foundation/NSArray.h>
 #import <Foundation/NSConnection.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSValue.h>
 #import <UnitKit/UnitKit.h>
 
 #import "DBusKit/DKPort.h"
 #import "DBusKit/DKProxy.h"
 #import "../Source/DKPort+Private.h"
 #import "../Source/DKObjectPathNode.h"
+#import "../Source/DKArgument.h"
+#import "../Source/DKMessageCapture.h"
+#import "../Source/DKTrace.h"
+
+#include <unistd.h>
 @interface TestDKPort: NSObject <UKTest>
 @end
 
+@interface NSObject (FakeIntrospectionSelector)
+- (NSString*)Introspect;
+@end
+
 @implementation TestDKPort
 - (void)testReturnProxy
 {
@@ -77,6 +90,110 @@
   [p _unregisterAllObjects];
 }
 
+- (void)testStatistics
+{
+  NSConnection *conn = nil;
+  DKPort *sendPort = [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease];
+  NSDictionary *stats = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  [sendPort setCollectsStatistics: YES];
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: sendPort];
+  [(id)[conn rootProxy] Introspect];
+  stats = [sendPort statistics];
+  UKTrue([[stats objectForKey: @"messagesSent"] unsignedLongLongValue] > 0);
+  UKTrue([[stats objectForKey: @"bytesSent"] unsignedLongLongValue] > 0);
+  UKTrue([[stats objectForKey: @"messagesReceived"] unsignedLongLongValue] > 0);
+  UKTrue([[stats objectForKey: @"maxMessageSize"] unsignedLongLongValue] > 0);
+  [sendPort setCollectsStatistics: NO];
+}
+
+- (void)testTraceExport
+{
+  NSConnection *conn = nil;
+  NSString *path = [NSString stringWithFormat: @"/tmp/dbuskit-trace-%d.json",
+    (int)getpid()];
+  NSString *trace = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease]];
+  DKTraceReset();
+  [DKPort setTracingEnabled: YES];
+  [(id)[conn rootProxy] Introspect];
+  [DKPort setTracingEnabled: NO];
+  UKTrue([DKPort writeTraceToFile: path]);
+  trace = [NSString stringWithContentsOfFile: path];
+  UKTrue([trace hasPrefix: @"{"]);
+  UKTrue([trace rangeOfString: @"\"traceEvents\""].location != NSNotFound);
+  UKTrue([trace rangeOfString: @"\"name\":\"Introspect\""].location != NSNotFound);
+  UKTrue([trace rangeOfString: @"\"cat\":\"dispatch\""].location != NSNotFound);
+  unlink([path fileSystemRepresentation]);
+}
+
+- (void)testMessageCapture
+{
+  NSConnection *conn = nil;
+  DKPort *sendPort = [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease];
+  NSString *path = [NSString stringWithFormat: @"/tmp/dbuskit-capture-%d.dkcap",
+    (int)getpid()];
+  DKMessageCapture *capture = nil;
+  DBusMessage *msg = NULL;
+  BOOL outgoing = NO;
+  NSUInteger sent = 0;
+  NSUInteger received = 0;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: sendPort];
+  UKTrue([sendPort startCapturingToFile: path]);
+  [(id)[conn rootProxy] Introspect];
+  [sendPort stopCapturing];
+
+  capture = [[DKMessageCapture alloc] initForReadingAtPath: path];
+  UKNotNil(capture);
+  while (NULL != (msg = [capture nextMessageOutgoing: &outgoing
+                                           timestamp: NULL]))
+  {
+    if (outgoing)
+    {
+      sent++;
+    }
+    else
+    {
+      received++;
+    }
+    dbus_message_unref(msg);
+  }
+  [capture release];
+  UKTrue(sent > 0);
+  UKTrue(received > 0);
+  unlink([path fileSystemRepresentation]);
+}
 
+- (void)testAllocationStatistics
+{
+  NSDictionary *before = [[DKPort allocationStatistics] objectForKey: @"DKArgument"];
+  NSDictionary *during = nil;
+  NSDictionary *after = nil;
+  NSMutableArray *args = [NSMutableArray new];
+  NSUInteger i = 0;
+  for (i = 0; i < 10; i++)
+  {
+    DKArgument *arg = [[DKArgument alloc] initWithDBusSignature: "i"
+                                                           name: nil
+                                                         parent: nil];
+    [args addObject: arg];
+    [arg release];
+  }
+  during = [[DKPort allocationStatistics] objectForKey: @"DKArgument"];
+  [args release];
+  after = [[DKPort allocationStatistics] objectForKey: @"DKArgument"];
+  UKNotNil(before);
+  UKTrue([[during objectForKey: @"allocated"] unsignedLongLongValue]
+    >= [[before objectForKey: @"allocated"] unsignedLongLongValue] + 10);
+  UKTrue([[during objectForKey: @"live"] longLongValue]
+    >= [[before objectForKey: @"live"] longLongValue] + 10);
+  UKTrue([[after objectForKey: @"live"] longLongValue]
+    <= [[during objectForKey: @"live"] longLongValue] - 10);
+}
 
 @end
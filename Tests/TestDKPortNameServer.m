@@ -0,0 +1,120 @@
+/* Unit tests for DKPortNameServer
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
+#import <Foundation/NSNotification.h>
+#import <Foundation/NSRunLoop.h>
+#import <Foundation/NSString.h>
+#import <Foundation/NSThread.h>
+#import <Foundation/NSValue.h>
+#import <UnitKit/UnitKit.h>
+
+#import "DBusKit/DKPort.h"
+#import "DBusKit/DKPortNameServer.h"
+
+@interface TestDKPortNameServer: NSObject <UKTest>
+{
+  NSDictionary *reply;
+  NSThread *notificationThread;
+}
+@end
+
+@implementation TestDKPortNameServer
+- (void)completed: (NSDictionary*)aReply
+{
+  [reply release];
+  reply = [aReply retain];
+}
+
+- (void)nameAcquired: (NSNotification*)notification
+{
+  [notificationThread release];
+  notificationThread = [[NSThread currentThread] retain];
+}
+
+- (void)runUntil: (NSDate*)deadline
+{
+  while (((nil == reply) || (nil == notificationThread))
+    && ([deadline timeIntervalSinceNow] > 0))
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  }
+}
+
+- (void)testAsynchronousRegistration
+{
+  DKPortNameServer *server = nil;
+  NSString *name = @"org.gnustep.dbuskit.test.AsynchronousRegistration";
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  server = [DKPortNameServer sharedSessionBusPortNameServer];
+  [reply release];
+  reply = nil;
+  [notificationThread release];
+  notificationThread = nil;
+  [[NSNotificationCenter defaultCenter] addObserver: self
+                                           selector: @selector(nameAcquired:)
+                                               name: DKPortNameAcquiredNotification
+                                             object: server];
+  [server registerPort: [DKPort sessionBusPort]
+                  name: name
+                 flags: DKPortNameDoNotQueue
+                target: self
+              selector: @selector(completed:)];
+  [self runUntil: [NSDate dateWithTimeIntervalSinceNow: 5]];
+  [[NSNotificationCenter defaultCenter] removeObserver: self];
+  UKNotNil(reply);
+  UKNil([reply objectForKey: @"exception"]);
+  UKObjectsEqual(name, [reply objectForKey: @"name"]);
+  UKIntsEqual(DKPortNamePrimaryOwner,
+    [[reply objectForKey: @"status"] unsignedIntValue]);
+  // The notification is posted on the thread that registered the name:
+  UKObjectsSame([NSThread currentThread], notificationThread);
+  [server removePortForName: name];
+}
+
+- (void)testStartServiceWithName
+{
+  DKPortNameServer *server = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  server = [DKPortNameServer sharedSessionBusPortNameServer];
+  [reply release];
+  reply = nil;
+  // Skip waiting for a notification:
+  [notificationThread release];
+  notificationThread = [[NSThread currentThread] retain];
+  [server startServiceWithName: @"org.freedesktop.DBus"
+                        target: self
+                      selector: @selector(completed:)];
+  [self runUntil: [NSDate dateWithTimeIntervalSinceNow: 5]];
+  UKNotNil(reply);
+  UKNil([reply objectForKey: @"exception"]);
+  UKObjectsEqual(@"org.freedesktop.DBus", [reply objectForKey: @"name"]);
+  // The bus is always running:
+  UKIntsEqual(2, [[reply objectForKey: @"result"] unsignedIntValue]);
+}
+
+- (void)dealloc
+{
+  [reply release];
+  [notificationThread release];
+  [super dealloc];
+}
+@end
@@ -28,11 +28,18 @@
 
 #import "DBusKit/DKProxy.h"
 #import "../Source/DKEndpoint.h"
+#import "../Source/DKEndpointManager.h"
+#import "../Source/DKLazyProxy.h"
 #import "DBusKit/DKPort.h"
+#import "DBusKit/DKPreparedCall.h"
 #import "DBusKit/NSConnection+DBus.h"
 
 #import <Foundation/NSArray.h>
+#import <Foundation/NSDate.h>
+#import <Foundation/NSDictionary.h>
 #import <Foundation/NSException.h>
+#import <Foundation/NSLock.h>
+#import <Foundation/NSRunLoop.h>
 #import <Foundation/NSThread.h>
 #import <Foundation/NSXMLNode.h>
 
@@ -44,9 +51,13 @@
 - (void)DBusBuildMethodCache;
 - (NSDictionary*)_interfaces;
 - (NSXMLNode*)XMLNode;
+- (DKEndpoint*)_endpoint;
 @end
 
 @interface TestDKProxy: NSObject <UKTest>
+{
+  NSDictionary *asyncReply;
+}
 @end
 
 @interface NSObject (FakeDBusSelectors)
@@ -304,4 +315,219 @@
 {
   UKNotNil([[DKDBus systemBus] GetId]);
 }
+
+- (void)testProxiesAreShared
+{
+  DKProxy *first = nil;
+  DKProxy *second = nil;
+  DKProxy *other = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  first = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                      path: @"/org/freedesktop/DBus"
+                                       bus: DKDBusSessionBus];
+  second = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                       path: @"/org/freedesktop/DBus"
+                                        bus: DKDBusSessionBus];
+  other = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                      path: @"/"
+                                       bus: DKDBusSessionBus];
+  UKObjectsSame(first, second);
+  UKObjectsNotSame(first, other);
+  [second release];
+  UKNotNil([(id)first GetId]);
+  [first release];
+  [other release];
+}
+
+- (void)testProxyIsRecreatedAfterLastRelease
+{
+  NSAutoreleasePool *arp = [NSAutoreleasePool new];
+  DKProxy *first = nil;
+  DKProxy *second = nil;
+  long long live = 0;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  first = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                      path: @"/org/freedesktop/DBus/Recreated"
+                                       bus: DKDBusSessionBus];
+  [arp release];
+  live = [[[[DKPort allocationStatistics] objectForKey: @"DKProxy"] objectForKey: @"live"] longLongValue];
+  [first release];
+  UKTrue([[[[DKPort allocationStatistics] objectForKey: @"DKProxy"] objectForKey: @"live"] longLongValue] < live);
+
+  // The entry of the deallocated proxy is gone, so we get a fresh one:
+  first = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                      path: @"/org/freedesktop/DBus/Recreated"
+                                       bus: DKDBusSessionBus];
+  second = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                       path: @"/org/freedesktop/DBus/Recreated"
+                                        bus: DKDBusSessionBus];
+  UKNotNil(first);
+  UKObjectsSame(first, second);
+  UKObjectsEqual(@"/org/freedesktop/DBus/Recreated", [(id)first _path]);
+  [second release];
+  [first release];
+}
+
+- (void)testLazyProxy
+{
+  DKEndpoint *ep = nil;
+  DKLazyProxy *lazy = nil;
+  DKProxy *real = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  ep = [[DKDBus sessionBus] _endpoint];
+  lazy = [[DKLazyProxy alloc] initWithEndpoint: ep
+                                       service: @"org.freedesktop.DBus"
+                                          path: @"/org/freedesktop/DBus"];
+  UKTrue([lazy isKindOfClass: [DKProxy class]]);
+  UKObjectsEqual(@"/org/freedesktop/DBus", [lazy _path]);
+  UKNotNil([(id)lazy GetId]);
+  real = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                     path: @"/org/freedesktop/DBus"
+                                      bus: DKDBusSessionBus];
+  UKObjectsSame(real, [lazy _proxy]);
+  UKTrue([lazy isEqual: real]);
+  UKTrue([real isEqual: lazy]);
+  UKIntsEqual([real hash], [lazy hash]);
+  [real release];
+  [lazy release];
+}
+
+- (void)asyncCallCompleted: (NSDictionary*)reply
+{
+  [asyncReply release];
+  asyncReply = [reply retain];
+}
+
+- (void)testAsynchronousCall
+{
+  id aProxy = nil;
+  NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow: 5];
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  aProxy = [DKDBus sessionBus];
+  [asyncReply release];
+  asyncReply = nil;
+  [aProxy callMethod: @selector(NameHasOwner:)
+       withArguments: [NSArray arrayWithObject: @"org.freedesktop.DBus"]
+              target: self
+            selector: @selector(asyncCallCompleted:)
+            userInfo: @"token"];
+  while ((nil == asyncReply) && ([deadline timeIntervalSinceNow] > 0))
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  }
+  UKNotNil(asyncReply);
+  UKNil([asyncReply objectForKey: @"exception"]);
+  UKObjectsEqual(@"token", [asyncReply objectForKey: @"userInfo"]);
+  UKTrue([[asyncReply objectForKey: @"result"] boolValue]);
+  UKRaisesException([aProxy callMethod: @selector(NameHasOwner:)
+                         withArguments: [NSArray array]
+                                target: nil
+                              selector: NULL
+                              userInfo: nil]);
+  [asyncReply release];
+  asyncReply = nil;
+}
+
+/*
+ * Keeps the worker thread busy until workerLock is set to 1, so that nothing
+ * is sent to the bus in the meantime.
+ */
+- (BOOL)blockWorker: (NSConditionLock*)workerLock
+{
+  [workerLock lockWhenCondition: 1];
+  [workerLock unlock];
+  return YES;
+}
+
+- (void)testAsynchronousCallDoesNotWaitForIntrospection
+{
+  NSConditionLock *workerLock = [[NSConditionLock alloc] initWithCondition: 0];
+  id aProxy = nil;
+  NSDate *deadline = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  aProxy = [[DKProxy alloc] initWithService: @"org.freedesktop.DBus"
+                                       path: @"/org/freedesktop/DBus"
+                                        bus: DKDBusSessionBus];
+  [asyncReply release];
+  asyncReply = nil;
+
+  /*
+   * While the worker is blocked, no message can go out on the bus, so the call
+   * can only return if it does not wait for the proxy to be introspected.
+   */
+  [[DKEndpointManager sharedEndpointManager] boolReturnForPerformingSelector: @selector(blockWorker:)
+                                                                      target: self
+                                                                        data: workerLock
+                                                               waitForReturn: NO];
+  UKNotNil([aProxy callMethod: @selector(NameHasOwner:)
+                withArguments: [NSArray arrayWithObject: @"org.freedesktop.DBus"]
+                       target: self
+                     selector: @selector(asyncCallCompleted:)
+                     userInfo: @"token"]);
+  UKNil(asyncReply);
+  [workerLock lock];
+  [workerLock unlockWithCondition: 1];
+
+  deadline = [NSDate dateWithTimeIntervalSinceNow: 5];
+  while ((nil == asyncReply) && ([deadline timeIntervalSinceNow] > 0))
+  {
+    [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode
+                             beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.1]];
+  }
+  UKNotNil(asyncReply);
+  UKNil([asyncReply objectForKey: @"exception"]);
+  UKObjectsEqual(@"token", [asyncReply objectForKey: @"userInfo"]);
+  UKTrue([[asyncReply objectForKey: @"result"] boolValue]);
+  [asyncReply release];
+  asyncReply = nil;
+  [aProxy release];
+  [workerLock release];
+}
+
+- (void)testResultCache
+{
+  NSConnection *conn = nil;
+  id aProxy = nil;
+  id first = nil;
+  unsigned long long hits = 0;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease]];
+  aProxy = [conn rootProxy];
+  [aProxy setResultCacheTTL: 60
+        invalidatedBySignal: nil
+                forSelector: @selector(GetId)];
+  first = [aProxy GetId];
+  hits = [[[DKPort resultCacheStatistics] objectForKey: @"hits"] unsignedLongLongValue];
+  UKObjectsEqual(first, [aProxy GetId]);
+  UKTrue([[[DKPort resultCacheStatistics] objectForKey: @"hits"] unsignedLongLongValue] > hits);
+  [aProxy setResultCacheTTL: 0
+        invalidatedBySignal: nil
+                forSelector: @selector(GetId)];
+}
+
+- (void)testPreparedCall
+{
+  NSConnection *conn = nil;
+  id aProxy = nil;
+  DKPreparedCall *call = nil;
+  id returnValue = nil;
+  NSWarnMLog(@"This test is an expected failure if the session message bus is not available!");
+  conn = [NSConnection connectionWithReceivePort: [DKPort port]
+                                        sendPort: [[[DKPort alloc] initWithRemote: @"org.freedesktop.DBus"] autorelease]];
+  aProxy = [conn rootProxy];
+  call = [DKPreparedCall preparedCallWithProxy: aProxy
+                                      selector: @selector(GetId)];
+  UKNotNil(call);
+  UKIntsEqual(0, [call numberOfArguments]);
+  [call invokeWithReturnValue: &returnValue];
+  UKObjectsEqual([aProxy GetId], returnValue);
+  returnValue = nil;
+  [call invokeWithArguments: NULL
+                returnValue: &returnValue];
+  UKObjectsEqual([aProxy GetId], returnValue);
+  UKRaisesException([DKPreparedCall preparedCallWithProxy: aProxy
+                                                 selector: NSSelectorFromString(@"NoSuchMethod")]);
+}
 @end
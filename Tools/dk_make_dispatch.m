@@ -0,0 +1,413 @@
+/** Tool to generate introspection data for exported classes at build time.
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; see the file COPYING.
+   If not, write to the Free Software Foundation,
+   51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+
+   */
+#import <Foundation/Foundation.h>
+#import "../Source/DKArgument.h"
+#import "../Source/DKInterface.h"
+#import "../Source/DKMethod.h"
+#import "../Source/DKProxy+Private.h"
+
+#include <clang-c/Index.h>
+#include <fcntl.h>
+
+/*
+ * State passed to the libclang visitor while scanning a header.
+ */
+typedef struct
+{
+  /* Names of the classes and protocols to export, nil to export all. */
+  NSSet *wanted;
+  /* Maps "class.Name"/"protocol.Name" to the interface generated for it. */
+  NSMutableDictionary *interfaces;
+  /* Keeps the order in which interfaces were encountered. */
+  NSMutableArray *order;
+} DKScanState;
+
+static enum CXChildVisitResult
+DKCollectMethods(CXCursor cursor, CXCursor parent, CXClientData data)
+{
+  DKInterface *theIf = (DKInterface*)data;
+  if (CXCursor_ObjCInstanceMethodDecl == clang_getCursorKind(cursor))
+  {
+    DKMethod *theMethod = [DKMethod methodWitCXCursor: cursor];
+    if (nil == theMethod)
+    {
+      CXString sel = clang_getCursorSpelling(cursor);
+      GSPrintf(stderr, @"Skipping %s in %@: No D-Bus equivalent for its types.\n",
+        clang_getCString(sel), [theIf name]);
+      clang_disposeString(sel);
+    }
+    else if (nil == [[theIf methods] objectForKey: [theMethod name]])
+    {
+      [theMethod setParent: theIf];
+      [theIf addMethod: theMethod];
+    }
+  }
+  return CXChildVisit_Continue;
+}
+
+static enum CXChildVisitResult
+DKFindClassName(CXCursor cursor, CXCursor parent, CXClientData data)
+{
+  if (CXCursor_ObjCClassRef == clang_getCursorKind(cursor))
+  {
+    CXString name = clang_getCursorSpelling(cursor);
+    *(NSString**)data = [NSString stringWithUTF8String: clang_getCString(name)];
+    clang_disposeString(name);
+    return CXChildVisit_Break;
+  }
+  return CXChildVisit_Continue;
+}
+
+static enum CXChildVisitResult
+DKScanDeclarations(CXCursor cursor, CXCursor parent, CXClientData data)
+{
+  DKScanState *state = (DKScanState*)data;
+  enum CXCursorKind kind = clang_getCursorKind(cursor);
+  NSString *objCName = nil;
+  NSString *typeComponent = @"class";
+  NSString *key = nil;
+  DKInterface *theIf = nil;
+
+  // Only look at declarations from the headers we were asked to scan:
+  if (0 == clang_Location_isFromMainFile(clang_getCursorLocation(cursor)))
+  {
+    return CXChildVisit_Continue;
+  }
+
+  if ((CXCursor_ObjCInterfaceDecl == kind)
+    || (CXCursor_ObjCProtocolDecl == kind))
+  {
+    CXString name = clang_getCursorSpelling(cursor);
+    objCName = [NSString stringWithUTF8String: clang_getCString(name)];
+    clang_disposeString(name);
+    if (CXCursor_ObjCProtocolDecl == kind)
+    {
+      typeComponent = @"protocol";
+    }
+  }
+  else if (CXCursor_ObjCCategoryDecl == kind)
+  {
+    // Methods from categories are exported with the class:
+    clang_visitChildren(cursor, DKFindClassName, &objCName);
+  }
+
+  if ((nil == objCName)
+    || ((nil != state->wanted) && (NO == [state->wanted containsObject: objCName])))
+  {
+    return CXChildVisit_Continue;
+  }
+
+  key = [NSString stringWithFormat: @"%@.%@", typeComponent, objCName];
+  theIf = [state->interfaces objectForKey: key];
+  if (nil == theIf)
+  {
+    // Use the same interface names as +[DKInterface interfaceForObjCClass:]
+    theIf = [[[DKInterface alloc] initWithName: [NSString stringWithFormat: @"org.gnustep.objc.%@", key]
+                                        parent: nil] autorelease];
+    [state->interfaces setObject: theIf
+                          forKey: key];
+    [state->order addObject: key];
+  }
+  clang_visitChildren(cursor, DKCollectMethods, theIf);
+  return CXChildVisit_Continue;
+}
+
+static NSString*
+DKCString(NSString *string)
+{
+  if (nil == string)
+  {
+    return @"NULL";
+  }
+  return [NSString stringWithFormat: @"\"%@\"", string];
+}
+
+static void
+DKAppendArgument(NSMutableString *code, DKArgument *arg, BOOL isOutput)
+{
+  NSString *name = [arg name];
+  if (0 == [name length])
+  {
+    name = nil;
+  }
+  [code appendFormat: @"  {%@, %@, %@, %d},\n",
+    DKCString([arg DBusTypeSignature]),
+    DKCString(name),
+    DKCString([arg annotationValueForKey: @"org.gnustep.objc.class"]),
+    (int)isOutput];
+}
+
+/*
+ * Emits the tables declared in DKGeneratedIntrospection.h for the interfaces
+ * and a constructor registering them with DBusKit.
+ */
+static NSString*
+DKDispatchTableSource(NSArray *order, NSDictionary *interfaces)
+{
+  NSMutableString *code = [NSMutableString stringWithString:
+    @"/* Generated by dk_make_dispatch, do not edit. */\n"
+    @"#import <DBusKit/DKGeneratedIntrospection.h>\n\n"
+    @"#include <stddef.h>\n\n"];
+  NSMutableString *ifTable = [NSMutableString string];
+  NSUInteger ifIndex = 0;
+  NSUInteger ifCount = [order count];
+
+  for (ifIndex = 0; ifIndex < ifCount; ifIndex++)
+  {
+    NSString *key = [order objectAtIndex: ifIndex];
+    DKInterface *theIf = [interfaces objectForKey: key];
+    NSDictionary *methods = [theIf methods];
+    NSArray *methodNames = [[methods allKeys]
+      sortedArrayUsingSelector: @selector(compare:)];
+    NSMutableString *methodTable = [NSMutableString string];
+    NSUInteger methodCount = [methodNames count];
+    NSUInteger methodIndex = 0;
+
+    for (methodIndex = 0; methodIndex < methodCount; methodIndex++)
+    {
+      DKMethod *theMethod = [methods objectForKey: [methodNames objectAtIndex: methodIndex]];
+      NSInteger argIndex = 0;
+      NSUInteger argCount = 0;
+      NSString *argTable = @"NULL";
+      DKArgument *arg = nil;
+      NSMutableString *args = [NSMutableString string];
+
+      // The return value comes first, followed by the input arguments:
+      for (argIndex = -1; nil != (arg = [theMethod DKArgumentAtIndex: argIndex]); argIndex--)
+      {
+        DKAppendArgument(args, arg, YES);
+        argCount++;
+      }
+      for (argIndex = 0; nil != (arg = [theMethod DKArgumentAtIndex: argIndex]); argIndex++)
+      {
+        DKAppendArgument(args, arg, NO);
+        argCount++;
+      }
+      if (0 != argCount)
+      {
+        argTable = [NSString stringWithFormat: @"DKGenArgs_%lu_%lu",
+          (unsigned long)ifIndex, (unsigned long)methodIndex];
+        [code appendFormat: @"static const DKGeneratedArgument %@[] = {\n%@};\n\n",
+          argTable, args];
+      }
+      [methodTable appendFormat: @"  {%@, %@, %@, %lu},\n",
+        DKCString([theMethod name]),
+        DKCString([theMethod selectorString]),
+        argTable,
+        (unsigned long)argCount];
+    }
+    [code appendFormat: @"static const DKGeneratedMethod DKGenMethods_%lu[] = {\n%@};\n\n",
+      (unsigned long)ifIndex, methodTable];
+    [ifTable appendFormat: @"  {%@, %d, %@, DKGenMethods_%lu, %lu},\n",
+      DKCString([key substringFromIndex: NSMaxRange([key rangeOfString: @"."])]),
+      (int)[key hasPrefix: @"protocol."],
+      DKCString([theIf name]),
+      (unsigned long)ifIndex,
+      (unsigned long)methodCount];
+  }
+  [code appendFormat: @"static const DKGeneratedInterface DKGenInterfaces[] = {\n%@};\n\n", ifTable];
+  [code appendFormat: @"static DKGeneratedIntrospectionTable DKGenTable = {DKGenInterfaces, %lu, NULL};\n\n",
+    (unsigned long)ifCount];
+  [code appendString: @"static void __attribute__((constructor))\n"
+    @"DKGenRegister(void)\n"
+    @"{\n"
+    @"  DKRegisterGeneratedIntrospection(&DKGenTable);\n"
+    @"}\n"];
+  return code;
+}
+
+static NSString*
+DKIntrospectionXML(NSArray *order, NSDictionary *interfaces)
+{
+  NSMutableArray *ifNodes = [NSMutableArray array];
+  NSEnumerator *keyEnum = [order objectEnumerator];
+  NSString *key = nil;
+  while (nil != (key = [keyEnum nextObject]))
+  {
+    NSXMLNode *ifNode = [[interfaces objectForKey: key] XMLNode];
+    if (nil != ifNode)
+    {
+      [ifNodes addObject: ifNode];
+    }
+  }
+  return [NSString stringWithFormat: @"%@\n%@\n", kDKDBusDocType,
+    [[NSXMLNode elementWithName: @"node"
+                       children: ifNodes
+                     attributes: nil] XMLString]];
+}
+
+static BOOL
+DKWriteString(NSString *string, NSString *path)
+{
+  NSFileHandle *outHandle = nil;
+  if (nil == path)
+  {
+    outHandle = [NSFileHandle fileHandleWithStandardOutput];
+  }
+  else
+  {
+    int fd = creat([[path stringByStandardizingPath] UTF8String], 0644);
+    if (-1 == fd)
+    {
+      GSPrintf(stderr, @"Could not open '%@'.\n", path);
+      return NO;
+    }
+    outHandle = [[[NSFileHandle alloc] initWithFileDescriptor: fd
+                                               closeOnDealloc: YES] autorelease];
+  }
+  [outHandle writeData: [string dataUsingEncoding: NSUTF8StringEncoding
+                             allowLossyConversion: YES]];
+  return YES;
+}
+
+int main (int argc, char **argv, char **env)
+{
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSProcessInfo *info = [NSProcessInfo processInfo];
+  NSArray *args = [info arguments];
+  NSUInteger argCount = [args count];
+  NSUInteger argIndex = 1;
+  NSMutableSet *wanted = nil;
+  NSMutableArray *headers = [NSMutableArray array];
+  NSMutableArray *clangArgs = [NSMutableArray arrayWithObjects: @"-x", @"objective-c", nil];
+  NSString *xmlPath = nil;
+  NSString *codePath = nil;
+  BOOL writeXML = NO;
+  BOOL writeCode = NO;
+  const char **cArgs = NULL;
+  NSUInteger i = 0;
+  CXIndex index = NULL;
+  DKScanState state;
+  NSEnumerator *headerEnum = nil;
+  NSString *header = nil;
+  int status = 0;
+
+  for (argIndex = 1; argIndex < argCount; argIndex++)
+  {
+    NSString *thisArg = [args objectAtIndex: argIndex];
+    BOOL hasValue = ((argIndex + 1) < argCount);
+    if (([thisArg isEqualToString: @"-c"]) && hasValue)
+    {
+      if (nil == wanted)
+      {
+        wanted = [NSMutableSet set];
+      }
+      [wanted addObject: [args objectAtIndex: ++argIndex]];
+    }
+    else if (([thisArg isEqualToString: @"-x"]) && hasValue)
+    {
+      xmlPath = [args objectAtIndex: ++argIndex];
+      writeXML = YES;
+    }
+    else if (([thisArg isEqualToString: @"-o"]) && hasValue)
+    {
+      codePath = [args objectAtIndex: ++argIndex];
+      writeCode = YES;
+    }
+    else if ([thisArg hasPrefix: @"-"])
+    {
+      // Everything else (-I, -D, -F, ...) is for the compiler
+      [clangArgs addObject: thisArg];
+    }
+    else
+    {
+      [headers addObject: thisArg];
+    }
+  }
+
+  if ((0 == [headers count]) || ((NO == writeXML) && (NO == writeCode)))
+  {
+    GSPrintf(stderr, @"Usage: dk_make_dispatch [-c name]... [-x file.xml] [-o file.m] [compiler flags] header...\n"
+      @"'-c' names a class or protocol to export (default: all declared in the headers).\n"
+      @"'-x' writes D-Bus introspection data, '-o' a dispatch table to link into the service.\n"
+      @"Use '-' as the file name to write to stdout.\n");
+    [pool release];
+    return 1;
+  }
+
+  state.wanted = wanted;
+  state.interfaces = [NSMutableDictionary dictionary];
+  state.order = [NSMutableArray array];
+
+  cArgs = malloc([clangArgs count] * sizeof(char*));
+  for (i = 0; i < [clangArgs count]; i++)
+  {
+    cArgs[i] = [[clangArgs objectAtIndex: i] UTF8String];
+  }
+
+  index = clang_createIndex(0, 1);
+  headerEnum = [headers objectEnumerator];
+  while (nil != (header = [headerEnum nextObject]))
+  {
+    CXTranslationUnit unit = clang_parseTranslationUnit(index,
+      [header UTF8String],
+      cArgs,
+      (int)[clangArgs count],
+      NULL,
+      0,
+      CXTranslationUnit_SkipFunctionBodies);
+    if (NULL == unit)
+    {
+      GSPrintf(stderr, @"Could not parse '%@'.\n", header);
+      status = 1;
+      continue;
+    }
+    clang_visitChildren(clang_getTranslationUnitCursor(unit),
+      DKScanDeclarations,
+      &state);
+    clang_disposeTranslationUnit(unit);
+  }
+  clang_disposeIndex(index);
+  free(cArgs);
+
+  // Don't bother exporting empty interfaces:
+  for (i = [state.order count]; i > 0; i--)
+  {
+    NSString *key = [state.order objectAtIndex: (i - 1)];
+    if (0 == [[[state.interfaces objectForKey: key] methods] count])
+    {
+      [state.order removeObjectAtIndex: (i - 1)];
+    }
+  }
+
+  if (0 == [state.order count])
+  {
+    GSPrintf(stderr, @"No exportable classes or protocols found.\n");
+    [pool release];
+    return 1;
+  }
+
+  if ([xmlPath isEqualToString: @"-"])
+  {
+    xmlPath = nil;
+  }
+  if ([codePath isEqualToString: @"-"])
+  {
+    codePath = nil;
+  }
+  if (writeXML
+    && (NO == DKWriteString(DKIntrospectionXML(state.order, state.interfaces), xmlPath)))
+  {
+    status = 1;
+  }
+  if (writeCode
+    && (NO == DKWriteString(DKDispatchTableSource(state.order, state.interfaces), codePath)))
+  {
+    status = 1;
+  }
+  [pool release];
+  return status;
+}